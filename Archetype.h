@@ -0,0 +1,283 @@
+
+#ifndef INC_ARCHETYPE
+#define INC_ARCHETYPE
+
+#include "ObjectManager.h"
+
+
+#include <vector>
+#include <new>
+#include <boost/static_assert.hpp>
+#include <boost/type_traits/is_same.hpp>
+#include <boost/type_traits/alignment_of.hpp>
+#include <boost/type_traits/aligned_storage.hpp>
+#include <boost/utility/in_place_factory.hpp>
+
+
+namespace Cistron {
+
+using std::vector;
+
+
+/**
+ * ARCHETYPES
+ * An archetype is a set of component types known at compile time, like Archetype<Person, Job>. The components of an
+ * object created by an archetype are constructed in place in one block, at offsets computed at compile time, so a
+ * component reaches the other components of its object without looking them up. The components are added to the
+ * object like any other, and receive and send messages and requests as usual.
+ */
+
+// an unused component slot of an archetype
+struct ArchetypeNone {};
+
+// size and alignment of a component slot - an unused slot takes no space
+template<class T>
+struct ArchetypeSlot {
+	enum {
+		SIZE = sizeof(T),
+		ALIGN = boost::alignment_of<T>::value
+	};
+};
+template<>
+struct ArchetypeSlot<ArchetypeNone> {
+	enum {
+		SIZE = 0,
+		ALIGN = 1
+	};
+};
+
+// round an offset up to an alignment
+template<unsigned OFFSET, unsigned ALIGN>
+struct ArchetypeAlign {
+	enum {
+		value = (OFFSET + ALIGN - 1) / ALIGN * ALIGN
+	};
+};
+
+// construct a component in its slot with an in-place factory - nothing for an unused slot
+template<class T>
+struct ArchetypeConstruct {
+	template<class F>
+	static inline Component* apply(void *address, F const & factory) {
+		return static_cast<T*>(factory.BOOST_NESTED_TEMPLATE apply<T>(address));
+	}
+	static inline void destroy(void *address) {
+		static_cast<T*>(address)->~T();
+	}
+};
+template<>
+struct ArchetypeConstruct<ArchetypeNone> {
+	template<class F>
+	static inline Component* apply(void*, F const &) {
+		return 0;
+	}
+	static inline void destroy(void*) {
+	}
+};
+
+
+// objects with a fixed set of up to four component types
+template<class A, class B = ArchetypeNone, class C = ArchetypeNone, class D = ArchetypeNone>
+class Archetype {
+
+	public:
+
+		// compile-time layout of the components in a block
+		enum {
+			OFFSET_A = 0,
+			OFFSET_B = ArchetypeAlign<OFFSET_A + ArchetypeSlot<A>::SIZE, ArchetypeSlot<B>::ALIGN>::value,
+			OFFSET_C = ArchetypeAlign<OFFSET_B + ArchetypeSlot<B>::SIZE, ArchetypeSlot<C>::ALIGN>::value,
+			OFFSET_D = ArchetypeAlign<OFFSET_C + ArchetypeSlot<C>::SIZE, ArchetypeSlot<D>::ALIGN>::value,
+			SIZE = OFFSET_D + ArchetypeSlot<D>::SIZE,
+			ALIGN_AB = (int)ArchetypeSlot<A>::ALIGN > (int)ArchetypeSlot<B>::ALIGN ? (int)ArchetypeSlot<A>::ALIGN : (int)ArchetypeSlot<B>::ALIGN,
+			ALIGN_CD = (int)ArchetypeSlot<C>::ALIGN > (int)ArchetypeSlot<D>::ALIGN ? (int)ArchetypeSlot<C>::ALIGN : (int)ArchetypeSlot<D>::ALIGN,
+			ALIGN = ALIGN_AB > ALIGN_CD ? ALIGN_AB : ALIGN_CD
+		};
+
+		// offset of a component type in the block - a compile error if the archetype doesn't contain the type
+		template<class T>
+		struct Offset {
+			enum {
+				value = boost::is_same<T, A>::value ? OFFSET_A :
+					boost::is_same<T, B>::value ? OFFSET_B :
+					boost::is_same<T, C>::value ? OFFSET_C :
+					boost::is_same<T, D>::value ? OFFSET_D : -1
+			};
+			BOOST_STATIC_ASSERT(value >= 0 && !(boost::is_same<T, ArchetypeNone>::value));
+		};
+
+		// the components of one object
+		class Instance {
+
+			public:
+
+				// get a component of the object
+				template<class T>
+				inline T* get() {
+					return reinterpret_cast<T*>(reinterpret_cast<char*>(&fData) + Offset<T>::value);
+				}
+
+				// get the object
+				inline ObjectId getObjectId() {
+					return fObjectId;
+				}
+
+			private:
+
+				// the components, at the start of the instance
+				typename boost::aligned_storage<SIZE, ALIGN>::type fData;
+
+				// the object they are part of
+				ObjectId fObjectId;
+
+				friend class Archetype;
+
+		};
+
+		// constructor/destructor - the components are owned by the archetype, which must outlive their use
+		// by the object manager: destroy it after the objects, or after the object manager was shut down
+		Archetype(ObjectManager *objectManager, unsigned chunkSize = 256);
+		virtual ~Archetype();
+
+		// create a finalized object with the components constructed in place, and added in order
+		// the factories are boost::in_place(constructor arguments), components without one are default constructed
+		Instance* create();
+		template<class FA>
+		Instance* create(FA const &);
+		template<class FA, class FB>
+		Instance* create(FA const &, FB const &);
+		template<class FA, class FB, class FC>
+		Instance* create(FA const &, FB const &, FC const &);
+		template<class FA, class FB, class FC, class FD>
+		Instance* create(FA const &, FB const &, FC const &, FD const &);
+
+		// get the instance of a component created by this archetype, and another component of its object
+		// only for components created by an archetype of this type, there is no check
+		template<class T>
+		static inline Instance* getInstance(T *component) {
+			return reinterpret_cast<Instance*>(reinterpret_cast<char*>(component) - Offset<T>::value);
+		}
+		template<class T, class U>
+		static inline T* getComponent(U *component) {
+			return getInstance(component)->BOOST_NESTED_TEMPLATE get<T>();
+		}
+
+		// instances in order of creation, stored contiguously in chunks - instances of destroyed objects aren't reused
+		inline unsigned getCount() {
+			return fCount;
+		}
+		inline Instance* getInstanceAt(unsigned index) {
+			return &fChunks[index / fChunkSize][index % fChunkSize];
+		}
+
+	private:
+
+		// the first slot can't be unused
+		BOOST_STATIC_ASSERT(!(boost::is_same<A, ArchetypeNone>::value));
+
+		// take the storage for a new instance
+		Instance* allocate();
+
+		// add the constructed components to a new object
+		Instance* add(Instance*, Component *a, Component *b, Component *c, Component *d);
+
+		// object manager the objects are created in
+		ObjectManager *fObjectManager;
+
+		// instances, in chunks of a fixed size
+		vector<Instance*> fChunks;
+		unsigned fChunkSize;
+		unsigned fCount;
+
+		// can't be copied, it owns the components
+		Archetype(Archetype const &);
+		Archetype& operator=(Archetype const &);
+
+};
+
+
+/**
+ * TEMPLATED ARCHETYPE FUNCTIONS
+ */
+
+// constructor/destructor
+template<class A, class B, class C, class D>
+Archetype<A, B, C, D>::Archetype(ObjectManager *objectManager, unsigned chunkSize) : fObjectManager(objectManager), fChunkSize(chunkSize > 0 ? chunkSize : 1), fCount(0) {
+}
+template<class A, class B, class C, class D>
+Archetype<A, B, C, D>::~Archetype() {
+
+	// destroy the components in the reverse order of construction
+	for (unsigned i = 0; i < fCount; ++i) {
+		char *data = reinterpret_cast<char*>(&getInstanceAt(i)->fData);
+		ArchetypeConstruct<D>::destroy(data + OFFSET_D);
+		ArchetypeConstruct<C>::destroy(data + OFFSET_C);
+		ArchetypeConstruct<B>::destroy(data + OFFSET_B);
+		ArchetypeConstruct<A>::destroy(data + OFFSET_A);
+	}
+	for (unsigned i = 0; i < fChunks.size(); ++i) {
+		delete[] fChunks[i];
+	}
+}
+
+// take the storage for a new instance
+template<class A, class B, class C, class D>
+typename Archetype<A, B, C, D>::Instance* Archetype<A, B, C, D>::allocate() {
+	if (fCount == fChunks.size() * fChunkSize) fChunks.push_back(new Instance[fChunkSize]);
+	return getInstanceAt(fCount);
+}
+
+// add the constructed components to a new object
+template<class A, class B, class C, class D>
+typename Archetype<A, B, C, D>::Instance* Archetype<A, B, C, D>::add(Instance *instance, Component *a, Component *b, Component *c, Component *d) {
+
+	// the instance is only counted once every component is constructed, so the destructor doesn't see half of one
+	++fCount;
+
+	// create the object, and add the components like any other
+	instance->fObjectId = fObjectManager->createObject();
+	fObjectManager->addComponent(instance->fObjectId, a);
+	if (b != 0) fObjectManager->addComponent(instance->fObjectId, b);
+	if (c != 0) fObjectManager->addComponent(instance->fObjectId, c);
+	if (d != 0) fObjectManager->addComponent(instance->fObjectId, d);
+	fObjectManager->finalizeObject(instance->fObjectId);
+	return instance;
+}
+
+// create an object
+template<class A, class B, class C, class D>
+typename Archetype<A, B, C, D>::Instance* Archetype<A, B, C, D>::create() {
+	return create(boost::in_place(), boost::in_place(), boost::in_place(), boost::in_place());
+}
+template<class A, class B, class C, class D>
+template<class FA>
+typename Archetype<A, B, C, D>::Instance* Archetype<A, B, C, D>::create(FA const & fa) {
+	return create(fa, boost::in_place(), boost::in_place(), boost::in_place());
+}
+template<class A, class B, class C, class D>
+template<class FA, class FB>
+typename Archetype<A, B, C, D>::Instance* Archetype<A, B, C, D>::create(FA const & fa, FB const & fb) {
+	return create(fa, fb, boost::in_place(), boost::in_place());
+}
+template<class A, class B, class C, class D>
+template<class FA, class FB, class FC>
+typename Archetype<A, B, C, D>::Instance* Archetype<A, B, C, D>::create(FA const & fa, FB const & fb, FC const & fc) {
+	return create(fa, fb, fc, boost::in_place());
+}
+template<class A, class B, class C, class D>
+template<class FA, class FB, class FC, class FD>
+typename Archetype<A, B, C, D>::Instance* Archetype<A, B, C, D>::create(FA const & fa, FB const & fb, FC const & fc, FD const & fd) {
+	Instance *instance = allocate();
+	char *data = reinterpret_cast<char*>(&instance->fData);
+	Component *a = ArchetypeConstruct<A>::apply(data + OFFSET_A, fa);
+	Component *b = ArchetypeConstruct<B>::apply(data + OFFSET_B, fb);
+	Component *c = ArchetypeConstruct<C>::apply(data + OFFSET_C, fc);
+	Component *d = ArchetypeConstruct<D>::apply(data + OFFSET_D, fd);
+	return add(instance, a, b, c, d);
+}
+
+
+};
+
+
+#endif
@@ -0,0 +1,198 @@
+
+#include "Atom.h"
+
+
+using namespace Cistron;
+
+
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/mutex.hpp>
+
+using std::vector;
+
+
+namespace {
+
+
+// names are stored in chunks that never move, so a name can be read while other threads add names
+static const unsigned ATOM_CHUNK_BITS = 10;
+static const unsigned ATOM_CHUNK_SIZE = 1 << ATOM_CHUNK_BITS;
+
+// initial number of chunks in the directory, which doubles when it's full
+static const unsigned ATOM_CHUNKS = 64;
+
+
+// hash of a name
+inline std::size_t hashName(string_ref s) {
+	return boost::hash_range(s.begin(), s.end());
+}
+
+
+// an open addressing index from name to atom id, at most half full - 0 is an empty slot
+struct AtomIndex {
+	unsigned fMask;
+	boost::atomic<AtomId> *fSlots;
+	AtomIndex(unsigned capacity) : fMask(capacity - 1), fSlots(new boost::atomic<AtomId>[capacity]) {
+		for (unsigned i = 0; i < capacity; ++i) fSlots[i].store(0, boost::memory_order_relaxed);
+	}
+};
+
+
+// the atom table
+// reading it is lock-free: names and index slots are published with release stores, and only adding a name takes the lock
+struct AtomTable {
+
+	// interned names by atom id, in chunks - replaced directories are kept, because readers may still be reading them
+	boost::atomic<string**> fChunks;
+	unsigned fNChunks;
+	vector<string**> fRetiredChunks;
+
+	// number of names, including the empty name
+	boost::atomic<unsigned> fCount;
+
+	// current index - replaced indices are kept, because readers may still be probing them
+	boost::atomic<AtomIndex*> fIndex;
+	vector<AtomIndex*> fRetired;
+
+	// guards adding names
+	boost::mutex fMutex;
+
+	// the empty name is atom 0, and isn't in the index
+	AtomTable() : fChunks(new string*[ATOM_CHUNKS]), fNChunks(ATOM_CHUNKS), fCount(1), fIndex(new AtomIndex(1024)) {
+		string **chunks = fChunks.load(boost::memory_order_relaxed);
+		for (unsigned i = 0; i < ATOM_CHUNKS; ++i) chunks[i] = 0;
+		chunks[0] = new string[ATOM_CHUNK_SIZE];
+	}
+
+	// get a name
+	inline string const & name(AtomId id) const {
+		return fChunks.load(boost::memory_order_acquire)[id >> ATOM_CHUNK_BITS][id & (ATOM_CHUNK_SIZE - 1)];
+	}
+
+	// look up a name in the current index, returns 0 if it isn't there
+	AtomId lookup(string_ref s, std::size_t hash) const {
+		AtomIndex *index = fIndex.load(boost::memory_order_acquire);
+		for (unsigned i = hash & index->fMask; ; i = (i + 1) & index->fMask) {
+			AtomId id = index->fSlots[i].load(boost::memory_order_acquire);
+			if (id == 0) return 0;
+			string const & n = name(id);
+			if (n.size() == s.size() && string_ref(n) == s) return id;
+		}
+	}
+
+	// put an id in an index, with the lock held
+	static void insert(AtomIndex *index, AtomId id, std::size_t hash) {
+		unsigned i = hash & index->fMask;
+		while (index->fSlots[i].load(boost::memory_order_relaxed) != 0) i = (i + 1) & index->fMask;
+		index->fSlots[i].store(id, boost::memory_order_release);
+	}
+
+	// add a name, with the lock held
+	AtomId add(string_ref s, std::size_t hash) {
+
+		// a directory with room for the chunk of the new id, complete when it's published
+		AtomId id = fCount.load(boost::memory_order_relaxed);
+		string **chunks = fChunks.load(boost::memory_order_relaxed);
+		if ((id >> ATOM_CHUNK_BITS) >= fNChunks) {
+			string **grown = new string*[2 * fNChunks];
+			for (unsigned i = 0; i < fNChunks; ++i) grown[i] = chunks[i];
+			for (unsigned i = fNChunks; i < 2 * fNChunks; ++i) grown[i] = 0;
+			fRetiredChunks.push_back(chunks);
+			fNChunks *= 2;
+			chunks = grown;
+			fChunks.store(chunks, boost::memory_order_release);
+		}
+
+		// store the name before anyone can find its id
+		if (chunks[id >> ATOM_CHUNK_BITS] == 0) chunks[id >> ATOM_CHUNK_BITS] = new string[ATOM_CHUNK_SIZE];
+		chunks[id >> ATOM_CHUNK_BITS][id & (ATOM_CHUNK_SIZE - 1)].assign(s.begin(), s.end());
+		fCount.store(id + 1, boost::memory_order_release);
+
+		// grow the index before it gets more than half full - the new one is complete when it's published
+		AtomIndex *index = fIndex.load(boost::memory_order_relaxed);
+		if (2 * (id + 1) > index->fMask + 1) {
+			AtomIndex *grown = new AtomIndex(2 * (index->fMask + 1));
+			for (AtomId i = 1; i < id; ++i) insert(grown, i, hashName(name(i)));
+			insert(grown, id, hash);
+			fRetired.push_back(index);
+			fIndex.store(grown, boost::memory_order_release);
+		}
+		else insert(index, id, hash);
+		return id;
+	}
+};
+
+
+// global atom table, constructed on first use
+AtomTable& getAtomTable() {
+	static AtomTable table;
+	return table;
+}
+
+
+};
+
+
+// constructors
+Atom::Atom(const char *name) : fId(intern(string_ref(name))) {
+}
+Atom::Atom(string const & name) : fId(intern(string_ref(name))) {
+}
+Atom::Atom(string_ref name) : fId(intern(name)) {
+}
+
+
+// intern a name
+AtomId Atom::intern(string_ref name) {
+	if (name.empty()) return 0;
+	AtomTable& table = getAtomTable();
+
+	// already exists, without locking
+	std::size_t hash = hashName(name);
+	AtomId id = table.lookup(name, hash);
+	if (id != 0) return id;
+
+	// look again with the lock held, another thread might have added it
+	boost::mutex::scoped_lock lock(table.fMutex);
+	id = table.lookup(name, hash);
+	if (id != 0) return id;
+	return table.add(name, hash);
+}
+
+
+// look up an atom without interning it
+Atom Atom::find(string_ref name) {
+	Atom a;
+	if (name.empty()) return a;
+	AtomTable& table = getAtomTable();
+	std::size_t hash = hashName(name);
+	a.fId = table.lookup(name, hash);
+
+	// not found - it might have been added while we were probing an index that was being replaced
+	if (a.fId == 0) {
+		boost::mutex::scoped_lock lock(table.fMutex);
+		a.fId = table.lookup(name, hash);
+	}
+	return a;
+}
+
+
+// get the interned name
+// names never move, and an atom is only handed out after its name was stored
+string const & Atom::str() const {
+	return getAtomTable().name(fId);
+}
+
+
+// number of atoms
+unsigned Atom::count() {
+	return getAtomTable().fCount.load(boost::memory_order_acquire);
+}
+
+
+// output
+std::ostream& operator<<(std::ostream& s, Atom const & a) {
+	return s << a.str();
+}
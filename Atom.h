@@ -0,0 +1,77 @@
+
+#ifndef INC_ATOM
+#define INC_ATOM
+
+
+#include <string>
+#include <ostream>
+#include <boost/utility/string_ref.hpp>
+
+
+namespace Cistron {
+
+using std::string;
+using boost::string_ref;
+
+
+// atom id - 0 is reserved for the empty name
+typedef unsigned AtomId;
+
+
+// an atom is an interned name (component, message, group or query name) - object names are kept by the object manager
+// every distinct name is stored only once, in a global atom table, and an atom is just the integer index into that table
+// converting a string to an atom only performs a lookup - the string is copied once, the first time it is seen
+// the atom table is shared by all threads, so components can be constructed on any thread - only adding a new name locks it
+class Atom {
+
+	public:
+
+		// constructors - the name is interned if it doesn't exist yet
+		Atom() : fId(0) {};
+		Atom(const char *name);
+		Atom(string const & name);
+		Atom(string_ref name);
+
+		// get the integer id of the atom
+		inline AtomId getId() const {
+			return fId;
+		}
+
+		// get the interned name
+		string const & str() const;
+
+		// the empty name is not a valid atom
+		inline bool isValid() const {
+			return fId != 0;
+		}
+
+		// comparison
+		inline bool operator==(Atom const & a) const { return fId == a.fId; }
+		inline bool operator!=(Atom const & a) const { return fId != a.fId; }
+		inline bool operator<(Atom const & a) const { return fId < a.fId; }
+
+		// look up an atom without interning it - returns an invalid atom if the name was never seen
+		static Atom find(string_ref name);
+
+		// number of atoms in the table (including the empty name)
+		static unsigned count();
+
+	private:
+
+		// intern a name
+		static AtomId intern(string_ref name);
+
+		// id in the atom table
+		AtomId fId;
+
+};
+
+
+};
+
+
+// output
+std::ostream& operator<<(std::ostream& s, Cistron::Atom const & a);
+
+
+#endif
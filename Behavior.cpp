@@ -0,0 +1,83 @@
+
+#include "Behavior.h"
+#include "ObjectManager.h"
+
+
+using namespace Cistron;
+
+
+#include <new>
+#include <boost/pool/pool.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/once.hpp>
+
+
+// frames are allocated from one pool per size class, bigger frames fall back to the heap
+static const std::size_t FRAME_GRANULARITY = 16;
+static const std::size_t FRAME_CLASSES = 32;
+
+// the pools are shared by all object managers, which can be owned by different threads (staging object managers),
+// so they are locked - they live as long as the process, so behaviors can still be deleted during static destruction
+struct FramePools {
+	boost::mutex mutex;
+	boost::pool<>* pools[FRAME_CLASSES];
+	FramePools() {
+		for (std::size_t i = 0; i < FRAME_CLASSES; ++i) pools[i] = 0;
+	}
+};
+static FramePools *framePools = 0;
+static boost::once_flag framePoolsOnce = BOOST_ONCE_INIT;
+static void createFramePools() {
+	framePools = new FramePools();
+}
+
+// get the pool for a frame size, with the lock held
+static boost::pool<>* getFramePool(std::size_t size) {
+
+	// too big
+	std::size_t sizeClass = (size + FRAME_GRANULARITY - 1) / FRAME_GRANULARITY;
+	if (sizeClass >= FRAME_CLASSES) return 0;
+
+	// create the pool on first use
+	boost::pool<>*& pool = framePools->pools[sizeClass];
+	if (pool == 0) pool = new boost::pool<>(sizeClass * FRAME_GRANULARITY);
+	return pool;
+}
+
+
+// allocate a frame
+void* Behavior::operator new(std::size_t size) {
+	boost::call_once(framePoolsOnce, createFramePools);
+	void *p;
+	{
+		boost::mutex::scoped_lock lock(framePools->mutex);
+		boost::pool<>* pool = getFramePool(size);
+		if (pool == 0) return ::operator new(size);
+		p = pool->malloc();
+	}
+	if (p == 0) throw std::bad_alloc();
+	return p;
+}
+
+// free a frame
+void Behavior::operator delete(void *p, std::size_t size) {
+	boost::mutex::scoped_lock lock(framePools->mutex);
+	boost::pool<>* pool = getFramePool(size);
+	if (pool == 0) ::operator delete(p);
+	else pool->free(p);
+}
+
+
+// constructor/destructor
+Behavior::Behavior() : fComponent(0), fWaitReqId(0), fWaitType(MESSAGE), fWaitSerial(0), fDead(false) {
+	fPrev[0] = fPrev[1] = fNext[0] = fNext[1] = 0;
+	fLinked[0] = fLinked[1] = false;
+}
+Behavior::~Behavior() {
+}
+
+
+// wait for an event
+void Behavior::await(Awaitable const & a) {
+	fComponent->getObjectManager()->awaitBehavior(this, a);
+}
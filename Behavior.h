@@ -0,0 +1,110 @@
+
+#ifndef INC_BEHAVIOR
+#define INC_BEHAVIOR
+
+#include "Component.h"
+
+
+#include <cstddef>
+#include <boost/asio/coroutine.hpp>
+
+
+namespace Cistron {
+
+
+// an event a behavior can wait for
+struct Awaitable {
+	ComponentRequestType type;
+	Atom name;
+	bool local;
+	Awaitable(ComponentRequestType t, Atom n, bool l) : type(t), name(n), local(l) {};
+};
+
+// wait for the next message of a given type, sent globally or to the object of the behavior
+inline Awaitable nextMessage(Atom name) {
+	return Awaitable(REQ_MESSAGE, name, false);
+}
+
+// wait for the next component of a given type to be created, in the object of the behavior unless local is false
+inline Awaitable componentCreated(Atom name, bool local = true) {
+	return Awaitable(REQ_COMPONENT, name, local);
+}
+
+
+/**
+ * A behavior is a stackless coroutine owned by a component.
+ * Multi-step logic is written as one function, using the reenter/yield macros of <boost/asio/yield.hpp>:
+ *
+ *   void resume(Message const & msg) {
+ *       reenter (this) {
+ *           yield await(componentCreated("Job"));
+ *           fJob = (Job*)msg.sender;
+ *           while (true) {
+ *               yield await(nextMessage("NextYear"));
+ *               ...
+ *           }
+ *       }
+ *   }
+ *
+ * resume() is called once when the behavior is started, and again every time the awaited event happens,
+ * with the message of that event. A waiting behavior holds no request registration, only its own (pooled) frame.
+ * The behavior is deleted when it completes, when it returns without awaiting anything, or when its component is destroyed.
+ * Local variables don't survive a yield - keep state in members.
+ */
+class Behavior : public boost::asio::coroutine {
+
+	public:
+
+		// constructor/destructor
+		Behavior();
+		virtual ~Behavior();
+
+		// body of the coroutine
+		virtual void resume(Message const & msg) = 0;
+
+		// get the component that owns this behavior
+		inline Component* getComponent() {
+			return fComponent;
+		}
+
+		// frames are allocated from pools, shared by all object managers - safe from any thread
+		static void* operator new(std::size_t size);
+		static void operator delete(void *p, std::size_t size);
+
+	protected:
+
+		// suspend until the event happens - call this as the argument of yield
+		void await(Awaitable const &);
+
+	private:
+
+		// owning component
+		Component *fComponent;
+
+		// request we are waiting for, 0 if not waiting
+		RequestId fWaitReqId;
+
+		// type of event we are waiting for
+		MessageType fWaitType;
+
+		// incremented every time we start waiting
+		unsigned fWaitSerial;
+
+		// links in the global (0) and local (1) wait lists
+		Behavior *fPrev[2];
+		Behavior *fNext[2];
+		bool fLinked[2];
+
+		// the component is gone or the behavior finished
+		bool fDead;
+
+		// object manager is our friend
+		friend class ObjectManager;
+
+};
+
+
+};
+
+
+#endif
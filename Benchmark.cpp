@@ -0,0 +1,473 @@
+
+/**
+ * Benchmark program running the scenario of the example program at scale.
+ * Persons age every year, companies give jobs to new persons and fire those who turn 65,
+ * the government keeps the total earned income and advances the calendar.
+ * Persons who turn 80 leave, and are replaced by a new person of 20, so the population stays the same.
+ *
+ * Usage: Benchmark [persons] [companies] [density] [years] [counters] [fast]
+ *    - persons: number of persons (default 2000)
+ *    - companies: number of companies (default 10), a person works for the company with the index of its object id
+ *    - density: fraction of the persons that subscribe to the birthdays of everyone (default 0.01)
+ *    - years: number of simulated years (default 50)
+ *    - counters: 1 to read the hardware performance counters, on Linux (default 0)
+ *    - fast: 1 to tear down without DESTROY messages (default 0)
+ *
+ * The defaults run in about a second. The birthday messages grow with the square of the persons times the density,
+ * and so does a graceful teardown with the persons, so larger runs take minutes - use fast to time the simulation only.
+ *
+ * It reports the time, the messages delivered, the components created and the allocations of every phase,
+ * the years and messages per second of the simulation, the peak resident set size,
+ * and the memory used by the object manager at the end of the simulation.
+ * With counters, it reports the cycles, instructions, cache misses and branch misses of every phase,
+ * per message delivered and per component created.
+ */
+
+#include "Cistron.h"
+
+using namespace Cistron;
+
+
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <new>
+#include <boost/chrono.hpp>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+using namespace std;
+
+
+
+/**
+ * COUNTERS
+ */
+
+// number of messages delivered to the components
+static unsigned long long gMessages = 0;
+
+// number of components created
+static unsigned long long gComponents = 0;
+
+// number of allocations
+static unsigned long long gAllocations = 0;
+
+// the replacement operators keep the exception specifications of the standard ones before C++11
+#if __cplusplus < 201103L
+#define THROWS_BAD_ALLOC throw(std::bad_alloc)
+#define THROWS_NOTHING throw()
+#else
+#define THROWS_BAD_ALLOC
+#define THROWS_NOTHING noexcept
+#endif
+
+// count every allocation
+void* operator new(size_t size) THROWS_BAD_ALLOC {
+	++gAllocations;
+	void *p = malloc(size != 0 ? size : 1);
+	if (p == 0) throw std::bad_alloc();
+	return p;
+}
+void* operator new[](size_t size) THROWS_BAD_ALLOC {
+	++gAllocations;
+	void *p = malloc(size != 0 ? size : 1);
+	if (p == 0) throw std::bad_alloc();
+	return p;
+}
+void operator delete(void *p) THROWS_NOTHING {
+	free(p);
+}
+void operator delete[](void *p) THROWS_NOTHING {
+	free(p);
+}
+
+// peak resident set size, in kilobytes
+static unsigned long getPeakRSS() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+	return counters.PeakWorkingSetSize / 1024;
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+#endif
+}
+
+
+/**
+ * HARDWARE COUNTERS
+ */
+
+// counted events
+static const unsigned CounterCount = 5;
+static char const * const CounterNames[CounterCount] = { "cycles", "instructions", "L1d misses", "LLC misses", "branch misses" };
+
+// hardware performance counters of this thread, in user space
+class Counters {
+
+	public:
+
+		Counters() : fOpen(false) {
+			for (unsigned i = 0; i < CounterCount; ++i) fFiles[i] = -1;
+		};
+		~Counters() {
+			close();
+		}
+
+		// start counting - returns false if the counters aren't available
+		bool open() {
+#ifdef __linux__
+			static const unsigned types[CounterCount] = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE };
+			static const unsigned long long configs[CounterCount] = {
+				PERF_COUNT_HW_CPU_CYCLES,
+				PERF_COUNT_HW_INSTRUCTIONS,
+				PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+				PERF_COUNT_HW_CACHE_MISSES,
+				PERF_COUNT_HW_BRANCH_MISSES
+			};
+			for (unsigned i = 0; i < CounterCount; ++i) {
+				struct perf_event_attr attr;
+				memset(&attr, 0, sizeof(attr));
+				attr.size = sizeof(attr);
+				attr.type = types[i];
+				attr.config = configs[i];
+				attr.exclude_kernel = 1;
+				attr.exclude_hv = 1;
+				attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+				fFiles[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+				if (fFiles[i] < 0) {
+					close();
+					return false;
+				}
+			}
+			fOpen = true;
+#endif
+			return fOpen;
+		}
+
+		// stop counting
+		void close() {
+#ifdef __linux__
+			for (unsigned i = 0; i < CounterCount; ++i) {
+				if (fFiles[i] >= 0) ::close(fFiles[i]);
+				fFiles[i] = -1;
+			}
+#endif
+			fOpen = false;
+		}
+
+		// are we counting?
+		bool isOpen() {
+			return fOpen;
+		}
+
+		// read the counters, scaled up if the kernel multiplexed them
+		void read(double values[CounterCount]) {
+			for (unsigned i = 0; i < CounterCount; ++i) {
+				values[i] = 0;
+#ifdef __linux__
+				unsigned long long data[3];
+				if (!fOpen || ::read(fFiles[i], data, sizeof(data)) != sizeof(data) || data[2] == 0) continue;
+				values[i] = (double)data[0] * data[1] / data[2];
+#endif
+			}
+		}
+
+	private:
+
+		bool fOpen;
+		int fFiles[CounterCount];
+
+};
+
+// the counters, if requested
+static Counters gCounters;
+
+
+/**
+ * SCENARIO
+ */
+
+// settings
+static unsigned gCompanies = 10;
+static double gDensity = 0.01;
+
+// random numbers, the same in every run
+static unsigned gSeed = 12345;
+static unsigned nextRandom() {
+	gSeed = gSeed * 1103515245 + 12345;
+	return (gSeed >> 16) & 0x7fff;
+}
+
+
+// job, fired on demand
+class Job: public Component {
+
+	public:
+
+		Job(int salary) : Component("Job"), fSalary(salary) {
+			++gComponents;
+		};
+
+		void addedToObject() {
+			requestMessage("Fire", &Job::fire);
+		}
+
+		int getSalary() { return fSalary; }
+
+	private:
+
+		void fire(Message const & /*msg*/) {
+			++gMessages;
+			destroy();
+		}
+
+		int fSalary;
+};
+
+
+// person, ages every year
+class Person: public Component {
+
+	public:
+
+		Person(int age) : Component("Person"), fAge(age) {
+			++gComponents;
+		};
+
+		int getAge() { return fAge; }
+
+		void addedToObject() {
+			requestComponent("Job", &Person::processJob, true);
+			requestMessage("NextYear", &Person::nextYear);
+
+			// some persons follow the birthdays of everyone
+			if (nextRandom() < gDensity * 0x8000) requestMessage("Birthday", &Person::processBirthday);
+		}
+
+	private:
+
+		void processJob(Message const & /*msg*/) {
+			++gMessages;
+		}
+
+		void processBirthday(Message const & /*msg*/) {
+			++gMessages;
+		}
+
+		void nextYear(Message const & /*msg*/) {
+			++gMessages;
+			++fAge;
+
+			// leave, and make room for a young person
+			if (fAge >= 80) {
+				addComponent(createObject(), new Person(20));
+				destroyObject(getOwnerId());
+				return;
+			}
+			sendMessage("Birthday");
+		}
+
+		int fAge;
+
+};
+
+
+// company, hires the persons of its index
+class Company: public Component {
+
+	public:
+
+		Company(unsigned index) : Component("Company"), fIndex(index) {
+			++gComponents;
+		};
+
+		void addedToObject() {
+			requestComponent("Person", &Company::processPerson);
+			requestMessage("Birthday", &Company::processBirthday);
+		}
+
+	private:
+
+		// is the person one of ours?
+		bool isEmployee(Person *person) {
+			return person->getOwnerId() % gCompanies == fIndex;
+		}
+
+		void processPerson(Message const & msg) {
+			++gMessages;
+			Person *person = (Person*)msg.sender;
+			if (msg.type != CREATE || !isEmployee(person)) return;
+			addComponent(person->getOwnerId(), new Job(person->getAge() * 10000));
+			if (person->getAge() >= 50) addComponent(person->getOwnerId(), new Job(50000));
+		}
+
+		void processBirthday(Message const & msg) {
+			++gMessages;
+			Person *person = (Person*)msg.sender;
+			if (!isEmployee(person)) return;
+			if (person->getAge() == 65) sendMessageToObject(person->getOwnerId(), "Fire");
+			if (person->getAge() == 50) addComponent(person->getOwnerId(), new Job(50000));
+		}
+
+		unsigned fIndex;
+
+};
+
+
+// government, keeps the total earned income and the calendar
+class Government: public Component {
+
+	public:
+
+		Government() : Component("Government"), fTotalEarnedIncome(0) {
+			++gComponents;
+		};
+
+		void addedToObject() {
+			requestComponent("Job", &Government::processJob);
+		}
+
+		void advanceCalendar() {
+			sendMessage("NextYear");
+		}
+
+		long long getTotalEarnedIncome() { return fTotalEarnedIncome; }
+
+	private:
+
+		void processJob(Message const & msg) {
+			++gMessages;
+			Job *job = (Job*)msg.sender;
+			if (msg.type == CREATE) fTotalEarnedIncome += job->getSalary();
+			else fTotalEarnedIncome -= job->getSalary();
+		}
+
+		long long fTotalEarnedIncome;
+
+};
+
+
+/**
+ * MEASURING
+ */
+
+typedef boost::chrono::steady_clock Clock;
+
+// a measured phase
+struct Phase {
+	Clock::time_point start;
+	unsigned long long messages;
+	unsigned long long components;
+	unsigned long long allocations;
+	double counters[CounterCount];
+	Phase() : messages(gMessages), components(gComponents), allocations(gAllocations) {
+		gCounters.read(counters);
+		start = Clock::now();
+	};
+	double seconds() {
+		return boost::chrono::duration<double>(Clock::now() - start).count();
+	}
+};
+
+// report a phase
+static double report(string const & name, Phase& phase) {
+	double seconds = phase.seconds();
+	double counters[CounterCount];
+	gCounters.read(counters);
+	unsigned long long messages = gMessages - phase.messages;
+	unsigned long long components = gComponents - phase.components;
+	cout << setw(10) << name << setw(12) << fixed << setprecision(1) << seconds * 1000 << " ms"
+		<< setw(14) << messages << " messages"
+		<< setw(10) << components << " components"
+		<< setw(14) << gAllocations - phase.allocations << " allocations" << endl;
+
+	// counters, per message delivered and per component created
+	if (!gCounters.isOpen()) return seconds;
+	for (unsigned i = 0; i < CounterCount; ++i) {
+		double count = counters[i] - phase.counters[i];
+		cout << setw(24) << CounterNames[i] << setw(16) << setprecision(0) << count;
+		if (messages > 0) cout << setw(14) << setprecision(1) << count / messages << " /message";
+		if (components > 0) cout << setw(14) << setprecision(1) << count / components << " /component";
+		cout << endl;
+	}
+	return seconds;
+}
+
+
+/**
+ * Run the benchmark.
+ */
+int main(int argc, char **argv) {
+
+	// settings
+	unsigned persons = argc > 1 ? atoi(argv[1]) : 2000;
+	gCompanies = argc > 2 ? atoi(argv[2]) : 10;
+	gDensity = argc > 3 ? atof(argv[3]) : 0.01;
+	unsigned years = argc > 4 ? atoi(argv[4]) : 50;
+	bool counters = argc > 5 && atoi(argv[5]) != 0;
+	bool fast = argc > 6 && atoi(argv[6]) != 0;
+	if (gCompanies == 0) gCompanies = 1;
+	cout << persons << " persons, " << gCompanies << " companies, density " << gDensity << ", " << years << " years" << endl;
+
+	// hardware counters
+	if (counters && !gCounters.open()) cout << "hardware counters are not available" << endl;
+
+	// create the government, the companies and the persons
+	Phase populate;
+	ObjectManager *objectManager = new ObjectManager();
+	Government *government = new Government();
+	objectManager->addComponent(objectManager->createObject(), government);
+	for (unsigned i = 0; i < gCompanies; ++i) {
+		objectManager->addComponent(objectManager->createObject(), new Company(i));
+	}
+	for (unsigned i = 0; i < persons; ++i) {
+		objectManager->addComponent(objectManager->createObject(), new Person(20 + nextRandom() % 60));
+	}
+	report("populate", populate);
+
+	// simulate the years
+	Phase simulate;
+	for (unsigned i = 0; i < years; ++i) {
+		government->advanceCalendar();
+		objectManager->tick(1);
+	}
+	unsigned long long messages = gMessages - simulate.messages;
+	unsigned long long allocations = gAllocations - simulate.allocations;
+	double seconds = report("simulate", simulate);
+	long long income = government->getTotalEarnedIncome();
+	ObjectManagerStats stats = objectManager->getStats();
+
+	// destroy everything
+	Phase teardown;
+	objectManager->shutdown(fast ? TEARDOWN_FAST : TEARDOWN_GRACEFUL);
+	delete objectManager;
+	report("teardown", teardown);
+
+	// throughput
+	cout << "total earned income " << income << endl;
+	cout << "years/sec " << setprecision(2) << years / seconds << endl;
+	cout << "messages/sec " << setprecision(0) << messages / seconds << endl;
+	cout << "allocations/year " << (years > 0 ? allocations / years : 0) << endl;
+	cout << "peak RSS " << getPeakRSS() << " KB" << endl;
+
+	// memory at the end of the simulation
+	stats.write(cout);
+
+	return 0;
+}
@@ -1,9 +1,20 @@
-
-#ifndef INC_CISTRON
-#define INC_CISTRON
-
-#include "Component.h"
-#include "Object.h"
-#include "ObjectManager.h"
-
-#endif
+
+#ifndef INC_CISTRON
+#define INC_CISTRON
+
+#include "Atom.h"
+#include "Component.h"
+#include "Object.h"
+#include "TimerWheel.h"
+#include "Behavior.h"
+#include "Inbox.h"
+#include "Profiler.h"
+#include "Recorder.h"
+#include "Mirror.h"
+#include "Replication.h"
+#include "System.h"
+#include "Stats.h"
+#include "ObjectManager.h"
+#include "Archetype.h"
+
+#endif
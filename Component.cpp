@@ -1,293 +1,388 @@
-
-#include "Component.h"
-#include "ObjectManager.h"
-
-
-using namespace Cistron;
-
-
-#include <sstream>
-#include <iostream>
-
-using std::stringstream;
-using namespace std;
-
-
-// constructor/destructor
-Component::Component(string name) : fOwnerId(-1), fName(name), fDestroyed(false), fTrack(false), fObjectManager(0) {
-	static ComponentId IdCounter = 0;
-	fId = ++IdCounter;
-}
-Component::~Component() {
-}
-
-
-// track activity in the log
-/*void Component::trackMe(track) {
-	fTrack = track;
-}*/
-
-
-// check for validity of the object
-bool Component::isValid() {
-	return fOwnerId >= 0 && fName.size() > 0 && !fDestroyed;
-}
-
-
-
-// get owner
-ObjectId Component::getOwnerId() {
-	return fOwnerId;
-}
-void Component::setOwner(ObjectId id) {
-
-	// set the owner
-	fOwnerId = id;
-
-	// respond to ping requests
-	requestMessage("ping", &Component::processPing);
-}
-void Component::setDestroyed() {
-	fDestroyed = true;
-}
-bool Component::isDestroyed() {
-	return fDestroyed;
-}
-
-
-// get id
-ComponentId Component::getId() {
-	return fId;
-}
-string Component::getName() {
-	return fName;
-}
-
-
-/**
- * OBJECT/COMPONENT MODIFICATION FUNCTIONS
- */
-
-
-// add another component to this object
-void Component::addLocalComponent(Component *c) {
-	fObjectManager->addComponent(getOwnerId(), c);
-}
-
-
-// add another component to another object
-void Component::addComponent(ObjectId objId, Component *c) {
-	fObjectManager->addComponent(objId, c);
-}
-
-
-// create an object
-ObjectId Component::createObject() {
-	return fObjectManager->createObject();
-}
-
-// finalize an object
-void Component::finalizeObject(ObjectId objId) {
-	fObjectManager->finalizeObject(objId);
-}
-
-// destroy object
-void Component::destroyObject(ObjectId objId) {
-	fObjectManager->destroyObject(objId);
-}
-
-
-
-/**
- * REQUEST FUNCTIONS
- */
-
-// message request function
-void Component::requestMessage(string message, MessageFunction f) {
-
-	// construct registered component
-	RegisteredComponent reg;
-	reg.callback = f;
-	reg.required = false;
-	reg.component = this;
-	reg.trackMe = false;
-
-	// construct component request
-	ComponentRequest req;
-	req.type = REQ_MESSAGE;
-	req.name = message;
-
-	// forward to object manager
-	fObjectManager->registerGlobalRequest(req, reg);
-}
-
-// require a component in this object
-void Component::requireComponent(string name, MessageFunction f) {
-
-	// construct registered component
-	RegisteredComponent reg;
-	reg.callback = f;
-	reg.required = true;
-	reg.component = this;
-	reg.trackMe = false;
-
-	// construct component request
-	ComponentRequest req;
-	req.type = REQ_COMPONENT;
-	req.name = name;
-
-	// forward to object manager
-	fObjectManager->registerLocalRequest(req, reg);
-}
-
-// register a component request
-void Component::requestComponent(string name, MessageFunction f, bool local) {
-
-	// construct registered component
-	RegisteredComponent reg;
-	reg.callback = f;
-	reg.required = false;
-	reg.component = this;
-	reg.trackMe = false;
-
-	// construct component request
-	ComponentRequest req;
-	req.type = REQ_COMPONENT;
-	req.name = name;
-
-	// forward to object manager
-	if (local) fObjectManager->registerLocalRequest(req, reg);
-	else fObjectManager->registerGlobalRequest(req, reg);
-}
-
-// request all components of one type
-void Component::requestAllExistingComponents(string name, MessageFunction f) {
-
-	// construct registered component
-	RegisteredComponent reg;
-	reg.callback = f;
-	reg.required = false;
-	reg.component = this;
-	reg.trackMe = false;
-
-	// construct component request
-	ComponentRequest req;
-	req.type = REQ_ALLCOMPONENTS;
-	req.name = name;
-
-	// forward to object manager
-	fObjectManager->registerGlobalRequest(req, reg);
-}
-
-
-
-// get a request id
-RequestId Component::getMessageRequestId(string name) {
-	return fObjectManager->getMessageRequestId(REQ_MESSAGE, name);
-}
-
-
-// request all components of a given type in a given object
-list<Component*> Component::getComponents(ObjectId id, string name) {
-	return fObjectManager->getComponents(id, name);
-}
-
-
-/**
- * MESSAGING FUNCTIONS
- */
-
-// send a message
-void Component::sendMessage(string msg, boost::any payload) {
-	fObjectManager->sendGlobalMessage(msg, this, payload);
-}
-void Component::sendMessage(RequestId reqId, boost::any payload) {
-	fObjectManager->sendGlobalMessage(reqId, this, payload);
-}
-void Component::sendLocalMessage(string msg, boost::any payload) {
-	fObjectManager->sendMessageToObject(msg, this, fOwnerId, payload);
-}
-void Component::sendLocalMessage(RequestId reqId, boost::any payload) {
-	fObjectManager->sendMessageToObject(reqId, this, fOwnerId, payload);
-}
-void Component::sendLocalMessage(RequestId reqId, Message const & msg) {
-	fObjectManager->sendMessageToObject(reqId, msg, fOwnerId);
-}
-void Component::sendMessageToObject(ObjectId id, string msg, boost::any payload) {
-	fObjectManager->sendMessageToObject(msg, this, id, payload);
-}
-void Component::sendMessageToObject(ObjectId id, RequestId reqId, boost::any payload) {
-	fObjectManager->sendMessageToObject(reqId, this, id, payload);
-}
-void Component::sendMessageToObject(ObjectId id, RequestId reqId, Message const & msg) {
-	fObjectManager->sendMessageToObject(reqId, msg, id);
-}
-
-
-
-// called when added to an object
-void Component::addedToObject() {
-	// does nothing by default
-}
-
-
-// register a unique name
-bool Component::registerName(string s) {
-	return fObjectManager->registerName(fOwnerId, s);
-}
-ObjectId Component::getObjectId(string name) {
-	return fObjectManager->getObjectId(name);
-}
-
-
-// destroy this component
-void Component::destroy() {
-	fObjectManager->destroyComponent(this);
-}
-
-
-// output
-ostream& operator<<(ostream& s, Component &v) {
-	return s << "Component[" << v.getId() << "][" << v.getName() << "] owned by [" << v.getOwnerId() << "]";
-};
-
-
-// to string
-string Component::toString() {
-	stringstream ss;
-	ss << (*this);
-	return ss.str();
-}
-
-
-/**
- * PING & LOGGING
- */
-
-
-// process ping
-void Component::processPing(Message const & msg) {
-	cout << *this << " PING" << endl;
-}
-
-
-// track a component request
-void Component::trackComponentRequest(string name, bool local) {
-
-	// get request id
-	RequestId reqId = fObjectManager->getMessageRequestId(REQ_COMPONENT, name);
-
-	// start tracking
-	fObjectManager->trackRequest(reqId, local, this);
-}
-
-
-// track a message request
-void Component::trackMessageRequest(string message) {
-
-	// get request id
-	RequestId reqId = fObjectManager->getMessageRequestId(REQ_MESSAGE, message);
-
-	// start tracking
-	fObjectManager->trackRequest(reqId, false, this);
+
+#include "Component.h"
+#include "ObjectManager.h"
+
+
+using namespace Cistron;
+
+
+#include <sstream>
+#include <iostream>
+#include <boost/atomic.hpp>
+
+using std::stringstream;
+using namespace std;
+
+
+// component id counter - components can be constructed on any thread
+static boost::atomic<ComponentId> IdCounter(0);
+
+
+// constructor/destructor
+Component::Component(Atom name) : fOwnerId(-1), fName(name), fDestroyed(false), fDying(false), fChangeSerial(0), fTypeIndex(0), fTrack(false), fObjectManager(0) {
+	fId = ++IdCounter;
+}
+Component::~Component() {
+}
+
+
+// track activity in the log
+/*void Component::trackMe(track) {
+	fTrack = track;
+}*/
+
+
+// check for validity of the object
+bool Component::isValid() {
+	return fOwnerId >= 0 && fName.isValid() && !fDestroyed;
+}
+
+
+
+// get owner
+ObjectId Component::getOwnerId() {
+	return fOwnerId;
+}
+void Component::setOwner(ObjectId id) {
+
+	// set the owner
+	fOwnerId = id;
+
+	// respond to ping requests
+	requestMessage("ping", &Component::processPing);
+}
+void Component::setDestroyed() {
+	fDestroyed = true;
+}
+bool Component::isDestroyed() {
+	return fDestroyed;
+}
+
+
+// get id
+ComponentId Component::getId() {
+	return fId;
+}
+string const & Component::getName() {
+	return fName.str();
+}
+
+
+/**
+ * OBJECT/COMPONENT MODIFICATION FUNCTIONS
+ */
+
+
+// add another component to this object
+void Component::addLocalComponent(Component *c) {
+	fObjectManager->addComponent(getOwnerId(), c);
+}
+
+
+// add another component to another object
+void Component::addComponent(ObjectId objId, Component *c) {
+	fObjectManager->addComponent(objId, c);
+}
+
+
+// create an object
+ObjectId Component::createObject() {
+	return fObjectManager->createObject();
+}
+
+// finalize an object
+void Component::finalizeObject(ObjectId objId) {
+	fObjectManager->finalizeObject(objId);
+}
+
+// destroy object
+void Component::destroyObject(ObjectId objId) {
+	fObjectManager->destroyObject(objId);
+}
+
+// move a component to another object
+void Component::moveComponent(Component *c, ObjectId objId) {
+	fObjectManager->moveComponent(c, objId);
+}
+
+
+
+/**
+ * REQUEST FUNCTIONS
+ */
+
+// message request function
+void Component::requestMessage(Atom message, MessageFunction f) {
+
+	// construct registered component
+	RegisteredComponent reg;
+	reg.callback = f;
+	reg.required = false;
+	reg.component = this;
+	reg.trackMe = false;
+
+	// construct component request
+	ComponentRequest req;
+	req.type = REQ_MESSAGE;
+	req.name = message;
+
+	// forward to object manager
+	fObjectManager->registerGlobalRequest(req, reg);
+}
+
+// require a component in this object
+void Component::requireComponent(Atom name, MessageFunction f) {
+
+	// construct registered component
+	RegisteredComponent reg;
+	reg.callback = f;
+	reg.required = true;
+	reg.component = this;
+	reg.trackMe = false;
+
+	// construct component request
+	ComponentRequest req;
+	req.type = REQ_COMPONENT;
+	req.name = name;
+
+	// forward to object manager
+	fObjectManager->registerLocalRequest(req, reg);
+}
+
+// register a component request
+void Component::requestComponent(Atom name, MessageFunction f, bool local) {
+
+	// construct registered component
+	RegisteredComponent reg;
+	reg.callback = f;
+	reg.required = false;
+	reg.component = this;
+	reg.trackMe = false;
+
+	// construct component request
+	ComponentRequest req;
+	req.type = REQ_COMPONENT;
+	req.name = name;
+
+	// forward to object manager
+	if (local) fObjectManager->registerLocalRequest(req, reg);
+	else fObjectManager->registerGlobalRequest(req, reg);
+}
+
+// request all components of one type
+void Component::requestAllExistingComponents(Atom name, MessageFunction f) {
+
+	// construct registered component
+	RegisteredComponent reg;
+	reg.callback = f;
+	reg.required = false;
+	reg.component = this;
+	reg.trackMe = false;
+
+	// construct component request
+	ComponentRequest req;
+	req.type = REQ_ALLCOMPONENTS;
+	req.name = name;
+
+	// forward to object manager
+	fObjectManager->registerGlobalRequest(req, reg);
+}
+
+// request the moves of components of one type
+void Component::requestComponentMoves(Atom name, MessageFunction f) {
+
+	// construct registered component
+	RegisteredComponent reg;
+	reg.callback = f;
+	reg.required = false;
+	reg.component = this;
+	reg.trackMe = false;
+
+	// forward to object manager
+	fObjectManager->registerMoveRequest(name, reg);
+}
+
+// receive the global messages of a request in one call per flush
+void Component::requestMessageBatch(Atom message, MessageBatchFunction f) {
+	fObjectManager->registerMessageBatch(message, this, f);
+}
+
+
+
+// get a request id
+RequestId Component::getMessageRequestId(Atom name) {
+	return fObjectManager->getMessageRequestId(REQ_MESSAGE, name);
+}
+
+
+// request all components of a given type in a given object
+list<Component*> Component::getComponents(ObjectId id, Atom name) {
+	return fObjectManager->getComponents(id, name);
+}
+
+
+// register the answer to a query
+void Component::registerAnswer(Atom query, QueryAnswer *answer, std::type_info const & type) {
+	fObjectManager->registerQuery(query, answer, type);
+}
+
+
+/**
+ * MESSAGING FUNCTIONS
+ */
+
+// send a message
+void Component::sendMessage(Atom msg, boost::any payload) {
+	fObjectManager->sendGlobalMessage(msg, this, payload);
+}
+void Component::sendMessage(RequestId reqId, boost::any payload) {
+	fObjectManager->sendGlobalMessage(reqId, this, payload);
+}
+void Component::sendLocalMessage(Atom msg, boost::any payload) {
+	fObjectManager->sendMessageToObject(msg, this, fOwnerId, payload);
+}
+void Component::sendLocalMessage(RequestId reqId, boost::any payload) {
+	fObjectManager->sendMessageToObject(reqId, this, fOwnerId, payload);
+}
+void Component::sendLocalMessage(RequestId reqId, Message const & msg) {
+	fObjectManager->sendMessageToObject(reqId, msg, fOwnerId);
+}
+void Component::sendMessageToObject(ObjectId id, Atom msg, boost::any payload) {
+	fObjectManager->sendMessageToObject(msg, this, id, payload);
+}
+void Component::sendMessageToObject(ObjectId id, RequestId reqId, boost::any payload) {
+	fObjectManager->sendMessageToObject(reqId, this, id, payload);
+}
+void Component::sendMessageToObject(ObjectId id, RequestId reqId, Message const & msg) {
+	fObjectManager->sendMessageToObject(reqId, msg, id);
+}
+void Component::sendMessageToGroup(Atom group, Atom msg, boost::any payload) {
+	fObjectManager->sendMessageToGroup(group, msg, this, payload);
+}
+void Component::sendMessageToGroup(Atom group, RequestId reqId, boost::any payload) {
+	fObjectManager->sendMessageToGroup(group, reqId, this, payload);
+}
+
+// group membership
+bool Component::joinGroup(Atom group) {
+	return fObjectManager->joinGroup(fOwnerId, group);
+}
+bool Component::leaveGroup(Atom group) {
+	return fObjectManager->leaveGroup(fOwnerId, group);
+}
+
+// send a message later
+TimerId Component::sendMessageDelayed(Atom msg, Time delay, boost::any payload) {
+	return fObjectManager->scheduleMessage(fObjectManager->getMessageRequestId(REQ_MESSAGE, msg), this, -1, payload, delay);
+}
+TimerId Component::sendMessageDelayed(RequestId reqId, Time delay, boost::any payload) {
+	return fObjectManager->scheduleMessage(reqId, this, -1, payload, delay);
+}
+TimerId Component::sendMessagePeriodic(Atom msg, Time period, boost::any payload) {
+	return fObjectManager->scheduleMessage(fObjectManager->getMessageRequestId(REQ_MESSAGE, msg), this, -1, payload, period, period);
+}
+TimerId Component::sendMessagePeriodic(RequestId reqId, Time period, boost::any payload) {
+	return fObjectManager->scheduleMessage(reqId, this, -1, payload, period, period);
+}
+TimerId Component::sendMessageToObjectDelayed(ObjectId id, Atom msg, Time delay, boost::any payload) {
+	return fObjectManager->scheduleMessage(fObjectManager->getMessageRequestId(REQ_MESSAGE, msg), this, id, payload, delay);
+}
+TimerId Component::sendMessageToObjectDelayed(ObjectId id, RequestId reqId, Time delay, boost::any payload) {
+	return fObjectManager->scheduleMessage(reqId, this, id, payload, delay);
+}
+TimerId Component::sendMessageToObjectPeriodic(ObjectId id, Atom msg, Time period, boost::any payload) {
+	return fObjectManager->scheduleMessage(fObjectManager->getMessageRequestId(REQ_MESSAGE, msg), this, id, payload, period, period);
+}
+TimerId Component::sendMessageToObjectPeriodic(ObjectId id, RequestId reqId, Time period, boost::any payload) {
+	return fObjectManager->scheduleMessage(reqId, this, id, payload, period, period);
+}
+bool Component::cancelMessage(TimerId id) {
+	return fObjectManager->cancelMessage(id);
+}
+
+
+// start a behavior
+void Component::startBehavior(Behavior *b) {
+	fObjectManager->startBehavior(this, b);
+}
+
+
+
+// called when added to an object
+void Component::addedToObject() {
+	// does nothing by default
+}
+
+
+// register a unique name
+bool Component::registerName(string const & s) {
+	return fObjectManager->registerName(fOwnerId, s);
+}
+ObjectId Component::getObjectId(string const & name) {
+	return fObjectManager->getObjectId(name);
+}
+
+
+// destroy this component
+void Component::destroy() {
+	fObjectManager->destroyComponent(this);
+}
+
+
+// memory used by the component
+size_t Component::getMemorySize() {
+	return sizeof(Component);
+}
+
+
+// mark as changed - changes before the component is added are part of its creation
+void Component::markChanged() {
+	if (fObjectManager != 0) fObjectManager->markChanged(this);
+}
+
+
+// output
+ostream& operator<<(ostream& s, Component &v) {
+	return s << "Component[" << v.getId() << "][" << v.getName() << "] owned by [" << v.getOwnerId() << "]";
+};
+
+
+// to string
+string Component::toString() {
+	stringstream ss;
+	ss << (*this);
+	return ss.str();
+}
+
+
+/**
+ * PING & LOGGING
+ */
+
+
+// process ping
+void Component::processPing(Message const & msg) {
+	cout << *this << " PING" << endl;
+}
+
+
+// track a component request
+void Component::trackComponentRequest(Atom name, bool local) {
+
+	// get request id
+	RequestId reqId = fObjectManager->getMessageRequestId(REQ_COMPONENT, name);
+
+	// start tracking
+	fObjectManager->trackRequest(reqId, local, this);
+}
+
+
+// track a message request
+void Component::trackMessageRequest(Atom message) {
+
+	// get request id
+	RequestId reqId = fObjectManager->getMessageRequestId(REQ_MESSAGE, message);
+
+	// start tracking
+	fObjectManager->trackRequest(reqId, false, this);
 }
\ No newline at end of file
@@ -1,288 +1,481 @@
-
-#ifndef INC_COMPONENT
-#define INC_COMPONENT
-
-
-#include <string>
-#include <map>
-#include <list>
-#include <boost/function.hpp>
-#include <boost/bind.hpp>
-#include <boost/any.hpp>
-#include <ostream>
-
-
-namespace Cistron {
-
-using std::list;
-using std::map;
-using std::string;
-using std::ostream;
-
-
-// object & component id
-typedef int ObjectId;
-typedef int ComponentId;
-
-
-// a request ID
-typedef int RequestId;
-
-// type of component requests
-enum ComponentRequestType {
-	REQ_COMPONENT = 0,
-	REQ_MESSAGE = 1,
-	REQ_ALLCOMPONENTS = 2
-};
-
-// a request
-struct ComponentRequest {
-	ComponentRequestType type;
-	string name;
-	ComponentRequest(ComponentRequestType t, string n) : type(t), name(n) {};
-	ComponentRequest() {};
-};
-
-
-
-
-// event type
-enum MessageType {
-	CREATE,
-	DESTROY,
-	MESSAGE
-};
-
-
-// an event
-class Component;
-struct Message {
-	MessageType type;
-	Component *sender;
-	boost::any p;
-	Message(MessageType t) : type(t) {};
-	Message(MessageType t, Component *c) : type(t), sender(c) {};
-	Message(MessageType t, Component *c, boost::any payload) : type(t), sender(c), p(payload) {};
-};
-
-
-
-
-// component function
-typedef boost::function<void(Message const &)> MessageFunction;
-
-
-// a component registered for an event (message or component creation/destruction)
-struct RegisteredComponent {
-	Component *component;
-	MessageFunction callback;
-	bool required;
-	bool trackMe;
-};
-
-// object manager
-class ObjectManager;
-
-
-// a generic component
-class Component {
-
-	public:
-
-		// constructor/destructor
-		Component(string name);
-		virtual ~Component();
-
-
-
-		// function called when the component is added to an object
-		virtual void addedToObject();
-
-		// register a unique name for the object
-		bool registerName(string s);
-
-		// get object id
-		ObjectId getObjectId(string name);
-
-
-		/**
-		 * OBJECT/COMPONENT MODIFICATION FUNCTIONS
-		 */
-
-		// add another component to this object
-		void addLocalComponent(Component*);
-
-		// add a component to another object
-		void addComponent(ObjectId, Component*);
-
-		// create an object
-		ObjectId createObject();
-
-		// finalize an object
-		void finalizeObject(ObjectId);
-
-		// destroy object
-		void destroyObject(ObjectId);
-
-
-		/**
-		 * REQUEST FUNCTIONS
-		 */
-
-		// message request function
-		void requestMessage(string message, MessageFunction);
-
-		// require a component in this object
-		void requireComponent(string name, MessageFunction);
-
-		// register a component request
-		void requestComponent(string name, MessageFunction, bool local = false);
-
-		// request all components of one type
-		void requestAllExistingComponents(string name, MessageFunction);
-
-		// request a request id of a message
-		RequestId getMessageRequestId(string name);
-
-		// request all components of a given type in a given object
-		list<Component*> getComponents(ObjectId id, string name);
-
-		/**
-		 * FANCY TEMPLATED REQUEST FUNCTIONS
-		 */
-
-		// message request function
-		template<class T>
-		void requestMessage(string message, void (T::*f)(Message const &));
-
-		// require a component in this object
-		template<class T>
-		void requireComponent(string name, void (T::*f)(Message const &));
-
-		// register a component request
-		template<class T>
-		void requestComponent(string name, void (T::*f)(Message const &), bool local = false);
-
-		// request all components of one type
-		template<class T>
-		void requestAllExistingComponents(string name, void (T::*f)(Message const &));
-
-
-		/**
-		 * MESSAGING FUNCTIONS
-		 */
-
-		// send a message
-		void sendMessage(string msg, boost::any  payload = 0);
-		void sendMessage(RequestId id, boost::any  payload = 0);
-		void sendMessageToObject(ObjectId id, string msg, boost::any payload = 0);
-		void sendMessageToObject(ObjectId id, RequestId reqId, boost::any payload = 0);
-		void sendMessageToObject(ObjectId id, RequestId reqId, Message const & msg);
-		void sendLocalMessage(string msg, boost::any payload = 0);
-		void sendLocalMessage(RequestId reqId, boost::any payload = 0);
-		void sendLocalMessage(RequestId reqId, Message const & msg);
-
-		/**
-		 * IMPLEMENTED REQUESTS & LOGGING
-		 */
-		void processPing(Message const &);
-
-		void trackComponentRequest(string name, bool local = false);
-		void trackMessageRequest(string message);
-		
-
-
-
-		// get object manager this component belongs to
-		inline ObjectManager* getObjectManager() {
-			return fObjectManager;
-		}
-
-		// get owner
-		ObjectId getOwnerId();
-
-		// get id
-		ComponentId getId();
-
-		// destroy this component
-		void destroy();
-		bool isDestroyed();
-
-		// valid component?
-		bool isValid();
-
-		// get the name of the component
-		string getName();
-
-		// to string
-		string toString();
-
-	private:
-
-		// set owner
-		void setOwner(ObjectId id);
-
-		// set destroyed
-		void setDestroyed();
-
-		// object id
-		ObjectId fOwnerId;
-
-		// object manager
-		ObjectManager *fObjectManager;
-
-		// component it
-		ComponentId fId;
-
-		// name of the component
-		string fName;
-
-		// destroyed
-		bool fDestroyed;
-
-		// track this component in the log
-		bool fTrack;
-
-		// object manager is our friend
-		friend class ObjectManager;
-
-};
-
-
-/**
- * TEMPLATED REQUEST FUNCTIONS
- */
-
-// message request function
-template<class T>
-void Component::requestMessage(string message, void (T::*f)(Message const &)) {
-	requestMessage(message, boost::bind(f, (T*)(this), _1));
-}
-
-// require a component in this object
-template<class T>
-void Component::requireComponent(string name, void (T::*f)(Message const &)) {
-	requireComponent(name, boost::bind(f, (T*)(this), _1));
-}
-
-// register a component request
-template<class T>
-void Component::requestComponent(string name, void (T::*f)(Message const &), bool local) {
-	requestComponent(name, boost::bind(f, (T*)(this), _1), local);
-}
-
-// request all components of one type
-template<class T>
-void Component::requestAllExistingComponents(string name, void (T::*f)(Message const &)) {
-	requestAllExistingComponents(name, boost::bind(f, (T*)(this), _1));
-}
-
-
-};
-
-
-// output
-std::ostream& operator<<(std::ostream& s, Cistron::Component &v);
-
-
-#endif
+
+#ifndef INC_COMPONENT
+#define INC_COMPONENT
+
+
+#include "Atom.h"
+
+
+#include <string>
+#include <map>
+#include <list>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/bind.hpp>
+#include <boost/any.hpp>
+#include <ostream>
+#include <typeinfo>
+
+
+namespace Cistron {
+
+using std::list;
+using std::vector;
+using std::map;
+using std::string;
+using std::ostream;
+
+
+// object & component id
+typedef int ObjectId;
+typedef int ComponentId;
+
+
+// a request ID
+typedef int RequestId;
+
+// time is measured in discrete units - what a unit means (a frame, a millisecond, a year) is up to the application
+typedef unsigned int Time;
+
+// handle to a scheduled message
+struct TimerId {
+	unsigned index;
+	unsigned generation;
+	TimerId() : index(0), generation(0) {};
+	TimerId(unsigned i, unsigned g) : index(i), generation(g) {};
+	inline bool isValid() const { return generation != 0; }
+};
+
+// type of component requests
+enum ComponentRequestType {
+	REQ_COMPONENT = 0,
+	REQ_MESSAGE = 1,
+	REQ_ALLCOMPONENTS = 2
+};
+
+// a request
+struct ComponentRequest {
+	ComponentRequestType type;
+	Atom name;
+	ComponentRequest(ComponentRequestType t, Atom n) : type(t), name(n) {};
+	ComponentRequest() {};
+};
+
+
+
+
+// event type
+enum MessageType {
+	CREATE,
+	DESTROY,
+	MESSAGE,
+	MOVED
+};
+
+
+// an event
+class Component;
+struct Message {
+	MessageType type;
+	Component *sender;
+	boost::any p;
+	Message(MessageType t) : type(t) {};
+	Message(MessageType t, Component *c) : type(t), sender(c) {};
+	Message(MessageType t, Component *c, boost::any payload) : type(t), sender(c), p(payload) {};
+};
+
+
+
+
+// component function
+typedef boost::function<void(Message const &)> MessageFunction;
+
+// batch functions - the messages sent since the last flush, or the receivers of a type with one message
+typedef boost::function<void(vector<Message> const &)> MessageBatchFunction;
+typedef boost::function<void(vector<Component*> const &, Message const &)> ReceiverBatchFunction;
+
+
+// a component registered for an event (message or component creation/destruction)
+struct RegisteredComponent {
+	Component *component;
+	MessageFunction callback;
+	bool required;
+	bool trackMe;
+};
+
+// a component answering a query, with its index in the answers of the query
+struct QueryAnswer {
+	Component *component;
+	unsigned index;
+	virtual ~QueryAnswer() {};
+};
+
+// the function answering a query, returning the type every answer of the query has
+template<class R>
+struct TypedQueryAnswer : public QueryAnswer {
+	boost::function<R(Message const &)> f;
+};
+
+// object manager
+class ObjectManager;
+
+// coroutine behavior
+class Behavior;
+
+
+// a generic component
+class Component {
+
+	public:
+
+		// constructor/destructor
+		Component(Atom name);
+		virtual ~Component();
+
+
+
+		// function called when the component is added to an object
+		virtual void addedToObject();
+
+		// register a unique name for the object
+		bool registerName(string const & s);
+
+		// get object id
+		ObjectId getObjectId(string const & name);
+
+
+		/**
+		 * OBJECT/COMPONENT MODIFICATION FUNCTIONS
+		 */
+
+		// add another component to this object
+		void addLocalComponent(Component*);
+
+		// add a component to another object
+		void addComponent(ObjectId, Component*);
+
+		// create an object
+		ObjectId createObject();
+
+		// finalize an object
+		void finalizeObject(ObjectId);
+
+		// destroy object
+		void destroyObject(ObjectId);
+
+		// move a component to another object
+		void moveComponent(Component*, ObjectId);
+
+
+		/**
+		 * REQUEST FUNCTIONS
+		 */
+
+		// message request function
+		void requestMessage(Atom message, MessageFunction);
+
+		// require a component in this object
+		void requireComponent(Atom name, MessageFunction);
+
+		// register a component request
+		void requestComponent(Atom name, MessageFunction, bool local = false);
+
+		// request all components of one type
+		void requestAllExistingComponents(Atom name, MessageFunction);
+
+		// request the moves of components of one type to another object - the payload is the previous owner
+		void requestComponentMoves(Atom name, MessageFunction);
+
+		// receive the global messages of a request in one call per flush, instead of one call per message
+		void requestMessageBatch(Atom message, MessageBatchFunction);
+
+		// request a request id of a message
+		RequestId getMessageRequestId(Atom name);
+
+		// request all components of a given type in a given object
+		list<Component*> getComponents(ObjectId id, Atom name);
+
+		// answer a query - every component answering the same query must return the same type
+		template<class R>
+		void answerQuery(Atom query, boost::function<R(Message const &)>);
+
+		/**
+		 * FANCY TEMPLATED REQUEST FUNCTIONS
+		 */
+
+		// message request function
+		template<class T>
+		void requestMessage(Atom message, void (T::*f)(Message const &));
+
+		// require a component in this object
+		template<class T>
+		void requireComponent(Atom name, void (T::*f)(Message const &));
+
+		// register a component request
+		template<class T>
+		void requestComponent(Atom name, void (T::*f)(Message const &), bool local = false);
+
+		// request all components of one type
+		template<class T>
+		void requestAllExistingComponents(Atom name, void (T::*f)(Message const &));
+
+		// request the moves of components of one type
+		template<class T>
+		void requestComponentMoves(Atom name, void (T::*f)(Message const &));
+
+		// receive the global messages of a request in one call per flush
+		template<class T>
+		void requestMessageBatch(Atom message, void (T::*f)(vector<Message> const &));
+
+		// answer a query
+		template<class T, class R>
+		void answerQuery(Atom query, R (T::*f)(Message const &));
+
+
+		/**
+		 * MESSAGING FUNCTIONS
+		 */
+
+		// send a message
+		void sendMessage(Atom msg, boost::any  payload = 0);
+		void sendMessage(RequestId id, boost::any  payload = 0);
+		void sendMessageToObject(ObjectId id, Atom msg, boost::any payload = 0);
+		void sendMessageToObject(ObjectId id, RequestId reqId, boost::any payload = 0);
+		void sendMessageToObject(ObjectId id, RequestId reqId, Message const & msg);
+		void sendLocalMessage(Atom msg, boost::any payload = 0);
+		void sendLocalMessage(RequestId reqId, boost::any payload = 0);
+		void sendLocalMessage(RequestId reqId, Message const & msg);
+		void sendMessageToGroup(Atom group, Atom msg, boost::any payload = 0);
+		void sendMessageToGroup(Atom group, RequestId reqId, boost::any payload = 0);
+
+		// add/remove the object of this component to/from a group
+		bool joinGroup(Atom group);
+		bool leaveGroup(Atom group);
+
+		// send a message after a delay, or every period time units
+		TimerId sendMessageDelayed(Atom msg, Time delay, boost::any payload = 0);
+		TimerId sendMessageDelayed(RequestId reqId, Time delay, boost::any payload = 0);
+		TimerId sendMessagePeriodic(Atom msg, Time period, boost::any payload = 0);
+		TimerId sendMessagePeriodic(RequestId reqId, Time period, boost::any payload = 0);
+		TimerId sendMessageToObjectDelayed(ObjectId id, Atom msg, Time delay, boost::any payload = 0);
+		TimerId sendMessageToObjectDelayed(ObjectId id, RequestId reqId, Time delay, boost::any payload = 0);
+		TimerId sendMessageToObjectPeriodic(ObjectId id, Atom msg, Time period, boost::any payload = 0);
+		TimerId sendMessageToObjectPeriodic(ObjectId id, RequestId reqId, Time period, boost::any payload = 0);
+
+		// cancel a delayed or periodic message
+		bool cancelMessage(TimerId);
+
+		// ask a query to every component answering it, to those in an object, or to those in the members of a group
+		// the answers are folded into the initial value with a binary operation
+		template<class R, class Op>
+		R ask(Atom query, Op op, R init = R(), boost::any payload = 0);
+		template<class R, class Op>
+		R askObject(ObjectId id, Atom query, Op op, R init = R(), boost::any payload = 0);
+		template<class R, class Op>
+		R askGroup(Atom group, Atom query, Op op, R init = R(), boost::any payload = 0);
+
+		/**
+		 * BEHAVIORS
+		 */
+
+		// start a coroutine behavior, owned by this component
+		void startBehavior(Behavior*);
+
+		/**
+		 * IMPLEMENTED REQUESTS & LOGGING
+		 */
+		void processPing(Message const &);
+
+		void trackComponentRequest(Atom name, bool local = false);
+		void trackMessageRequest(Atom message);
+		
+
+
+
+		// get object manager this component belongs to
+		inline ObjectManager* getObjectManager() {
+			return fObjectManager;
+		}
+
+		// get owner
+		ObjectId getOwnerId();
+
+		// get id
+		ComponentId getId();
+
+		// destroy this component
+		void destroy();
+		bool isDestroyed();
+
+		// the component will be destroyed incrementally, and no longer receives messages
+		inline bool isDying() {
+			return fDying;
+		}
+
+		// valid component?
+		bool isValid();
+
+		// mark the state of this component as changed in this tick
+		void markChanged();
+
+		// memory used by the component, for the statistics of the object manager
+		// override it to include the size of the derived class and the memory it owns
+		virtual size_t getMemorySize();
+
+		// get the name of the component
+		string const & getName();
+		inline Atom getNameAtom() {
+			return fName;
+		}
+
+		// to string
+		string toString();
+
+	private:
+
+		// set owner
+		void setOwner(ObjectId id);
+
+		// set destroyed
+		void setDestroyed();
+
+		// register the answer to a query, of the given type
+		void registerAnswer(Atom query, QueryAnswer*, std::type_info const & type);
+
+		// object id
+		ObjectId fOwnerId;
+
+		// object manager
+		ObjectManager *fObjectManager;
+
+		// component it
+		ComponentId fId;
+
+		// name of the component
+		Atom fName;
+
+		// destroyed
+		bool fDestroyed;
+
+		// waiting for incremental destruction
+		bool fDying;
+
+		// serial of the changed sets the component was last added to
+		unsigned fChangeSerial;
+
+		// index in the components of its type
+		unsigned fTypeIndex;
+
+		// track this component in the log
+		bool fTrack;
+
+		// object manager is our friend
+		friend class ObjectManager;
+
+};
+
+
+/**
+ * TRACKED FIELDS
+ */
+
+// a field that marks its component as changed when a different value is assigned
+template<class T>
+class Tracked {
+
+	public:
+
+		// constructor
+		Tracked(Component *owner, T const & value = T()) : fOwner(owner), fValue(value) {};
+
+		// get the value
+		inline T const & get() const {
+			return fValue;
+		}
+		inline operator T const & () const {
+			return fValue;
+		}
+
+		// set the value
+		inline Tracked& operator=(T const & value) {
+			if (!(fValue == value)) {
+				fValue = value;
+				fOwner->markChanged();
+			}
+			return *this;
+		}
+
+	private:
+
+		// can't be copied to another component
+		Tracked(Tracked const &);
+		Tracked& operator=(Tracked const &);
+
+		Component *fOwner;
+		T fValue;
+
+};
+
+
+/**
+ * TEMPLATED REQUEST FUNCTIONS
+ */
+
+// message request function
+template<class T>
+void Component::requestMessage(Atom message, void (T::*f)(Message const &)) {
+	requestMessage(message, boost::bind(f, (T*)(this), _1));
+}
+
+// require a component in this object
+template<class T>
+void Component::requireComponent(Atom name, void (T::*f)(Message const &)) {
+	requireComponent(name, boost::bind(f, (T*)(this), _1));
+}
+
+// register a component request
+template<class T>
+void Component::requestComponent(Atom name, void (T::*f)(Message const &), bool local) {
+	requestComponent(name, boost::bind(f, (T*)(this), _1), local);
+}
+
+// request all components of one type
+template<class T>
+void Component::requestAllExistingComponents(Atom name, void (T::*f)(Message const &)) {
+	requestAllExistingComponents(name, boost::bind(f, (T*)(this), _1));
+}
+
+// request the moves of components of one type
+template<class T>
+void Component::requestComponentMoves(Atom name, void (T::*f)(Message const &)) {
+	requestComponentMoves(name, boost::bind(f, (T*)(this), _1));
+}
+
+// receive the global messages of a request in one call per flush
+template<class T>
+void Component::requestMessageBatch(Atom message, void (T::*f)(vector<Message> const &)) {
+	requestMessageBatch(message, boost::bind(f, (T*)(this), _1));
+}
+
+// answer a query
+template<class R>
+void Component::answerQuery(Atom query, boost::function<R(Message const &)> f) {
+	TypedQueryAnswer<R> *answer = new TypedQueryAnswer<R>();
+	answer->component = this;
+	answer->f = f;
+	registerAnswer(query, answer, typeid(R));
+}
+template<class T, class R>
+void Component::answerQuery(Atom query, R (T::*f)(Message const &)) {
+	answerQuery<R>(query, boost::function<R(Message const &)>(boost::bind(f, (T*)(this), _1)));
+}
+
+
+};
+
+
+// output
+std::ostream& operator<<(std::ostream& s, Cistron::Component &v);
+
+
+#endif
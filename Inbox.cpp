@@ -0,0 +1,264 @@
+
+#include "Inbox.h"
+
+
+using namespace Cistron;
+
+
+#include <boost/thread/thread.hpp>
+
+
+// closed flag, in the high bit of the size
+const unsigned Inbox::CLOSED;
+
+
+// constructor/destructor
+Inbox::Inbox(ObjectId target, unsigned capacity, InboxOverflow overflow) : fSize(0), fTarget(target), fCapacity(capacity), fOverflow(overflow),
+	fReferences(1) {
+
+	// the queue always contains a stub node
+	fTail = new Node();
+	fHead.store(fTail);
+}
+Inbox::~Inbox() {
+
+	// delete the remaining nodes
+	while (fTail != 0) {
+		Node *next = fTail->next.load(boost::memory_order_relaxed);
+		delete fTail;
+		fTail = next;
+	}
+}
+
+
+// add a command
+bool Inbox::post(InboxCommand const & command) {
+
+	// reserve a place in the inbox, unless it's closed and nobody will drain it anymore
+	if (fOverflow == INBOX_GROW || fCapacity == 0) {
+		if (fSize.fetch_add(1, boost::memory_order_acquire) & CLOSED) {
+			fSize.fetch_sub(1, boost::memory_order_relaxed);
+			return false;
+		}
+	}
+	else {
+		unsigned size = fSize.load(boost::memory_order_acquire);
+		while (true) {
+			if (size & CLOSED) return false;
+
+			// full
+			if (size >= fCapacity) {
+				if (fOverflow == INBOX_REJECT) return false;
+				boost::this_thread::yield();
+				size = fSize.load(boost::memory_order_acquire);
+				continue;
+			}
+
+			// take it
+			if (fSize.compare_exchange_weak(size, size+1, boost::memory_order_acquire)) break;
+		}
+	}
+
+	// create the node
+	Node *node = new Node();
+	node->command = command;
+
+	// swap it in as the new head, and link the previous head to it
+	Node *prev = fHead.exchange(node, boost::memory_order_acq_rel);
+	prev->next.store(node, boost::memory_order_release);
+	return true;
+}
+
+
+// release an object inbox
+void Inbox::release() {
+	if (fReferences.fetch_sub(1, boost::memory_order_acq_rel) == 1) delete this;
+}
+
+
+// take the oldest command
+bool Inbox::pop(InboxCommand& command) {
+
+	// the tail is the stub, the command is in the node after it
+	Node *tail = fTail;
+	Node *next = tail->next.load(boost::memory_order_acquire);
+
+	// empty, or a producer is still linking its node
+	if (next == 0) return false;
+
+	// the next node becomes the stub
+	command = next->command;
+	next->command = InboxCommand();
+	fTail = next;
+	delete tail;
+
+	// one less
+	fSize.fetch_sub(1, boost::memory_order_release);
+	return true;
+}
+
+
+// reject the posts from now on
+void Inbox::close() {
+	fSize.fetch_or(CLOSED, boost::memory_order_acq_rel);
+}
+
+
+// take the oldest command of a closed inbox
+bool Inbox::drain(InboxCommand& command) {
+
+	// no post can take a place anymore, so the places taken are commands being linked
+	while (size() > 0) {
+		if (pop(command)) return true;
+		boost::this_thread::yield();
+	}
+	return false;
+}
+
+
+/**
+ * POSTING
+ */
+
+// send a message to the default target
+bool Inbox::postMessage(Component *sender, string const & msg, boost::any payload) {
+	return postMessageToObject(fTarget, sender, msg, payload);
+}
+bool Inbox::postMessage(Component *sender, RequestId reqId, boost::any payload) {
+	return postMessageToObject(fTarget, sender, reqId, payload);
+}
+
+// send a message to an object
+bool Inbox::postMessageToObject(ObjectId id, Component *sender, string const & msg, boost::any payload) {
+	InboxCommand command(INBOX_MESSAGE, id);
+	command.component = sender;
+	command.name = msg;
+	command.payload = payload;
+	return post(command);
+}
+bool Inbox::postMessageToObject(ObjectId id, Component *sender, RequestId reqId, boost::any payload) {
+	InboxCommand command(INBOX_MESSAGE, id);
+	command.component = sender;
+	command.reqId = reqId;
+	command.payload = payload;
+	return post(command);
+}
+
+// create an object
+bool Inbox::postCreateObject(list<Component*> const & components, bool finalize) {
+	InboxCommand command(INBOX_CREATE_OBJECT, -1);
+	command.components = components;
+	command.finalize = finalize;
+	return post(command);
+}
+
+// add a component
+bool Inbox::postAddComponent(ObjectId id, Component *component) {
+	InboxCommand command(INBOX_ADD_COMPONENT, id);
+	command.component = component;
+	return post(command);
+}
+
+// destroy a component
+bool Inbox::postDestroyComponent(Component *component) {
+	InboxCommand command(INBOX_DESTROY_COMPONENT, -1);
+	command.component = component;
+	return post(command);
+}
+
+// destroy an object
+bool Inbox::postDestroyObject(ObjectId id) {
+	return post(InboxCommand(INBOX_DESTROY_OBJECT, id));
+}
+
+// finalize an object
+bool Inbox::postFinalizeObject(ObjectId id) {
+	return post(InboxCommand(INBOX_FINALIZE_OBJECT, id));
+}
+
+// move a component
+bool Inbox::postMoveComponent(Component *component, ObjectId id) {
+	InboxCommand command(INBOX_MOVE_COMPONENT, id);
+	command.component = component;
+	return post(command);
+}
+
+// register a name
+bool Inbox::postRegisterName(ObjectId id, string const & name) {
+	InboxCommand command(INBOX_REGISTER_NAME, id);
+	command.name = name;
+	return post(command);
+}
+
+
+/**
+ * COMMAND BUFFERS
+ */
+
+// create an object
+ObjectId CommandBuffer::createObject() {
+	return createObject(list<Component*>(), false);
+}
+ObjectId CommandBuffer::createObject(list<Component*> const & components, bool finalize) {
+	InboxCommand command(INBOX_CREATE_OBJECT, -2 - (ObjectId)fCreated);
+	command.components = components;
+	command.finalize = finalize;
+	fCommands.push_back(command);
+	return -2 - (ObjectId)fCreated++;
+}
+
+// structural changes
+void CommandBuffer::addComponent(ObjectId id, Component *component) {
+	InboxCommand command(INBOX_ADD_COMPONENT, id);
+	command.component = component;
+	fCommands.push_back(command);
+}
+void CommandBuffer::destroyComponent(Component *component) {
+	InboxCommand command(INBOX_DESTROY_COMPONENT, -1);
+	command.component = component;
+	fCommands.push_back(command);
+}
+void CommandBuffer::destroyObject(ObjectId id) {
+	fCommands.push_back(InboxCommand(INBOX_DESTROY_OBJECT, id));
+}
+void CommandBuffer::finalizeObject(ObjectId id) {
+	fCommands.push_back(InboxCommand(INBOX_FINALIZE_OBJECT, id));
+}
+void CommandBuffer::moveComponent(Component *component, ObjectId id) {
+	InboxCommand command(INBOX_MOVE_COMPONENT, id);
+	command.component = component;
+	fCommands.push_back(command);
+}
+void CommandBuffer::registerName(ObjectId id, string const & name) {
+	InboxCommand command(INBOX_REGISTER_NAME, id);
+	command.name = name;
+	fCommands.push_back(command);
+}
+
+// messages
+void CommandBuffer::sendMessage(Component *sender, string const & msg, boost::any payload) {
+	sendMessageToObject(-1, sender, msg, payload);
+}
+void CommandBuffer::sendMessageToObject(ObjectId id, Component *sender, string const & msg, boost::any payload) {
+	InboxCommand command(INBOX_MESSAGE, id);
+	command.component = sender;
+	command.name = msg;
+	command.payload = payload;
+	fCommands.push_back(command);
+}
+
+// append another buffer
+void CommandBuffer::append(CommandBuffer& other) {
+	for (unsigned i = 0; i < other.fCommands.size(); ++i) {
+		fCommands.push_back(other.fCommands[i]);
+		if (fCommands.back().target < -1) fCommands.back().target -= fCreated;
+	}
+	fCreated += other.fCreated;
+	other.clear();
+}
+
+// forget the commands
+void CommandBuffer::clear() {
+	fCommands.clear();
+	fCreated = 0;
+}
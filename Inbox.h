@@ -0,0 +1,228 @@
+
+#ifndef INC_INBOX
+#define INC_INBOX
+
+#include "Component.h"
+
+
+#include <list>
+#include <vector>
+#include <string>
+#include <boost/atomic.hpp>
+
+
+namespace Cistron {
+
+using std::list;
+using std::vector;
+using std::string;
+
+
+// what happens when an inbox is full
+enum InboxOverflow {
+	INBOX_GROW = 0,		// never full, the capacity is ignored
+	INBOX_REJECT = 1,	// posting fails
+	INBOX_BLOCK = 2		// posting waits until the owning thread drained the inbox
+};
+
+// type of a posted command
+enum InboxCommandType {
+	INBOX_MESSAGE,
+	INBOX_CREATE_OBJECT,
+	INBOX_ADD_COMPONENT,
+	INBOX_DESTROY_COMPONENT,
+	INBOX_DESTROY_OBJECT,
+	INBOX_FINALIZE_OBJECT,
+	INBOX_MOVE_COMPONENT,
+	INBOX_REGISTER_NAME
+};
+
+// a posted command
+// names are kept as strings and only resolved by the owning thread
+struct InboxCommand {
+	InboxCommandType type;
+	ObjectId target;
+	Component *component;
+	RequestId reqId;
+	string name;
+	boost::any payload;
+	list<Component*> components;
+	bool finalize;
+	InboxCommand() : type(INBOX_MESSAGE), target(-1), component(0), reqId(0), finalize(false) {};
+	InboxCommand(InboxCommandType t, ObjectId id) : type(t), target(id), component(0), reqId(0), finalize(false) {};
+};
+
+
+// a lock-free multi-producer single-consumer inbox
+// any thread can post messages and structural commands, which are executed by the thread owning the object manager
+// when it processes its inboxes (ObjectManager::processInbox, called at the start of every tick)
+class Inbox {
+
+	public:
+
+		// constructor/destructor
+		// a capacity of 0 means unbounded
+		Inbox(ObjectId target = -1, unsigned capacity = 0, InboxOverflow overflow = INBOX_GROW);
+		virtual ~Inbox();
+
+
+		/**
+		 * POSTING - SAFE FROM ANY THREAD
+		 * All functions return false if the command was rejected because the inbox is full, or closed because its object was destroyed.
+		 * The sender component must be part of the object manager, and is only used as the sender of the message.
+		 */
+
+		// send a message to the default target of the inbox (everyone for the object manager inbox, the object for an object inbox)
+		bool postMessage(Component *sender, string const & msg, boost::any payload = 0);
+		bool postMessage(Component *sender, RequestId reqId, boost::any payload = 0);
+
+		// send a message to a particular object
+		bool postMessageToObject(ObjectId id, Component *sender, string const & msg, boost::any payload = 0);
+		bool postMessageToObject(ObjectId id, Component *sender, RequestId reqId, boost::any payload = 0);
+
+		// create an object containing the given components
+		bool postCreateObject(list<Component*> const & components, bool finalize = true);
+
+		// add a component to an existing object
+		bool postAddComponent(ObjectId id, Component *component);
+
+		// destroy a component or an object
+		bool postDestroyComponent(Component *component);
+		bool postDestroyObject(ObjectId id);
+
+		// finalize an object
+		bool postFinalizeObject(ObjectId id);
+
+		// move a component to another object
+		bool postMoveComponent(Component *component, ObjectId id);
+
+		// register a unique name for an object
+		bool postRegisterName(ObjectId id, string const & name);
+
+		// number of pending commands
+		inline unsigned size() {
+			return fSize.load(boost::memory_order_relaxed) & ~CLOSED;
+		}
+
+		// is the inbox closed, because its object was destroyed?
+		inline bool isClosed() {
+			return (fSize.load(boost::memory_order_acquire) & CLOSED) != 0;
+		}
+
+		// release an object inbox obtained from ObjectManager::getObjectInbox - safe from any thread
+		// the inbox is deleted once it was released by everyone who got it, and by the object manager
+		void release();
+
+	private:
+
+		// a node in the queue
+		struct Node {
+			boost::atomic<Node*> next;
+			InboxCommand command;
+			Node() : next(0) {};
+		};
+
+		// add a command
+		bool post(InboxCommand const &);
+
+		// take the oldest command - owning thread only
+		bool pop(InboxCommand&);
+
+		// reject the posts from now on - owning thread only
+		void close();
+
+		// take the oldest command of a closed inbox, waiting for the posts that took a place before it was closed
+		// returns false once they were all taken - owning thread only
+		bool drain(InboxCommand&);
+
+		// producers push at the head, the consumer pops at the tail
+		boost::atomic<Node*> fHead;
+		Node *fTail;
+
+		// number of pending commands, and the closed flag in the high bit
+		// a post takes its place in the same word, so it either takes it before the inbox is closed, and is drained, or fails
+		static const unsigned CLOSED = 0x80000000u;
+		boost::atomic<unsigned> fSize;
+
+		// default target of messages
+		ObjectId fTarget;
+
+		// backpressure
+		unsigned fCapacity;
+		InboxOverflow fOverflow;
+
+		// references of object inboxes
+		boost::atomic<unsigned> fReferences;
+
+		// object manager is our friend
+		friend class ObjectManager;
+
+};
+
+
+// a buffer of commands recorded by one thread or task, without any synchronization
+// the object manager executes buffers in the order of their keys, and the commands of a buffer in the order they were
+// recorded, so the result doesn't depend on how the threads were scheduled - unlike the commands posted to an inbox
+class CommandBuffer {
+
+	public:
+
+		// constructor - buffers with a lower key are executed first
+		CommandBuffer(unsigned key = 0) : fKey(key), fCreated(0) {};
+
+		// the key the buffers are ordered by
+		inline unsigned getKey() {
+			return fKey;
+		}
+		inline void setKey(unsigned key) {
+			fKey = key;
+		}
+
+		// create an object - returns a provisional id, which can only be used in later commands of this buffer
+		ObjectId createObject();
+		ObjectId createObject(list<Component*> const & components, bool finalize = true);
+
+		// structural changes, to existing objects or to provisional ones
+		void addComponent(ObjectId id, Component *component);
+		void destroyComponent(Component *component);
+		void destroyObject(ObjectId id);
+		void finalizeObject(ObjectId id);
+		void moveComponent(Component *component, ObjectId id);
+		void registerName(ObjectId id, string const & name);
+
+		// send a message to everyone, or to an object
+		void sendMessage(Component *sender, string const & msg, boost::any payload = 0);
+		void sendMessageToObject(ObjectId id, Component *sender, string const & msg, boost::any payload = 0);
+
+		// append the commands of another buffer, which is cleared - its provisional ids are renumbered
+		void append(CommandBuffer&);
+
+		// number of recorded commands
+		inline unsigned size() {
+			return fCommands.size();
+		}
+
+		// forget the recorded commands
+		void clear();
+
+	private:
+
+		// recorded commands - provisional ids are -2 for the first object created, -3 for the second, ...
+		vector<InboxCommand> fCommands;
+
+		// key
+		unsigned fKey;
+
+		// number of objects created
+		unsigned fCreated;
+
+		// object manager is our friend
+		friend class ObjectManager;
+
+};
+
+
+};
+
+
+#endif
@@ -0,0 +1,222 @@
+
+#include "Mirror.h"
+
+
+using namespace Cistron;
+using namespace boost::interprocess;
+
+
+#include <cstring>
+#include <new>
+
+
+// region header
+static const char MirrorMagic[4] = { 'C', 'S', 'T', 'M' };
+static const unsigned MirrorVersion = 1;
+
+// no buffer published yet
+static const unsigned MirrorNone = 2;
+
+
+/**
+ * PUBLISHING
+ */
+
+// constructor/destructor
+Mirror::Mirror(string const & name, unsigned capacity) : fName(name), fHeader(0), fData(0), fTime(0), fPublished(0), fDropped(0) {
+
+	// create the region
+	shared_memory_object::remove(name.c_str());
+	shared_memory_object memory(create_only, name.c_str(), read_write);
+	memory.truncate(sizeof(MirrorHeader) + 2 * capacity);
+	fMemory.swap(memory);
+	mapped_region region(fMemory, read_write);
+	fRegion.swap(region);
+
+	// initialize the header
+	fHeader = new (fRegion.get_address()) MirrorHeader();
+	memcpy(fHeader->magic, MirrorMagic, 4);
+	fHeader->version = MirrorVersion;
+	fHeader->capacity = capacity;
+	fHeader->latest.store(MirrorNone);
+	for (int i = 0; i < 2; ++i) {
+		fHeader->buffers[i].sequence.store(0);
+		fHeader->buffers[i].size = 0;
+	}
+	fData = (unsigned char*)fRegion.get_address() + sizeof(MirrorHeader);
+}
+Mirror::~Mirror() {
+
+	// the region disappears when the last reader unmaps it
+	shared_memory_object::remove(fName.c_str());
+}
+
+
+// publish a component type
+void Mirror::registerComponent(Atom type, ComponentWriter writer) {
+	if (fWriters.find(type.getId()) == fWriters.end()) fTypes.push_back(type);
+	fWriters[type.getId()] = writer;
+}
+
+
+// start a snapshot
+void Mirror::beginSnapshot(Time time) {
+	fTime = time;
+	fCounts.assign(fTypes.size(), 0);
+	fRecords.resize(fTypes.size());
+	for (unsigned i = 0; i < fRecords.size(); ++i) fRecords[i].clear();
+}
+
+
+// add a component to the snapshot
+void Mirror::writeComponent(Component *comp) {
+
+	// find its type
+	unsigned type = 0;
+	while (type < fTypes.size() && fTypes[type] != comp->getNameAtom()) ++type;
+	if (type == fTypes.size()) return;
+
+	// owner and state
+	vector<unsigned char> state;
+	RecordWriter stateWriter(state);
+	fWriters[comp->getNameAtom().getId()](comp, stateWriter);
+	RecordWriter w(fRecords[type]);
+	w.writeInt(comp->getOwnerId());
+	w.writeBytes(state);
+	++fCounts[type];
+}
+
+
+// publish the snapshot
+void Mirror::endSnapshot() {
+
+	// layout: time, number of types, and per type its name, number of components and size of the records
+	fSnapshot.clear();
+	RecordWriter w(fSnapshot);
+	w.writeUnsigned(fTime);
+	w.writeUnsigned(fTypes.size());
+	for (unsigned i = 0; i < fTypes.size(); ++i) {
+		w.writeString(fTypes[i].str());
+		w.writeUnsigned(fCounts[i]);
+		w.writeBytes(fRecords[i]);
+	}
+
+	// doesn't fit
+	if (fSnapshot.size() > fHeader->capacity) {
+		++fDropped;
+		return;
+	}
+
+	// write the buffer readers aren't directed to
+	unsigned b = fHeader->latest.load(boost::memory_order_relaxed) == 0 ? 1 : 0;
+	MirrorBuffer& buffer = fHeader->buffers[b];
+	unsigned sequence = buffer.sequence.load(boost::memory_order_relaxed);
+	buffer.sequence.store(sequence + 1, boost::memory_order_relaxed);
+	boost::atomic_thread_fence(boost::memory_order_release);
+	memcpy(fData + b * fHeader->capacity, &fSnapshot[0], fSnapshot.size());
+	buffer.size = fSnapshot.size();
+	buffer.sequence.store(sequence + 2, boost::memory_order_release);
+
+	// direct the readers to it
+	fHeader->latest.store(b, boost::memory_order_release);
+	++fPublished;
+}
+
+
+/**
+ * READING
+ */
+
+// find the records of a type
+bool MirrorSnapshot::find(string const & type, unsigned& count, unsigned& offset) {
+	if (fData.size() == 0) return false;
+	RecordReader r(&fData[0], fData.size());
+	r.readUnsigned();
+	unsigned types = r.readUnsigned();
+	for (unsigned i = 0; i < types && !r.failed(); ++i) {
+		string name = r.readString();
+		count = r.readUnsigned();
+		unsigned size = r.readUnsigned();
+		offset = fData.size() - r.remaining();
+		if (name == type) return !r.failed();
+		r.skip(size);
+	}
+	return false;
+}
+
+
+// number of components of a type
+unsigned MirrorSnapshot::getCount(string const & type) {
+	unsigned count, offset;
+	if (!find(type, count, offset)) return 0;
+	return count;
+}
+
+
+// iterate the components of a type
+void MirrorSnapshot::forEach(string const & type, boost::function<void(ObjectId, RecordReader&)> f) {
+	unsigned count, offset;
+	if (!find(type, count, offset)) return;
+	RecordReader r(&fData[0] + offset, fData.size() - offset);
+	for (unsigned i = 0; i < count && !r.failed(); ++i) {
+		ObjectId id = r.readInt();
+		vector<unsigned char> state = r.readBytes();
+		RecordReader stateReader(state.size() > 0 ? &state[0] : 0, state.size());
+		f(id, stateReader);
+	}
+}
+
+
+// constructor/destructor
+MirrorReader::MirrorReader(string const & name) : fHeader(0), fData(0) {
+
+	// map the region, it might not exist
+	try {
+		shared_memory_object memory(open_only, name.c_str(), read_only);
+		fMemory.swap(memory);
+		mapped_region region(fMemory, read_only);
+		fRegion.swap(region);
+	}
+	catch (interprocess_exception&) {
+		return;
+	}
+
+	// check the header
+	MirrorHeader const *header = (MirrorHeader const *)fRegion.get_address();
+	if (fRegion.get_size() < sizeof(MirrorHeader) || memcmp(header->magic, MirrorMagic, 4) != 0 || header->version != MirrorVersion) return;
+	if (fRegion.get_size() < sizeof(MirrorHeader) + 2 * header->capacity) return;
+	fHeader = header;
+	fData = (unsigned char const *)fRegion.get_address() + sizeof(MirrorHeader);
+}
+MirrorReader::~MirrorReader() {
+}
+
+
+// copy the latest snapshot
+bool MirrorReader::read(MirrorSnapshot& snapshot, unsigned maxRetries) {
+	if (fHeader == 0) return false;
+	for (unsigned i = 0; i <= maxRetries; ++i) {
+
+		// nothing published yet
+		unsigned b = fHeader->latest.load(boost::memory_order_acquire);
+		if (b == MirrorNone) return false;
+
+		// being written
+		MirrorBuffer const & buffer = fHeader->buffers[b];
+		unsigned sequence = buffer.sequence.load(boost::memory_order_acquire);
+		if (sequence & 1) continue;
+
+		// copy it, and check that the writer didn't touch it meanwhile
+		unsigned size = buffer.size;
+		if (size > fHeader->capacity) continue;
+		snapshot.fData.assign(fData + b * fHeader->capacity, fData + b * fHeader->capacity + size);
+		boost::atomic_thread_fence(boost::memory_order_acquire);
+		if (buffer.sequence.load(boost::memory_order_relaxed) != sequence) continue;
+
+		// consistent
+		RecordReader r(snapshot.fData.size() > 0 ? &snapshot.fData[0] : 0, snapshot.fData.size());
+		snapshot.fTime = r.readUnsigned();
+		return !r.failed();
+	}
+	return false;
+}
@@ -0,0 +1,174 @@
+
+#ifndef INC_MIRROR
+#define INC_MIRROR
+
+#include "Recorder.h"
+
+
+#include <vector>
+#include <map>
+#include <string>
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+
+namespace Cistron {
+
+using std::vector;
+using std::map;
+using std::string;
+
+
+/**
+ * SHARED MEMORY LAYOUT
+ * The region starts with a header, followed by two buffers of the capacity given by the writer.
+ * The writer always writes the buffer readers aren't directed to, and then publishes it as the latest.
+ * Each buffer is guarded by a sequence counter, which is odd while the buffer is being written: readers
+ * retry when the counter was odd or changed while they were copying the buffer.
+ */
+struct MirrorBuffer {
+	boost::atomic<unsigned> sequence;
+	unsigned size;
+};
+struct MirrorHeader {
+	char magic[4];
+	unsigned version;
+	unsigned capacity;
+	boost::atomic<unsigned> latest;
+	MirrorBuffer buffers[2];
+};
+
+
+/**
+ * PUBLISHING
+ * A mirror publishes the state of selected component types into a named shared memory region, at the end
+ * of every tick of the object manager it is attached to. Processes reading the region with a MirrorReader
+ * never block the object manager.
+ */
+class Mirror {
+
+	public:
+
+		// constructor/destructor - creates the region, replacing any region with the same name
+		// the capacity is the maximum size of a snapshot in bytes
+		Mirror(string const & name, unsigned capacity);
+		virtual ~Mirror();
+
+		// publish a component type - the writer writes the state of one component
+		void registerComponent(Atom type, ComponentWriter);
+
+		// number of snapshots published, and dropped because they didn't fit in the capacity
+		inline unsigned getPublished() {
+			return fPublished;
+		}
+		inline unsigned getDropped() {
+			return fDropped;
+		}
+
+		// called by the object manager
+		void beginSnapshot(Time);
+		void writeComponent(Component*);
+		void endSnapshot();
+
+		// published component types
+		inline vector<Atom> const & getTypes() {
+			return fTypes;
+		}
+
+	private:
+
+		// name of the region
+		string fName;
+
+		// shared memory
+		boost::interprocess::shared_memory_object fMemory;
+		boost::interprocess::mapped_region fRegion;
+		MirrorHeader *fHeader;
+		unsigned char *fData;
+
+		// published types, and their writers by atom id
+		vector<Atom> fTypes;
+		map<AtomId, ComponentWriter> fWriters;
+
+		// snapshot being built: per type, the number of components and their records
+		vector<unsigned> fCounts;
+		vector<vector<unsigned char> > fRecords;
+		vector<unsigned char> fSnapshot;
+		Time fTime;
+
+		// statistics
+		unsigned fPublished;
+		unsigned fDropped;
+
+};
+
+
+/**
+ * READING
+ */
+
+// a consistent copy of the published state
+class MirrorSnapshot {
+
+	public:
+
+		// time of the object manager when the snapshot was taken
+		inline Time getTime() {
+			return fTime;
+		}
+
+		// number of components of a type in the snapshot
+		unsigned getCount(string const & type);
+
+		// call a function for every component of a type, with the owner id and a reader over its state
+		void forEach(string const & type, boost::function<void(ObjectId, RecordReader&)>);
+
+	private:
+
+		// find the records of a type - returns false if the type isn't published
+		bool find(string const & type, unsigned& count, unsigned& offset);
+
+		// snapshot data
+		vector<unsigned char> fData;
+		Time fTime;
+
+		// the reader fills the snapshot
+		friend class MirrorReader;
+
+};
+
+// maps a mirror region read-only
+class MirrorReader {
+
+	public:
+
+		// constructor/destructor - opens the region, check isOpen for success
+		MirrorReader(string const & name);
+		virtual ~MirrorReader();
+
+		// is the region mapped?
+		inline bool isOpen() {
+			return fHeader != 0;
+		}
+
+		// copy the latest snapshot, retrying while the writer interferes
+		// returns false if nothing was published yet or no consistent copy was made within the retries
+		bool read(MirrorSnapshot&, unsigned maxRetries = 1000);
+
+	private:
+
+		// shared memory
+		boost::interprocess::shared_memory_object fMemory;
+		boost::interprocess::mapped_region fRegion;
+		MirrorHeader const *fHeader;
+		unsigned char const *fData;
+
+};
+
+
+};
+
+
+#endif
@@ -1,104 +1,124 @@
-
-#ifndef INC_OBJECT
-#define INC_OBJECT
-
-#include "Component.h"
-
-
-#include <hash_map>
-#include <list>
-#include <string>
-#include <vector>
-
-
-namespace Cistron {
-
-using std::vector;
-using std::list;
-using std::string;
-using stdext::hash_map;
-
-
-// an object is a container of components
-class Object {
-
-	public:
-
-		// constructor/destructor
-		Object(ObjectId id);
-		virtual ~Object();
-
-	
-	private:
-
-		// object id
-		ObjectId fId;
-
-
-		/**
-		 * COMPONENT MANAGEMENT
-		 */
-
-		// component map
-		hash_map<string, list<Component*> > fComponents;
-
-		// add a component
-		bool addComponent(Component*);
-
-		// get a component
-		list<Component*> getComponents(string name);
-
-		// get all components
-		list<Component*> getComponents();
-
-		// remove all requests for a given component
-		void removeComponent(Component*);
-
-		/**
-		 * LOCAL REQUESTS
-		 */
-
-		// send a local message
-		void sendMessage(RequestId, Message const &);
-
-		// register a request
-		void registerRequest(RequestId, RegisteredComponent);
-
-		// list of local requests
-		vector<list<RegisteredComponent> > fLocalRequests;
-
-
-		/**
-		 * OBJECT MANAGEMENT
-		 */
-
-		// is the object finalized?
-		bool fFinalized;
-
-		// finalize the object
-		void finalize();
-
-		// is the object finalized?
-		bool isFinalized();
-
-		/**
-		 * LOGGING
-		 */
-
-		// track a request
-		void trackRequest(RequestId, Component*);
-
-
-
-		// object manager is our friend
-		friend class ObjectManager;
-
-
-
-};
-
-
-};
-
-
-#endif
+
+#ifndef INC_OBJECT
+#define INC_OBJECT
+
+#include "Component.h"
+
+
+#include <hash_map>
+#include <list>
+#include <string>
+#include <vector>
+#include <utility>
+
+
+namespace Cistron {
+
+class Behavior;
+class Profiler;
+
+using std::vector;
+using std::list;
+using std::string;
+using std::pair;
+using stdext::hash_map;
+
+
+// an object is a container of components
+class Object {
+
+	public:
+
+		// constructor/destructor
+		Object(ObjectId id);
+		virtual ~Object();
+
+	
+	private:
+
+		// object id
+		ObjectId fId;
+
+
+		/**
+		 * COMPONENT MANAGEMENT
+		 */
+
+		// component map, by component name atom
+		hash_map<AtomId, list<Component*> > fComponents;
+
+		// add a component
+		bool addComponent(Component*);
+
+		// get a component
+		list<Component*> getComponents(Atom name);
+
+		// get all components
+		list<Component*> getComponents();
+
+		// remove all requests for a given component
+		void removeComponent(Component*);
+
+		// move a component to another object, with its local requests and answers
+		void moveComponent(Component*, Object *to);
+
+		/**
+		 * LOCAL REQUESTS
+		 */
+
+		// send a local message, profiling the callbacks if there is a profiler
+		void sendMessage(RequestId, Message const &, Profiler *profiler = 0);
+
+		// register a request
+		void registerRequest(RequestId, RegisteredComponent);
+
+		// list of local requests
+		vector<list<RegisteredComponent> > fLocalRequests;
+
+		// behaviors waiting for a local event, by request id
+		vector<Behavior*> fWaitingBehaviors;
+
+		// answers to queries, by atom id of the query name
+		vector<vector<QueryAnswer*> > fQueryAnswers;
+
+
+		/**
+		 * OBJECT MANAGEMENT
+		 */
+
+		// is the object finalized?
+		bool fFinalized;
+
+		// finalize the object
+		void finalize();
+
+		// is the object finalized?
+		bool isFinalized();
+
+		// the object will be destroyed incrementally, and is invisible until then
+		bool fDying;
+
+		// groups the object is a member of, with its index in the members of the group
+		vector<pair<AtomId, unsigned> > fGroups;
+
+		/**
+		 * LOGGING
+		 */
+
+		// track a request
+		void trackRequest(RequestId, Component*);
+
+
+
+		// object manager is our friend
+		friend class ObjectManager;
+
+
+
+};
+
+
+};
+
+
+#endif
@@ -1,547 +1,2584 @@
-
-#include "ObjectManager.h"
-
-
-using namespace Cistron;
-
-
-#include <iostream>
-
-using std::cout;
-using std::endl;
-using boost::format;
-
-
-// constructor/destructor
-ObjectManager::ObjectManager() : fIdCounter(0), fRequestIdCounter(0), fNLocks(0) {
-
-	// because we start counting from 1 for request id's, we add an empty request lock in front
-	fRequestLocks.push_back(RequestLock());
-}
-ObjectManager::~ObjectManager() {
-
-	// delete all objects
-	for (unsigned i = 0; i < fObjects.size(); ++i) {
-
-		// already destroyed earlier
-		if (fObjects[i] == 0) continue;
-
-		// destroy every component in the object
-		list<Component*> comps = fObjects[i]->getComponents();
-		for (list<Component*>::iterator it = comps.begin(); it != comps.end(); ++it) {
-			destroyComponent(*it);
-		}
-
-		// destroy the object itself
-		delete fObjects[i];
-	}
-}
-
-
-// generate a unique request id or return one if it already exists
-RequestId ObjectManager::getMessageRequestId(ComponentRequestType type, string name) {
-
-	// ALL_COMPONENTS is changed to COMPONENT, it's the same in regards to the request id
-	if (type == REQ_ALLCOMPONENTS) type = REQ_COMPONENT;
-
-	// if it doesn't exist, create it
-	if (fRequestToId[type].find(name) == fRequestToId[type].end()) {
-		fRequestToId[type][name] = ++fRequestIdCounter;
-		fIdToRequest[type][fRequestIdCounter] = name;
-		fRequestLocks.push_back(RequestLock());
-		return fRequestIdCounter;
-	}
-
-	// it exists, just return it
-	return fRequestToId[type][name];
-}
-
-
-// return existing request id
-RequestId ObjectManager::getExistingRequestId(ComponentRequestType type, string name) {
-
-	// if it doesn't exist we don't return it
-	if (fRequestToId[type].find(name) == fRequestToId[type].end()) {
-		return 0;
-	}
-
-	// if it does exist, but there are no global requests, we don't return it either
-	RequestId id = fRequestToId[type][name];
-	if (fGlobalRequests.size() <= id) return 0;
-
-	// we might have a global request - process it
-	return id;
-}
-
-
-
-// create a new object
-ObjectId ObjectManager::createObject() {
-
-	// create a new object
-	Object *obj = new Object(fIdCounter);
-	//cout << "Created object " << fIdCounter << endl;
-	++fIdCounter;
-
-	// add it to the list
-	fObjects.push_back(obj);
-	return fIdCounter-1;
-}
-
-
-// activate lock
-void ObjectManager::activateLock(RequestId reqId) {
-
-	// if the lock is already activated, we have bounced against an infinite loop
-	if (fRequestLocks[reqId].locked) {
-		error(format("Do not request a message or component in a callback function for the same message/component request or a function called by this callback function"));
-	}
-
-	// one more lofk
-	++fNLocks;
-
-	// activate the lock
-	fRequestLocks[reqId].locked = true;
-}
-
-
-// release the lock, process the pending global and local requests
-void ObjectManager::releaseLock(RequestId reqId) {
-
-	// lock
-	RequestLock& lock = fRequestLocks[reqId];
-
-	// must be locked!
-	assert(lock.locked);
-
-	// release the lock
-	lock.locked = false;
-
-	// one lock less
-	--fNLocks;
-
-	// copy the pending requests
-	list<pair<ComponentRequest, RegisteredComponent> > pendingGlobal = lock.pendingGlobalRequests;
-	list<pair<ComponentRequest, RegisteredComponent> > pendingLocal = lock.pendingLocalRequests;
-	lock.pendingGlobalRequests = list<pair<ComponentRequest, RegisteredComponent> >();
-	lock.pendingLocalRequests = list<pair<ComponentRequest, RegisteredComponent> >();
-
-	// process the global requests
-	for (list<pair<ComponentRequest, RegisteredComponent> >::iterator it = pendingGlobal.begin(); it != pendingGlobal.end(); ++it) {
-		registerGlobalRequest(it->first, it->second);
-	}
-
-	// process the local requests
-	for (list<pair<ComponentRequest, RegisteredComponent> >::iterator it = pendingLocal.begin(); it != pendingLocal.end(); ++it) {
-		registerLocalRequest(it->first, it->second);
-	}
-
-	// if there are no more locks, destroy any pending components & objects
-	if (fNLocks == 0) {
-
-		// first components
-		list<Component*> deadComponents = fDeadComponents;
-		fDeadComponents.clear();
-		for (list<Component*>::iterator it = deadComponents.begin(); it != deadComponents.end(); ++it) {
-			destroyComponent(*it);
-		}
-
-		// then entire objects
-		list<ObjectId> deadObjects = fDeadObjects;
-		fDeadObjects.clear();
-		for (list<ObjectId>::iterator it = deadObjects.begin(); it != deadObjects.end(); ++it) {
-			destroyObject(*it);
-		}
-	}
-}
-
-
-// add a new component to an object
-void ObjectManager::addComponent(ObjectId id, Component *component) {
-
-	// make sure the object exists
-	if (id < 0 || id >= fObjects.size() || fObjects[id] == 0) {
-		error(format("Failed to add component %s to object %d: it does not exist!") % component->toString() % id);
-	}
-
-	// can only add once
-	if (component->fObjectManager != 0) {
-		error(format("Component is already part of an ObjectManager. You cannot add a component twice."));
-	}
-
-	// we get the appropriate object
-	Object *obj = fObjects[id];
-
-	// set the object manager
-	component->fObjectManager = this;
-
-	// set the owner of the component
-	component->setOwner(id);
-
-	// we add the component
-	if (!obj->addComponent(component)) {
-		error(boost::format("Failed to add component %s to object %d") % component->toString() % id);
-	}
-
-	// put in log
-	//if (fStream.is_open()) fStream << "CREATE  " << *component << endl;
-
-	// let the component know
-	component->addedToObject();
-
-	// get request id for this component
-	RequestId reqId = getExistingRequestId(REQ_COMPONENT, component->getName());
-
-	// if there's no such request yet, we skip
-	if (reqId == 0) return;
-
-	// CREATE event
-	Message msg(CREATE);
-	msg.sender = component;
-
-	// lock this request id
-	activateLock(reqId);
-
-	// look for requests and forward them
-	for (list<RegisteredComponent>::iterator it = fGlobalRequests[reqId].begin(); it != fGlobalRequests[reqId].end(); ++it) {
-		if (it->component->getId() != component->getId()) {
-			if ((*it).trackMe) cout << it->component << " received component " << *component << " of type " << fIdToRequest[REQ_COMPONENT][reqId] << endl; 
-			(*it).callback(msg);
-		}
-	}
-
-	// forward to the object itself, so local requests are processed also
-	obj->sendMessage(reqId, msg);
-
-	// release the lock
-	releaseLock(reqId);
-}
-
-
-// register a local request
-// only COMPONENT requests can be local!!
-void ObjectManager::registerLocalRequest(ComponentRequest req, RegisteredComponent reg) {
-
-	// we generate the request id (might be new)
-	RequestId reqId = getMessageRequestId(req.type, req.name);
-
-	// if this request is locked, postpone the processing
-	if (fRequestLocks[reqId].locked) {
-		fRequestLocks[reqId].pendingLocalRequests.push_back(pair<ComponentRequest, RegisteredComponent>(req, reg));
-		return;
-	}
-
-	// forward to appropriate object
-	fObjects[reg.component->getOwnerId()]->registerRequest(reqId, reg);
-
-	// put in log
-	//if (fStream.is_open()) fStream << "DESTROY " << *comp << endl;
-
-//cout << "Registered local request of " << (*reg.component) << " for " << req.name << endl;
-	// if we want the previously created components as well, we process them
-	if (req.type != REQ_COMPONENT) return;
-	
-	// lock this request id
-	activateLock(reqId);
-
-	// now look for existing components of this type
-	Message msg(CREATE);
-
-	// get component and forward it
-	list<Component*> comps = fObjects[reg.component->getOwnerId()]->getComponents(req.name);
-	for (list<Component*>::iterator it = comps.begin(); it != comps.end(); ++it) {
-		if ((*it)->isValid() && reg.component->getId() != (*it)->getId()) {
-			msg.sender = (*it);
-			if (reg.trackMe) cout << *reg.component << " received component " << (*msg.sender) << " of type " << req.name << endl;
-			//cout << "Warning component " << (*reg.component) << " for the local existence of component " << (*msg.sender) << endl;
-			reg.callback(msg);
-		}
-	}
-
-	// release the lock
-	releaseLock(reqId);
-}
-
-
-// register a global request
-void ObjectManager::registerGlobalRequest(ComponentRequest req, RegisteredComponent reg) {
-	assert(reg.component->isValid());
-
-	// first we request the id and create it if it doesn't exist
-	RequestId reqId = getMessageRequestId(req.type, req.name);
-
-	// we only really register component and message requests
-	if (req.type != REQ_ALLCOMPONENTS) {
-
-		// if this request is locked, postpone the processing
-		if (fRequestLocks[reqId].locked) {
-			fRequestLocks[reqId].pendingGlobalRequests.push_back(pair<ComponentRequest, RegisteredComponent>(req, reg));
-			return;
-		}
-
-		// if the request list isn't large enough, we resize it
-		if (fGlobalRequests.size() <= reqId) {
-			fGlobalRequests.resize(reqId+1);
-		}
-
-		// we add the request
-		fGlobalRequests[reqId].push_back(reg);
-	//cout << "Registered global request of " << (*reg.component) << " for " << req.name << endl;
-		// we also add it locally if it is a message
-		if (req.type == REQ_MESSAGE) {
-			fObjects[reg.component->getOwnerId()]->registerRequest(reqId, reg);
-		}
-
-		// we add it to the associative map (used at destruction of the component to look up all its requests)
-		fRequestsByComponentId[reg.component->getId()].push_back(req);
-
-		// if the request is required and the object isn't finalized yet, we add it to a special list
-		ObjectId objId = reg.component->getOwnerId();
-		if (reg.required && !fObjects[objId]->isFinalized()) {
-			fRequiredComponents[objId].push_back(req.name);
-		}
-	}
-
-	// if we want the previously created components as well, we process them
-	if (req.type == REQ_MESSAGE) return;
-	
-	// activate the lock on this id
-	activateLock(reqId);
-
-	// now look for existing components of this type
-	Message msg(CREATE);
-	for (unsigned i = 0; i < fObjects.size(); ++i) {
-
-		// only process objects that still exist
-		if (fObjects[i] == 0) continue;
-
-		// get component and forward it
-		list<Component*> comps = fObjects[i]->getComponents(req.name);
-		for (list<Component*>::iterator it = comps.begin(); it != comps.end(); ++it) {
-			if ((*it)->isValid() && reg.component->getId() != (*it)->getId()) {
-				msg.sender = (*it);
-				if (reg.trackMe) cout << (*reg.component) << " received component " << (**it) << " of type " << req.name << endl; 
-				//cout << "Warning component " << (*reg.component) << " for the global existence of component " << (*msg.sender) << endl;
-				reg.callback(msg);
-			}
-		}
-	}
-
-	// release the lock
-	releaseLock(reqId);
-}
-
-
-// send a message to everyone
-void ObjectManager::sendGlobalMessage(RequestId reqId, Message const & msg) {
-
-	// must be valid component
-	assert(msg.sender->isValid());
-
-	// activate the lock
-	activateLock(reqId);
-
-	// look for requests and forward them
-	for (list<RegisteredComponent>::iterator it = fGlobalRequests[reqId].begin(); it != fGlobalRequests[reqId].end(); ++it) {
-		if ((*it).trackMe) cout << it->component << " received message " << fIdToRequest[REQ_MESSAGE][reqId] << " from " << *msg.sender << endl; 
-		(*it).callback(msg);
-	}
-
-	// release the lock
-	releaseLock(reqId);
-}
-
-
-// error processing
-void ObjectManager::error(boost::format err) {
-	cout << err.str() << endl;
-	assert(false);
-}
-
-
-// destroy object
-void ObjectManager::destroyObject(ObjectId id) {
-
-	// if there's no lock, we delete the object immediately, otherwise, postpone
-	if (fNLocks != 0) {
-		fDeadObjects.push_back(id);
-		return;
-	}
-
-	// object doesn't exist
-	if (id < 0 || id >= fObjects.size() || fObjects[id] == 0) {
-		error(format("Failed to destroy object %d: it does not exist!") % id);
-	}
-
-	// destroy every component in the object
-	list<Component*> comps = fObjects[id]->getComponents();
-	for (list<Component*>::iterator it = comps.begin(); it != comps.end(); ++it) {
-		destroyComponent(*it);
-	}
-
-	// delete the actual object
-	//cout << "Destroyed object " << id << endl;
-	delete fObjects[id];
-	fObjects[id] = 0;
-}
-
-
-
-// destroy a component
-void ObjectManager::destroyComponent(Component *comp) {
-
-	// already destroyed before, don't do anything
-	if (comp->isDestroyed()) {
-		return;
-	}
-
-	// invalid component shouldn't be possible
-	else if (!comp->isValid()) {
-		error(format("Error destroying component %s: component is not valid.") % comp->toString());
-	}
-
-
-	// see if there are any locks - if there are, postpone this destroyal
-	if (fNLocks != 0) {
-		fDeadComponents.push_back(comp);
-		return;
-	}
-	
-
-	// put in log
-	//if (fStream.is_open()) fStream << "DESTROY " << *comp << endl;
-
-	// remove its own requests
-	list<ComponentRequest>& reqs = fRequestsByComponentId[comp->getId()];
-	for (list<ComponentRequest>::iterator it = reqs.begin(); it != reqs.end(); ++it) {
-
-		// get the appropriate id
-		RequestId reqId = getExistingRequestId(it->type, it->name);
-
-		// must exist!
-		assert(reqId != 0);
-
-		// look up the request and delete it
-		for (list<RegisteredComponent>::iterator reg = fGlobalRequests[reqId].begin(); reg != fGlobalRequests[reqId].end();) {
-			if (reg->component->getId() == comp->getId()) {
-				reg = fGlobalRequests[reqId].erase(reg);
-			}
-			else ++reg;
-		}
-	}
-
-	// remove its own local requests - only if the object itself wasn't removed yet
-	fObjects[comp->getOwnerId()]->removeComponent(comp);
-
-	// CREATE event
-	Message msg(DESTROY);
-	msg.sender = comp;
-
-	// get req id
-	RequestId reqId = getExistingRequestId(REQ_COMPONENT, comp->getName());
-
-	// if there exist some requests, we process them
-	if (reqId != 0) {
-
-		// activate lock
-		activateLock(reqId);
-
-		// look up the request and delete it
-		for (list<RegisteredComponent>::iterator reg = fGlobalRequests[reqId].begin(); reg != fGlobalRequests[reqId].end(); ++reg) {
-			reg->callback(msg);
-		}
-
-		// forward to the object itself, so local requests are processed also
-		fObjects[comp->getOwnerId()]->sendMessage(reqId, msg);
-
-		// release the lock
-		releaseLock(reqId);
-	}
-
-	// make it invalid
-	comp->setDestroyed();
-}
-
-
-// finalize an object
-void ObjectManager::finalizeObject(ObjectId id) {
-
-	// object doesn't exist
-	if (id < 0 || id >= fObjects.size() || fObjects[id] == 0) {
-		error(format("Failed to destroy object %d: it does not exist!") % id);
-	}
-
-	// finalize the object itself
-	fObjects[id]->finalize();
-
-	// see if there are any requirements
-	if (fRequiredComponents.find(id) == fRequiredComponents.end()) return;
-
-	// there are, do the checklist
-	list<string> requiredComponents = fRequiredComponents[id];
-	bool destroyObject = false;
-	for (list<string>::iterator it = requiredComponents.begin(); it != requiredComponents.end(); ++it) {
-
-		// get the components of this type
-		list<Component*> comps = fObjects[id]->getComponents(*it);
-
-		// if there are none, we want this object dead!
-		if (comps.size() == 0) destroyObject = true;
-	}
-/*if (!destroyObject) cout << "Finalized object " << id << " succesfully!" << endl;
-else cout << "Finalize on object " << id << " failed, destroying..." << endl;*/
-	// we destroy the object if we didn't find what we needed
-	if (destroyObject) this->destroyObject(id);
-}
-
-
-// register a unique name for an object
-bool ObjectManager::registerName(ObjectId id, string name) {
-
-	// see if the name doesn't exist yet
-	if (fObjectNameToId.find(name) != fObjectNameToId.end()) {
-		error(format("Failed to register name identifier %s for object %d, because it already exists!") % name % id);
-		return false;
-	}
-
-	// add the id
-	fObjectNameToId[name] = id;
-	return true;
-}
-
-// get the id based on the unique name identified
-ObjectId ObjectManager::getObjectId(string name) {
-
-	// see if the name doesn't exist yet
-	if (fObjectNameToId.find(name) == fObjectNameToId.end()) {
-		error(format("Failed to acquire object id for unique name identifier %s because it doesn't exist!") % name);
-		return 0;
-	}
-
-	// return id
-	return fObjectNameToId[name];
-}
-
-
-// logging
-void ObjectManager::trackRequest(RequestId reqId, bool local, Component *component) {
-
-	// if global, find it
-	if (!local) {
-
-		// find in global request list
-		for (list<RegisteredComponent>::iterator it = fGlobalRequests[reqId].begin(); it != fGlobalRequests[reqId].end(); ++it) {
-			if ((*it).component->getId() == component->getId()) (*it).trackMe = true;
-		}
-
-		// also pass to local for extra check (MESSAGE messages are always local AND global)
-		fObjects[component->getOwnerId()]->trackRequest(reqId, component);
-
-
-	}
-
-	// if local, forward to object
-	else {
-		fObjects[component->getOwnerId()]->trackRequest(reqId, component);
-	}
-}
\ No newline at end of file
+
+#include "ObjectManager.h"
+
+
+using namespace Cistron;
+
+
+#include <iostream>
+#include <algorithm>
+#include <boost/chrono.hpp>
+
+using std::cout;
+using std::endl;
+using boost::format;
+
+
+// names of the profiled structural operations
+static const Atom AddComponentAtom("addComponent");
+static const Atom DestroyComponentAtom("destroyComponent");
+static const Atom MoveComponentAtom("moveComponent");
+static const Atom DeferredDestructionAtom("deferredDestruction");
+static const Atom ProcessDestructionAtom("processDestruction");
+static const Atom TickAtom("tick");
+static const Atom RunSystemsAtom("runSystems");
+static const Atom ShutdownAtom("shutdown");
+static const Atom FlushBatchesAtom("flushBatches");
+static const Atom MergeAtom("merge");
+static const Atom CompactionAtom("compaction");
+
+
+// constructor/destructor
+ObjectManager::ObjectManager(unsigned inboxCapacity, InboxOverflow inboxOverflow) : fRequestIdCounter(0), fNLocks(0),
+	fIncrementalDestruction(false), fDestructionMaxComponents(0), fDestructionMaxSeconds(0), fDestroyingObject(false),
+	fCompaction(false), fCompactionMaxEntries(0), fCompactionMaxSeconds(0), fCompactionCursor(0), fIdCounter(0), fChangeSerial(1),
+	fSystemContext(this), fRunningSystems(false), fTicking(false), fResumeDepth(0), fInbox(-1, inboxCapacity, inboxOverflow),
+	fProfiler(0), fRecorder(0), fRecordDepth(0), fMirror(0), fReplicator(0) {
+
+	// because we start counting from 1 for request id's, we add an empty request lock in front
+	fRequestLocks.push_back(RequestLock());
+}
+ObjectManager::~ObjectManager() {
+
+	// delete all objects
+	shutdown(TEARDOWN_GRACEFUL);
+
+	// release the object inboxes, they are deleted when the other threads released them too
+	for (map<ObjectId, Inbox*>::iterator it = fObjectInboxes.begin(); it != fObjectInboxes.end(); ++it) {
+		it->second->close();
+		it->second->release();
+	}
+	for (unsigned i = 0; i < fClosedInboxes.size(); ++i) fClosedInboxes[i]->release();
+}
+
+
+// destroy everything
+void ObjectManager::shutdown(TeardownMode mode) {
+
+	// not while messages are being sent
+	if (fNLocks != 0 || fResumeDepth != 0) {
+		error(format("Failed to shut down: messages are being sent."));
+	}
+
+	// profile
+	ProfileScope profile(fProfiler, PROFILE_DESTRUCTION, ShutdownAtom);
+
+	// destroy every component, with its messages
+	if (mode == TEARDOWN_GRACEFUL) {
+		for (unsigned i = 0; i < fObjects.size(); ++i) {
+
+			// already destroyed earlier
+			if (fObjects[i] == 0) continue;
+
+			// destroy every component in the object
+			list<Component*> comps = fObjects[i]->getComponents();
+			for (list<Component*>::iterator it = comps.begin(); it != comps.end(); ++it) {
+				destroyComponentNow(*it);
+			}
+
+			// destroy the object itself
+			delete fObjects[i];
+			fObjects[i] = 0;
+		}
+	}
+
+	// only mark the components destroyed, and delete the objects and behaviors
+	else {
+		for (unsigned t = 0; t < fComponentsByType.size(); ++t) {
+			for (unsigned i = 0; i < fComponentsByType[t].size(); ++i) fComponentsByType[t][i]->setDestroyed();
+		}
+		for (hash_map<ComponentId, list<Behavior*> >::iterator it = fBehaviorsByComponentId.begin(); it != fBehaviorsByComponentId.end(); ++it) {
+			for (list<Behavior*>::iterator b = it->second.begin(); b != it->second.end(); ++b) delete *b;
+		}
+		for (unsigned i = 0; i < fObjects.size(); ++i) {
+			delete fObjects[i];
+			fObjects[i] = 0;
+		}
+	}
+	deleteDeadBehaviors();
+
+	// delete the state channels and the answers
+	for (unsigned i = 0; i < fStateChannels.size(); ++i) {
+		delete fStateChannels[i];
+	}
+	for (unsigned i = 0; i < fBatches.size(); ++i) {
+		delete fBatches[i];
+	}
+	for (unsigned i = 0; i < fQueries.size(); ++i) {
+		for (unsigned j = 0; j < fQueries[i].answers.size(); ++j) delete fQueries[i].answers[j];
+	}
+
+	// release the storage in bulk - object ids aren't reused, and request ids stay valid
+	vector<vector<Component*> >().swap(fComponentsByType);
+	vector<list<RegisteredComponent> >().swap(fGlobalRequests);
+	vector<list<RegisteredComponent> >().swap(fMoveRequests);
+	hash_map<ComponentId, list<ComponentRequest> >().swap(fRequestsByComponentId);
+	hash_map<ObjectId, list<pair<ComponentId, Atom> > >().swap(fRequiredComponents);
+	hash_map<string, ObjectId>().swap(fObjectNameToId);
+	for (unsigned i = 0; i < fRequestLocks.size(); ++i) fRequestLocks[i] = RequestLock();
+	list<ObjectId>().swap(fDeadObjects);
+	list<Component*>().swap(fDeadComponents);
+	list<pair<Component*, ObjectId> >().swap(fPendingMoves);
+	deque<Component*>().swap(fDyingComponents);
+	deque<ObjectId>().swap(fDyingObjects);
+	list<Component*>().swap(fDyingObjectComponents);
+	fDestroyingObject = false;
+	vector<Group>().swap(fGroups);
+	vector<Query>().swap(fQueries);
+	hash_map<ComponentId, vector<AtomId> >().swap(fQueriesByComponentId);
+	vector<StateChannel*>().swap(fStateChannels);
+	vector<RequestId>().swap(fPendingChannels);
+	vector<Batch*>().swap(fBatches);
+	vector<RequestId>().swap(fPendingBatches);
+	vector<vector<Component*> >().swap(fChangedComponents);
+	vector<AtomId>().swap(fChangedTypes);
+	vector<Component*>().swap(fDeferredChanges);
+	vector<Component*>().swap(fSystemChanges);
+	hash_map<ComponentId, list<Behavior*> >().swap(fBehaviorsByComponentId);
+	vector<Behavior*>().swap(fWaitingBehaviors);
+	vector<Component*>().swap(fLiveComponents);
+	fTimers.clear();
+	vector<TimerId>().swap(fExpiredTimers);
+}
+
+
+// generate a unique request id or return one if it already exists
+RequestId ObjectManager::getMessageRequestId(ComponentRequestType type, Atom name) {
+
+	// ALL_COMPONENTS is changed to COMPONENT, it's the same in regards to the request id
+	if (type == REQ_ALLCOMPONENTS) type = REQ_COMPONENT;
+
+	// make sure there's room for this atom
+	vector<RequestId>& ids = fRequestToId[type];
+	if (ids.size() <= name.getId()) ids.resize(name.getId()+1, 0);
+
+	// if it doesn't exist, create it
+	if (ids[name.getId()] == 0) {
+		ids[name.getId()] = ++fRequestIdCounter;
+		fIdToRequest[type].resize(fRequestIdCounter+1);
+		fIdToRequest[type][fRequestIdCounter] = name;
+		fRequestLocks.push_back(RequestLock());
+		return fRequestIdCounter;
+	}
+
+	// it exists, just return it
+	return ids[name.getId()];
+}
+
+
+// return existing request id
+RequestId ObjectManager::getExistingRequestId(ComponentRequestType type, Atom name) {
+
+	// if it doesn't exist we don't return it
+	if (fRequestToId[type].size() <= name.getId() || fRequestToId[type][name.getId()] == 0) {
+		return 0;
+	}
+
+	// if it does exist, but there are no global requests, we don't return it either, unless it's a state channel
+	RequestId id = fRequestToId[type][name.getId()];
+	if (fGlobalRequests.size() <= (unsigned)id && !isStateChannel(id)) return 0;
+
+	// we might have a global request - process it
+	return id;
+}
+
+
+
+// create a new object
+ObjectId ObjectManager::createObject() {
+
+	// create a new object
+	Object *obj = new Object(fIdCounter);
+	//cout << "Created object " << fIdCounter << endl;
+	++fIdCounter;
+
+	// add it to the list
+	fObjects.push_back(obj);
+
+	// record
+	if (isRecording()) fRecorder->recordCreateObject(fIdCounter-1);
+	return fIdCounter-1;
+}
+
+
+// activate lock
+void ObjectManager::activateLock(RequestId reqId) {
+
+	// if the lock is already activated, we have bounced against an infinite loop
+	if (fRequestLocks[reqId].locked) {
+		error(format("Do not request a message or component in a callback function for the same message/component request or a function called by this callback function"));
+	}
+
+	// one more lofk
+	++fNLocks;
+
+	// activate the lock
+	fRequestLocks[reqId].locked = true;
+}
+
+
+// release the lock, process the pending global and local requests
+void ObjectManager::releaseLock(RequestId reqId) {
+
+	// lock
+	RequestLock& lock = fRequestLocks[reqId];
+
+	// must be locked!
+	assert(lock.locked);
+
+	// release the lock
+	lock.locked = false;
+
+	// one lock less
+	--fNLocks;
+
+	// copy the pending requests
+	list<pair<ComponentRequest, RegisteredComponent> > pendingGlobal = lock.pendingGlobalRequests;
+	list<pair<ComponentRequest, RegisteredComponent> > pendingLocal = lock.pendingLocalRequests;
+	lock.pendingGlobalRequests = list<pair<ComponentRequest, RegisteredComponent> >();
+	lock.pendingLocalRequests = list<pair<ComponentRequest, RegisteredComponent> >();
+
+	// process the global requests
+	for (list<pair<ComponentRequest, RegisteredComponent> >::iterator it = pendingGlobal.begin(); it != pendingGlobal.end(); ++it) {
+		registerGlobalRequest(it->first, it->second);
+	}
+
+	// process the local requests
+	for (list<pair<ComponentRequest, RegisteredComponent> >::iterator it = pendingLocal.begin(); it != pendingLocal.end(); ++it) {
+		registerLocalRequest(it->first, it->second);
+	}
+
+	// if there are no more locks, move and destroy any pending components & objects
+	processPending();
+}
+
+
+// move, then destroy the pending components & objects
+void ObjectManager::processPending() {
+
+	// moves first, they were requested before the destruction of their target could happen
+	while (fNLocks == 0 && fPendingMoves.size() > 0) {
+		pair<Component*, ObjectId> move = fPendingMoves.front();
+		fPendingMoves.pop_front();
+		moveComponentNow(move.first, move.second);
+	}
+
+	if (fNLocks == 0 && (fDeadComponents.size() > 0 || fDeadObjects.size() > 0)) {
+		ProfileScope profile(fProfiler, PROFILE_DESTRUCTION, DeferredDestructionAtom);
+
+		// first components
+		list<Component*> deadComponents = fDeadComponents;
+		fDeadComponents.clear();
+		for (list<Component*>::iterator it = deadComponents.begin(); it != deadComponents.end(); ++it) {
+			destroyComponentNow(*it);
+		}
+
+		// then entire objects
+		list<ObjectId> deadObjects = fDeadObjects;
+		fDeadObjects.clear();
+		for (list<ObjectId>::iterator it = deadObjects.begin(); it != deadObjects.end(); ++it) {
+			destroyObjectNow(*it);
+		}
+	}
+}
+
+
+// add a new component to an object
+void ObjectManager::addComponent(ObjectId id, Component *component) {
+
+	// make sure the object exists
+	if (id < 0 || (unsigned)id >= fObjects.size() || fObjects[id] == 0 || fObjects[id]->fDying) {
+		error(format("Failed to add component %s to object %d: it does not exist!") % component->toString() % id);
+	}
+
+	// can only add once
+	if (component->fObjectManager != 0) {
+		error(format("Component is already part of an ObjectManager. You cannot add a component twice."));
+	}
+
+	// we get the appropriate object
+	Object *obj = fObjects[id];
+
+	// profile
+	ProfileScope profile(fProfiler, PROFILE_STRUCTURE, AddComponentAtom, component, id);
+
+	// record, everything the component does when it's added is a consequence
+	if (isRecording()) fRecorder->recordAddComponent(id, component);
+	RecordScope record(fRecordDepth);
+
+	// set the object manager
+	component->fObjectManager = this;
+
+	// set the owner of the component
+	component->setOwner(id);
+
+	// we add the component
+	if (!obj->addComponent(component)) {
+		error(boost::format("Failed to add component %s to object %d") % component->toString() % id);
+	}
+
+	// and to the components of its type
+	AtomId type = component->getNameAtom().getId();
+	if (fComponentsByType.size() <= type) fComponentsByType.resize(type+1);
+	component->fTypeIndex = fComponentsByType[type].size();
+	fComponentsByType[type].push_back(component);
+	if (fReplicator != 0) fReplicator->componentAdded(component);
+
+	// put in log
+	//if (fStream.is_open()) fStream << "CREATE  " << *component << endl;
+
+	// let the component know
+	component->addedToObject();
+
+	// get request id for this component
+	RequestId reqId = getExistingRequestId(REQ_COMPONENT, component->getNameAtom());
+
+	// if there's no such request yet, we skip
+	if (reqId == 0) return;
+
+	// CREATE event
+	Message msg(CREATE);
+	msg.sender = component;
+
+	// lock this request id
+	activateLock(reqId);
+
+	// look for requests and forward them
+	for (list<RegisteredComponent>::iterator it = fGlobalRequests[reqId].begin(); it != fGlobalRequests[reqId].end(); ++it) {
+		if (it->component->getId() != component->getId() && !it->component->isDying()) {
+			if ((*it).trackMe) cout << it->component << " received component " << *component << " of type " << fIdToRequest[REQ_COMPONENT][reqId] << endl; 
+			ProfileScope profileCallback(fProfiler, component, it->component);
+			(*it).callback(msg);
+		}
+	}
+
+	// resume the behaviors waiting for this component
+	resumeBehaviors(0, id, reqId, CREATE, msg);
+
+	// forward to the object itself, so local requests are processed also
+	obj->sendMessage(reqId, msg, fProfiler);
+	resumeBehaviors(1, id, reqId, CREATE, msg);
+
+	// release the lock
+	releaseLock(reqId);
+}
+
+
+// register a local request
+// only COMPONENT requests can be local!!
+void ObjectManager::registerLocalRequest(ComponentRequest req, RegisteredComponent reg) {
+
+	// we generate the request id (might be new)
+	RequestId reqId = getMessageRequestId(req.type, req.name);
+
+	// if this request is locked, postpone the processing
+	if (fRequestLocks[reqId].locked) {
+		fRequestLocks[reqId].pendingLocalRequests.push_back(pair<ComponentRequest, RegisteredComponent>(req, reg));
+		return;
+	}
+
+	// forward to appropriate object
+	ObjectId objId = reg.component->getOwnerId();
+	fObjects[objId]->registerRequest(reqId, reg);
+
+	// if the request is required and the object isn't finalized yet, it's checked when it is
+	if (reg.required && !fObjects[objId]->isFinalized()) {
+		fRequiredComponents[objId].push_back(pair<ComponentId, Atom>(reg.component->getId(), req.name));
+	}
+
+	// put in log
+	//if (fStream.is_open()) fStream << "DESTROY " << *comp << endl;
+
+//cout << "Registered local request of " << (*reg.component) << " for " << req.name << endl;
+	// if we want the previously created components as well, we process them
+	if (req.type != REQ_COMPONENT) return;
+	
+	// lock this request id
+	activateLock(reqId);
+
+	// now look for existing components of this type
+	Message msg(CREATE);
+
+	// get component and forward it
+	list<Component*> comps = fObjects[reg.component->getOwnerId()]->getComponents(req.name);
+	for (list<Component*>::iterator it = comps.begin(); it != comps.end(); ++it) {
+		if ((*it)->isValid() && reg.component->getId() != (*it)->getId()) {
+			msg.sender = (*it);
+			if (reg.trackMe) cout << *reg.component << " received component " << (*msg.sender) << " of type " << req.name << endl;
+			//cout << "Warning component " << (*reg.component) << " for the local existence of component " << (*msg.sender) << endl;
+			reg.callback(msg);
+		}
+	}
+
+	// release the lock
+	releaseLock(reqId);
+}
+
+
+// register a global request
+void ObjectManager::registerGlobalRequest(ComponentRequest req, RegisteredComponent reg) {
+	assert(reg.component->isValid());
+
+	// first we request the id and create it if it doesn't exist
+	RequestId reqId = getMessageRequestId(req.type, req.name);
+
+	// we only really register component and message requests
+	if (req.type != REQ_ALLCOMPONENTS) {
+
+		// if this request is locked, postpone the processing
+		if (fRequestLocks[reqId].locked) {
+			fRequestLocks[reqId].pendingGlobalRequests.push_back(pair<ComponentRequest, RegisteredComponent>(req, reg));
+			return;
+		}
+
+		// if the request list isn't large enough, we resize it
+		if (fGlobalRequests.size() <= reqId) {
+			fGlobalRequests.resize(reqId+1);
+		}
+
+		// we add the request
+		fGlobalRequests[reqId].push_back(reg);
+	//cout << "Registered global request of " << (*reg.component) << " for " << req.name << endl;
+		// we also add it locally if it is a message
+		if (req.type == REQ_MESSAGE) {
+			fObjects[reg.component->getOwnerId()]->registerRequest(reqId, reg);
+		}
+
+		// we add it to the associative map (used at destruction of the component to look up all its requests)
+		fRequestsByComponentId[reg.component->getId()].push_back(req);
+
+		// if the request is required and the object isn't finalized yet, we add it to a special list
+		ObjectId objId = reg.component->getOwnerId();
+		if (reg.required && !fObjects[objId]->isFinalized()) {
+			fRequiredComponents[objId].push_back(pair<ComponentId, Atom>(reg.component->getId(), req.name));
+		}
+	}
+
+	// messages don't have previously created components, but state channels have their last values
+	if (req.type == REQ_MESSAGE) {
+		if (isStateChannel(reqId)) replayStateChannel(reqId, reg);
+		return;
+	}
+	
+	// activate the lock on this id
+	activateLock(reqId);
+
+	// now look for existing components of this type
+	Message msg(CREATE);
+	for (unsigned i = 0; i < fObjects.size(); ++i) {
+
+		// only process objects that still exist
+		if (fObjects[i] == 0 || fObjects[i]->fDying) continue;
+
+		// get component and forward it
+		list<Component*> comps = fObjects[i]->getComponents(req.name);
+		for (list<Component*>::iterator it = comps.begin(); it != comps.end(); ++it) {
+			if ((*it)->isValid() && reg.component->getId() != (*it)->getId()) {
+				msg.sender = (*it);
+				if (reg.trackMe) cout << (*reg.component) << " received component " << (**it) << " of type " << req.name << endl; 
+				//cout << "Warning component " << (*reg.component) << " for the global existence of component " << (*msg.sender) << endl;
+				reg.callback(msg);
+			}
+		}
+	}
+
+	// release the lock
+	releaseLock(reqId);
+}
+
+
+// register a request for the moves of a component type
+void ObjectManager::registerMoveRequest(Atom name, RegisteredComponent reg) {
+	assert(reg.component->isValid());
+
+	// the request id of the component type, with room in the global requests so it can be looked up
+	RequestId reqId = getMessageRequestId(REQ_COMPONENT, name);
+	if (fGlobalRequests.size() <= (unsigned)reqId) fGlobalRequests.resize(reqId+1);
+	if (fMoveRequests.size() <= (unsigned)reqId) fMoveRequests.resize(reqId+1);
+
+	// add it, and remember it for the destruction of the component
+	fMoveRequests[reqId].push_back(reg);
+	fRequestsByComponentId[reg.component->getId()].push_back(ComponentRequest(REQ_COMPONENT, name));
+}
+
+
+// send a message to everyone
+void ObjectManager::sendGlobalMessage(RequestId reqId, Message const & msg) {
+
+	// must be valid component
+	assert(msg.sender->isValid());
+
+	// state channels keep the last value of the sender, and deliver it at the end of the tick
+	if (isStateChannel(reqId)) {
+		if (isRecording()) fRecorder->recordSendGlobal(fIdToRequest[REQ_MESSAGE][reqId], msg.sender, msg.p);
+		StateChannel *channel = fStateChannels[reqId];
+		StateValue& value = channel->values[msg.sender->getId()];
+		value.sender = msg.sender;
+		value.payload = msg.p;
+		if (!value.pending) {
+			if (channel->pending.size() == 0) fPendingChannels.push_back(reqId);
+			channel->pending.push_back(msg.sender->getId());
+			value.pending = true;
+		}
+		return;
+	}
+
+	// nobody ever requested this message globally
+	if (fGlobalRequests.size() <= (unsigned)reqId) return;
+
+	// record
+	if (isRecording()) fRecorder->recordSendGlobal(fIdToRequest[REQ_MESSAGE][reqId], msg.sender, msg.p);
+	RecordScope record(fRecordDepth);
+
+	// send it
+	dispatchGlobalMessage(reqId, msg);
+}
+void ObjectManager::dispatchGlobalMessage(RequestId reqId, Message const & msg) {
+
+	// nobody ever requested this message globally
+	if (fGlobalRequests.size() <= (unsigned)reqId) return;
+
+	// profile
+	ProfileScope profile(fProfiler, PROFILE_MESSAGE, fProfiler != 0 ? fIdToRequest[REQ_MESSAGE][reqId] : Atom(), msg.sender);
+
+	// keep it for the batch handlers
+	if (isBatched(reqId)) {
+		Batch *batch = fBatches[reqId];
+		if (batch->pending.size() == 0) fPendingBatches.push_back(reqId);
+		batch->pending.push_back(msg);
+	}
+
+	// activate the lock
+	activateLock(reqId);
+
+	// look for requests and forward them
+	for (list<RegisteredComponent>::iterator it = fGlobalRequests[reqId].begin(); it != fGlobalRequests[reqId].end(); ++it) {
+		if (it->component->isDying()) continue;
+		if ((*it).trackMe) cout << it->component << " received message " << fIdToRequest[REQ_MESSAGE][reqId] << " from " << *msg.sender << endl; 
+		ProfileScope profileCallback(fProfiler, msg.sender, it->component);
+		(*it).callback(msg);
+	}
+
+	// resume the behaviors waiting for this message
+	resumeBehaviors(0, -1, reqId, MESSAGE, msg);
+
+	// release the lock
+	releaseLock(reqId);
+}
+
+
+// send a message to an object
+void ObjectManager::sendMessageToObject(RequestId reqId, Message const & msg, ObjectId id) {
+
+	// profile
+	ProfileScope profile(fProfiler, PROFILE_MESSAGE, fProfiler != 0 ? fIdToRequest[REQ_MESSAGE][reqId] : Atom(), msg.sender, id);
+
+	// record
+	if (isRecording()) fRecorder->recordSendObject(fIdToRequest[REQ_MESSAGE][reqId], msg.sender, id, msg.p);
+	RecordScope record(fRecordDepth);
+
+	// forward to the object
+	fObjects[id]->sendMessage(reqId, msg, fProfiler);
+
+	// resume the behaviors in this object waiting for this message
+	resumeBehaviors(1, id, reqId, MESSAGE, msg);
+}
+
+
+// make a global message a state channel
+void ObjectManager::registerStateChannel(Atom msg) {
+	RequestId reqId = getMessageRequestId(REQ_MESSAGE, msg);
+	if (fStateChannels.size() <= (unsigned)reqId) fStateChannels.resize(reqId+1, 0);
+	if (fStateChannels[reqId] == 0) fStateChannels[reqId] = new StateChannel();
+}
+
+
+// deliver the pending values of the state channels
+void ObjectManager::flushStateChannels() {
+
+	// record
+	if (isRecording() && fPendingChannels.size() > 0) fRecorder->recordFlushChannels();
+	RecordScope record(fRecordDepth);
+
+	// values sent by the callbacks are delivered the next time
+	vector<RequestId> channels;
+	channels.swap(fPendingChannels);
+	for (unsigned c = 0; c < channels.size(); ++c) {
+		StateChannel *channel = fStateChannels[channels[c]];
+		vector<ComponentId> pending;
+		pending.swap(channel->pending);
+
+		// deliver the last value of every sender
+		for (unsigned i = 0; i < pending.size(); ++i) {
+			map<ComponentId, StateValue>::iterator it = channel->values.find(pending[i]);
+			if (it == channel->values.end()) continue;
+
+			// the sender died, forget its value
+			if (!it->second.sender->isValid() || it->second.sender->isDying()) {
+				channel->values.erase(it);
+				continue;
+			}
+
+			// copy the message, a callback may send a new value
+			it->second.pending = false;
+			Message msg(MESSAGE, it->second.sender, it->second.payload);
+			dispatchGlobalMessage(channels[c], msg);
+		}
+	}
+}
+
+
+// send the cached values of a state channel to a new requester
+void ObjectManager::replayStateChannel(RequestId reqId, RegisteredComponent& reg) {
+
+	// copy the values, the callback may send new ones
+	vector<Message> values;
+	StateChannel *channel = fStateChannels[reqId];
+	for (map<ComponentId, StateValue>::iterator it = channel->values.begin(); it != channel->values.end(); ) {
+		if (!it->second.sender->isValid() || it->second.sender->isDying()) {
+			channel->values.erase(it++);
+			continue;
+		}
+		if (it->second.sender != reg.component) values.push_back(Message(MESSAGE, it->second.sender, it->second.payload));
+		++it;
+	}
+
+	// send them to the new requester only
+	activateLock(reqId);
+	for (unsigned i = 0; i < values.size(); ++i) {
+		if (reg.component->isDying() || !reg.component->isValid()) break;
+		reg.callback(values[i]);
+	}
+	releaseLock(reqId);
+}
+
+
+// get the batch of a message
+ObjectManager::Batch* ObjectManager::getBatch(Atom msg) {
+
+	// the request id, with room in the global requests so messages are dispatched even without ordinary requests
+	RequestId reqId = getMessageRequestId(REQ_MESSAGE, msg);
+	if (fGlobalRequests.size() <= (unsigned)reqId) fGlobalRequests.resize(reqId+1);
+	if (fBatches.size() <= (unsigned)reqId) fBatches.resize(reqId+1, 0);
+	if (fBatches[reqId] == 0) fBatches[reqId] = new Batch();
+	return fBatches[reqId];
+}
+
+
+// register a component batch handler
+void ObjectManager::registerMessageBatch(Atom msg, Component *component, MessageBatchFunction f) {
+	assert(component->isValid());
+	getBatch(msg)->components.push_back(pair<Component*, MessageBatchFunction>(component, f));
+
+	// remember it for the destruction of the component
+	fRequestsByComponentId[component->getId()].push_back(ComponentRequest(REQ_MESSAGE, msg));
+}
+
+
+// register a type batch handler
+void ObjectManager::registerTypeBatch(Atom msg, Atom type, ReceiverBatchFunction f) {
+	getBatch(msg)->types.push_back(pair<AtomId, ReceiverBatchFunction>(type.getId(), f));
+}
+
+
+// deliver the pending batches
+void ObjectManager::flushBatches() {
+
+	// record
+	if (isRecording() && fPendingBatches.size() > 0) fRecorder->recordFlushBatches();
+	RecordScope record(fRecordDepth);
+
+	// profile
+	ProfileScope profile(fProfiler, PROFILE_MESSAGE, FlushBatchesAtom);
+
+	// messages sent by the handlers are delivered the next time
+	vector<RequestId> batches;
+	batches.swap(fPendingBatches);
+	for (unsigned b = 0; b < batches.size(); ++b) {
+		Batch *batch = fBatches[batches[b]];
+		vector<Message> messages;
+		messages.swap(batch->pending);
+
+		// forget the messages of senders that died since, like the values of state channels
+		unsigned n = 0;
+		for (unsigned i = 0; i < messages.size(); ++i) {
+			if (messages[i].sender->isValid() && !messages[i].sender->isDying()) messages[n++] = messages[i];
+		}
+		messages.erase(messages.begin() + n, messages.end());
+		if (messages.size() == 0) continue;
+
+		// structural changes in the handlers are postponed until the batch is delivered
+		++fNLocks;
+
+		// every message to the components at once
+		for (list<pair<Component*, MessageBatchFunction> >::iterator it = batch->components.begin(); it != batch->components.end(); ++it) {
+			if (it->first->isDying()) continue;
+			ProfileScope profileCallback(fProfiler, (Component*)0, it->first);
+			it->second(messages);
+		}
+
+		// every living component of a type at once, for every message
+		for (list<pair<AtomId, ReceiverBatchFunction> >::iterator it = batch->types.begin(); it != batch->types.end(); ++it) {
+			vector<Component*> receivers;
+			if (fComponentsByType.size() > it->first) {
+				vector<Component*> const & comps = fComponentsByType[it->first];
+				receivers.reserve(comps.size());
+				for (unsigned i = 0; i < comps.size(); ++i) {
+					if (!comps[i]->isDying()) receivers.push_back(comps[i]);
+				}
+			}
+			if (receivers.size() == 0) continue;
+			for (unsigned i = 0; i < messages.size(); ++i) it->second(receivers, messages[i]);
+		}
+
+		--fNLocks;
+		processPending();
+	}
+}
+
+
+// send a message to every object in a group
+void ObjectManager::sendMessageToGroup(Atom group, RequestId reqId, Message const & msg) {
+
+	// must be valid component
+	assert(msg.sender->isValid());
+
+	// no such group
+	if (fGroups.size() <= group.getId()) return;
+
+	// profile
+	ProfileScope profile(fProfiler, PROFILE_MESSAGE, fProfiler != 0 ? fIdToRequest[REQ_MESSAGE][reqId] : Atom(), msg.sender);
+
+	// record
+	if (isRecording()) fRecorder->recordSendGroup(group, fIdToRequest[REQ_MESSAGE][reqId], msg.sender, msg.p);
+	RecordScope record(fRecordDepth);
+
+	// lock the request, so objects destroyed by the callbacks are destroyed afterwards, and lock the group,
+	// so members leaving don't move the others - objects joining now don't get the message
+	activateLock(reqId);
+	Group& g = fGroups[group.getId()];
+	++g.locks;
+
+	// forward to every member
+	unsigned size = g.members.size();
+	for (unsigned i = 0; i < size; ++i) {
+		ObjectId id = fGroups[group.getId()].members[i];
+		if (id < 0 || fObjects[id] == 0) continue;
+		fObjects[id]->sendMessage(reqId, msg, fProfiler);
+		resumeBehaviors(1, id, reqId, MESSAGE, msg);
+	}
+
+	// unlock
+	Group& unlocked = fGroups[group.getId()];
+	if (--unlocked.locks == 0 && unlocked.dirty) compactGroup(group.getId());
+	releaseLock(reqId);
+}
+
+
+/**
+ * QUERIES
+ */
+
+// returned for objects that don't answer a query
+static const vector<QueryAnswer*> NoAnswers;
+
+
+// register an answer to a query
+void ObjectManager::registerQuery(Atom query, QueryAnswer *answer, std::type_info const & type) {
+	Component *comp = answer->component;
+
+	// must be valid component
+	if (!comp->isValid() || comp->isDestroyed()) {
+		delete answer;
+		error(format("Failed to register an answer of %s to query %s: the component is not valid.") % comp->toString() % query.str());
+	}
+
+	// the first answer decides the type of the query
+	if (fQueries.size() <= query.getId()) fQueries.resize(query.getId()+1);
+	Query& q = fQueries[query.getId()];
+	if (q.type == 0) q.type = &type;
+	else if (*q.type != type) {
+		delete answer;
+		error(format("Failed to register an answer of %s to query %s: the query is answered with another type.") % comp->toString() % query.str());
+	}
+
+	// add it to the answers of the query, and to those of the object
+	answer->index = q.answers.size();
+	q.answers.push_back(answer);
+	vector<vector<QueryAnswer*> >& local = fObjects[comp->getOwnerId()]->fQueryAnswers;
+	if (local.size() <= query.getId()) local.resize(query.getId()+1);
+	local[query.getId()].push_back(answer);
+	fQueriesByComponentId[comp->getId()].push_back(query.getId());
+}
+
+
+// does any component answer a query?
+bool ObjectManager::isAnswered(Atom query, std::type_info const & type) {
+	if (fQueries.size() <= query.getId() || fQueries[query.getId()].answers.size() == 0) return false;
+	if (*fQueries[query.getId()].type != type) {
+		error(format("Failed to ask query %s: the query is answered with another type.") % query.str());
+	}
+	return true;
+}
+
+
+// get the answers to a query
+vector<QueryAnswer*> const & ObjectManager::getAnswers(ObjectId id, AtomId query) {
+	if (id < 0) return fQueries[query].answers;
+	if ((unsigned)id >= fObjects.size() || fObjects[id] == 0 || fObjects[id]->fDying) return NoAnswers;
+	vector<vector<QueryAnswer*> > const & local = fObjects[id]->fQueryAnswers;
+	if (local.size() <= query) return NoAnswers;
+	return local[query];
+}
+
+
+// remove the answers of a component, moving the last answers in their place
+void ObjectManager::removeAnswers(Component *comp) {
+	hash_map<ComponentId, vector<AtomId> >::iterator queries = fQueriesByComponentId.find(comp->getId());
+	if (queries == fQueriesByComponentId.end()) return;
+	vector<vector<QueryAnswer*> >& local = fObjects[comp->getOwnerId()]->fQueryAnswers;
+	for (unsigned i = 0; i < queries->second.size(); ++i) {
+		vector<QueryAnswer*>& answers = fQueries[queries->second[i]].answers;
+		vector<QueryAnswer*>& localAnswers = local[queries->second[i]];
+		for (unsigned a = 0; a < localAnswers.size(); ) {
+			QueryAnswer *answer = localAnswers[a];
+			if (answer->component != comp) {
+				++a;
+				continue;
+			}
+			answers[answer->index] = answers.back();
+			answers[answer->index]->index = answer->index;
+			answers.pop_back();
+			localAnswers[a] = localAnswers.back();
+			localAnswers.pop_back();
+			delete answer;
+		}
+	}
+	fQueriesByComponentId.erase(queries);
+}
+
+
+// schedule a message
+TimerId ObjectManager::scheduleMessage(RequestId reqId, Component *component, ObjectId target, boost::any payload, Time delay, Time period) {
+
+	// must be valid component
+	assert(component->isValid());
+
+	// target must exist, if any
+	if (target >= 0 && ((unsigned)target >= fObjects.size() || fObjects[target] == 0)) {
+		error(format("Failed to schedule message for object %d: it does not exist!") % target);
+	}
+
+	// put it in the wheel
+	return fTimers.schedule(ScheduledMessage(reqId, component, target, payload, period), delay);
+}
+
+
+// cancel a scheduled message
+bool ObjectManager::cancelMessage(TimerId id) {
+	return fTimers.cancel(id);
+}
+
+
+// advance the time
+void ObjectManager::tick(Time dt) {
+
+	// can't tick from within a scheduled message
+	if (fTicking) {
+		error(format("Do not call tick from a callback function of a scheduled message"));
+	}
+	fTicking = true;
+
+	// profile
+	ProfileScope profile(fProfiler, PROFILE_TICK, TickAtom);
+
+	// execute everything other threads posted - the commands are recorded before the tick
+	processInbox();
+
+	// record, the scheduled messages are consequences of the tick
+	if (isRecording()) fRecorder->recordTick(dt);
+	RecordScope record(fRecordDepth);
+
+	// spend the destruction budget
+	if (fIncrementalDestruction || getPendingDestructions() > 0) processDestruction();
+
+	// process one time unit at a time, so messages sent by scheduled messages can expire in the same tick
+	for (Time t = 0; t < dt; ++t) {
+
+		// nothing scheduled, skip the rest
+		if (fTimers.size() == 0) {
+			fTimers.skip(dt - t);
+			break;
+		}
+
+		// collect the batch of expired messages
+		fExpiredTimers.clear();
+		fTimers.step(fExpiredTimers);
+
+		// send them
+		for (unsigned i = 0; i < fExpiredTimers.size(); ++i) {
+
+			// might have been cancelled by a message earlier in this batch
+			ScheduledMessage *scheduled = fTimers.get(fExpiredTimers[i]);
+			if (scheduled == 0) continue;
+
+			// sender or target no longer exists or is being destroyed, the timer dies with it
+			bool targetDying = scheduled->target >= 0 && (fObjects[scheduled->target] == 0 || fObjects[scheduled->target]->fDying);
+			if (scheduled->sender->isDestroyed() || scheduled->sender->isDying() || targetDying) {
+				fTimers.cancel(fExpiredTimers[i]);
+				continue;
+			}
+
+			// reschedule or release it before sending, the callbacks may cancel it
+			ScheduledMessage msg = *scheduled;
+			fTimers.expire(fExpiredTimers[i]);
+
+			// send the message
+			if (msg.target < 0) sendGlobalMessage(msg.reqId, Message(MESSAGE, msg.sender, msg.payload));
+			else sendMessageToObject(msg.reqId, Message(MESSAGE, msg.sender, msg.payload), msg.target);
+		}
+	}
+
+	// run the systems
+	runSystems(dt);
+
+	// deliver the state channels, and the batches
+	flushStateChannels();
+	flushBatches();
+
+	// done
+	fTicking = false;
+
+	// publish the state at the end of the tick
+	if (fMirror != 0) publishMirror();
+	if (fReplicator != 0) replicate();
+
+	// the next tick starts without changes, except those made by systems in this tick
+	clearChanged();
+	vector<Component*> systemChanges;
+	systemChanges.swap(fSystemChanges);
+	for (unsigned i = 0; i < systemChanges.size(); ++i) {
+		if (!systemChanges[i]->isDestroyed()) markChanged(systemChanges[i]);
+	}
+
+	// spend the compaction budget
+	if (fCompaction) processCompaction();
+}
+
+
+// add/remove a system
+void ObjectManager::addSystem(System *system) {
+	fSystems.add(system);
+}
+bool ObjectManager::removeSystem(System *system) {
+	return fSystems.remove(system);
+}
+
+
+// run the systems
+void ObjectManager::runSystems(Time dt) {
+	if (fSystems.size() == 0) return;
+
+	// profile
+	ProfileScope profile(fProfiler, PROFILE_TICK, RunSystemsAtom);
+
+	// collect the components of the declared types, and make sure the changed sets exist, they can't grow while systems run
+	vector<Atom> types = fSystems.getTypes();
+	fSystemContext.fComponents.clear();
+	for (unsigned i = 0; i < types.size(); ++i) {
+		getLiveComponents(vector<Atom>(1, types[i]), fSystemContext.fComponents[types[i].getId()]);
+		getChangedComponents(types[i]);
+	}
+	fSystemContext.fTime = getTime();
+	fSystemContext.fDelta = dt;
+
+	// run them
+	fRunningSystems = true;
+	fSystems.run(fSystemContext);
+	fRunningSystems = false;
+
+	// sync point: the changes, the command buffers of the systems in the order they were added, and the posted commands
+	vector<Component*> changes;
+	changes.swap(fDeferredChanges);
+	for (unsigned i = 0; i < changes.size(); ++i) markChanged(changes[i]);
+	fSystemChanges.insert(fSystemChanges.end(), changes.begin(), changes.end());
+	for (unsigned i = 0; i < fSystems.size(); ++i) executeCommands(fSystems.get(i)->getCommands());
+	processInbox();
+}
+
+
+// add a component to the changed set of its type
+void ObjectManager::markChanged(Component *comp) {
+
+	// systems are running, the changed sets are being read
+	if (fRunningSystems) {
+		boost::mutex::scoped_lock lock(fDeferredChangesMutex);
+		fDeferredChanges.push_back(comp);
+		return;
+	}
+
+	// already in it
+	if (comp->fChangeSerial == fChangeSerial) return;
+	comp->fChangeSerial = fChangeSerial;
+
+	// add it
+	AtomId type = comp->getNameAtom().getId();
+	if (fChangedComponents.size() <= type) fChangedComponents.resize(type+1);
+	if (fChangedComponents[type].size() == 0) fChangedTypes.push_back(type);
+	fChangedComponents[type].push_back(comp);
+}
+
+
+// get the changed components of a type
+vector<Component*> const & ObjectManager::getChangedComponents(Atom type) {
+	if (fChangedComponents.size() <= type.getId()) fChangedComponents.resize(type.getId()+1);
+	return fChangedComponents[type.getId()];
+}
+
+
+// forget the changes
+void ObjectManager::clearChanged() {
+	for (unsigned i = 0; i < fChangedTypes.size(); ++i) {
+		fChangedComponents[fChangedTypes[i]].clear();
+	}
+	fChangedTypes.clear();
+	++fChangeSerial;
+}
+
+
+// publish a snapshot in the mirror
+void ObjectManager::publishMirror() {
+	if (fMirror == 0) return;
+
+	// every living component of the published types
+	getLiveComponents(fMirror->getTypes(), fLiveComponents);
+	fMirror->beginSnapshot(getTime());
+	for (unsigned i = 0; i < fLiveComponents.size(); ++i) fMirror->writeComponent(fLiveComponents[i]);
+	fMirror->endSnapshot();
+}
+
+
+// send a replication frame
+void ObjectManager::replicate() {
+	if (fReplicator == 0) return;
+
+	// the first frame has every living component of the replicated types
+	fReplicator->beginFrame(getTime());
+	if (fReplicator->isFirstFrame()) {
+		getLiveComponents(fReplicator->getTypes(), fLiveComponents);
+		for (unsigned i = 0; i < fLiveComponents.size(); ++i) fReplicator->writeComponent(fLiveComponents[i]);
+	}
+
+	// then the structural changes, and the components marked changed in this tick
+	fReplicator->writePending();
+	vector<Atom> const & types = fReplicator->getTypes();
+	for (unsigned t = 0; t < types.size(); ++t) {
+		vector<Component*> const & changed = getChangedComponents(types[t]);
+		for (unsigned i = 0; i < changed.size(); ++i) {
+			if (!changed[i]->isDestroyed() && !changed[i]->isDying()) fReplicator->writeComponent(changed[i]);
+		}
+	}
+	fReplicator->endFrame();
+}
+
+
+// get every living component of the given types
+void ObjectManager::getLiveComponents(vector<Atom> const & types, vector<Component*>& comps) {
+	comps.clear();
+	for (unsigned t = 0; t < types.size(); ++t) {
+		vector<Component*> const & ofType = getComponentsOfType(types[t]);
+		for (unsigned i = 0; i < ofType.size(); ++i) {
+			if (!ofType[i]->isDying()) comps.push_back(ofType[i]);
+		}
+	}
+}
+
+
+// start a behavior
+void ObjectManager::startBehavior(Component *component, Behavior *b) {
+
+	// must be valid component
+	assert(component->isValid());
+
+	// the component owns the behavior
+	b->fComponent = component;
+	fBehaviorsByComponentId[component->getId()].push_back(b);
+
+	// run until the first wait
+	resumeBehavior(b, Message(MESSAGE, component));
+}
+
+
+// suspend a behavior until an event happens
+void ObjectManager::awaitBehavior(Behavior *b, Awaitable const & a) {
+
+	// stop waiting for anything else
+	unlinkBehavior(b);
+
+	// get the request id
+	RequestId reqId = getMessageRequestId(a.type, a.name);
+
+	// make sure the request is known globally, so component creation is reported
+	if (fGlobalRequests.size() <= (unsigned)reqId) {
+		fGlobalRequests.resize(reqId+1);
+	}
+
+	// wait for it
+	b->fWaitReqId = reqId;
+	b->fWaitType = a.type == REQ_MESSAGE ? MESSAGE : CREATE;
+	++b->fWaitSerial;
+
+	// messages are received both globally and locally, components either globally or locally
+	if (a.type == REQ_MESSAGE || !a.local) linkBehavior(b, 0);
+	if (a.type == REQ_MESSAGE || a.local) linkBehavior(b, 1);
+}
+
+
+// get a wait list
+Behavior*& ObjectManager::getWaitingBehaviors(Behavior *b, int scope) {
+	vector<Behavior*>& heads = scope == 0 ? fWaitingBehaviors : fObjects[b->fComponent->getOwnerId()]->fWaitingBehaviors;
+	if (heads.size() <= (unsigned)b->fWaitReqId) heads.resize(b->fWaitReqId+1, 0);
+	return heads[b->fWaitReqId];
+}
+
+
+// add a behavior to a wait list
+void ObjectManager::linkBehavior(Behavior *b, int scope) {
+	Behavior*& head = getWaitingBehaviors(b, scope);
+	b->fPrev[scope] = 0;
+	b->fNext[scope] = head;
+	if (head != 0) head->fPrev[scope] = b;
+	head = b;
+	b->fLinked[scope] = true;
+}
+
+
+// remove a behavior from the wait lists
+void ObjectManager::unlinkBehavior(Behavior *b) {
+	for (int scope = 0; scope < 2; ++scope) {
+		if (!b->fLinked[scope]) continue;
+		if (b->fPrev[scope] != 0) b->fPrev[scope]->fNext[scope] = b->fNext[scope];
+		else getWaitingBehaviors(b, scope) = b->fNext[scope];
+		if (b->fNext[scope] != 0) b->fNext[scope]->fPrev[scope] = b->fPrev[scope];
+		b->fPrev[scope] = b->fNext[scope] = 0;
+		b->fLinked[scope] = false;
+	}
+	b->fWaitReqId = 0;
+}
+
+
+// resume a behavior
+void ObjectManager::resumeBehavior(Behavior *b, Message const & msg) {
+
+	// behaviors can't be deleted while we're in here
+	++fResumeDepth;
+	b->resume(msg);
+
+	// done, or not waiting for anything anymore
+	if (!b->fDead && (b->is_complete() || b->fWaitReqId == 0)) killBehavior(b);
+	--fResumeDepth;
+
+	// clean up
+	deleteDeadBehaviors();
+}
+
+
+// resume the waiting behaviors
+void ObjectManager::resumeBehaviors(int scope, ObjectId objId, RequestId reqId, MessageType type, Message const & msg) {
+
+	// anyone waiting?
+	vector<Behavior*>& heads = scope == 0 ? fWaitingBehaviors : fObjects[objId]->fWaitingBehaviors;
+	if (heads.size() <= (unsigned)reqId || heads[reqId] == 0) return;
+
+	// take a snapshot of the wait list, resumed behaviors may wait for the same event again
+	vector<pair<Behavior*, unsigned> > waiting;
+	for (Behavior *b = heads[reqId]; b != 0; b = b->fNext[scope]) {
+		if (b->fWaitType == type && b->fComponent != msg.sender) waiting.push_back(pair<Behavior*, unsigned>(b, b->fWaitSerial));
+	}
+
+	// resume everyone still waiting for this event
+	++fResumeDepth;
+	for (unsigned i = 0; i < waiting.size(); ++i) {
+		Behavior *b = waiting[i].first;
+		if (b->fDead || b->fWaitReqId != reqId || b->fWaitSerial != waiting[i].second || b->fComponent->isDying()) continue;
+		unlinkBehavior(b);
+		resumeBehavior(b, msg);
+	}
+	--fResumeDepth;
+
+	// clean up
+	deleteDeadBehaviors();
+}
+
+
+// stop a behavior
+void ObjectManager::killBehavior(Behavior *b) {
+
+	// already dead
+	if (b->fDead) return;
+
+	// remove it from the wait lists and from its component
+	unlinkBehavior(b);
+	b->fDead = true;
+	hash_map<ComponentId, list<Behavior*> >::iterator it = fBehaviorsByComponentId.find(b->fComponent->getId());
+	if (it != fBehaviorsByComponentId.end()) it->second.remove(b);
+
+	// delete it, or postpone until the behaviors being resumed returned
+	fDeadBehaviors.push_back(b);
+	deleteDeadBehaviors();
+}
+
+
+// delete the dead behaviors
+void ObjectManager::deleteDeadBehaviors() {
+	if (fResumeDepth != 0) return;
+	while (fDeadBehaviors.size() > 0) {
+		delete fDeadBehaviors.front();
+		fDeadBehaviors.pop_front();
+	}
+}
+
+
+// get the inbox of an object
+Inbox* ObjectManager::getObjectInbox(ObjectId id, unsigned capacity, InboxOverflow overflow) {
+
+	// object doesn't exist
+	if (id < 0 || (unsigned)id >= fObjects.size() || fObjects[id] == 0) {
+		error(format("Failed to create inbox for object %d: it does not exist!") % id);
+	}
+
+	// create it if it doesn't exist yet
+	map<ObjectId, Inbox*>::iterator it = fObjectInboxes.find(id);
+	if (it != fObjectInboxes.end()) {
+		it->second->fReferences.fetch_add(1, boost::memory_order_relaxed);
+		return it->second;
+	}
+
+	// one reference for us, one for the caller
+	Inbox *inbox = new Inbox(id, capacity, overflow);
+	inbox->fReferences.store(2, boost::memory_order_relaxed);
+	fObjectInboxes[id] = inbox;
+	return inbox;
+}
+
+
+// close the inbox of a destroyed object
+void ObjectManager::closeObjectInbox(ObjectId id) {
+	map<ObjectId, Inbox*>::iterator it = fObjectInboxes.find(id);
+	if (it == fObjectInboxes.end()) return;
+	it->second->close();
+	fClosedInboxes.push_back(it->second);
+	fObjectInboxes.erase(it);
+}
+
+
+// execute all posted commands
+unsigned ObjectManager::processInbox() {
+
+	// first the object manager inbox, then the object inboxes in order of object id
+	// the commands can destroy objects, which closes their inboxes, so we go through a copy
+	unsigned n = processInbox(fInbox);
+	vector<Inbox*> inboxes;
+	inboxes.reserve(fObjectInboxes.size());
+	for (map<ObjectId, Inbox*>::iterator it = fObjectInboxes.begin(); it != fObjectInboxes.end(); ++it) {
+		inboxes.push_back(it->second);
+	}
+	for (unsigned i = 0; i < inboxes.size(); ++i) n += processInbox(*inboxes[i]);
+
+	// what was posted to the inboxes of destroyed objects before they were closed, then we no longer need them
+	while (fClosedInboxes.size() > 0) {
+		vector<Inbox*> closed;
+		closed.swap(fClosedInboxes);
+		for (unsigned i = 0; i < closed.size(); ++i) {
+			n += processInbox(*closed[i]);
+			closed[i]->release();
+		}
+	}
+	return n;
+}
+
+
+// execute the commands in an inbox
+unsigned ObjectManager::processInbox(Inbox& inbox) {
+
+	// a closed inbox gets no more posts, but the ones accepted before it was closed are still executed
+	unsigned n = 0;
+	InboxCommand command;
+	if (inbox.isClosed()) {
+		while (inbox.drain(command)) {
+			executeCommand(command);
+			++n;
+		}
+		return n;
+	}
+
+	// only execute what was posted until now, so producers can't keep us busy forever
+	unsigned pending = inbox.size();
+	while (n < pending && inbox.pop(command)) {
+		executeCommand(command);
+		++n;
+	}
+	return n;
+}
+
+
+// execute a posted command
+// commands that refer to objects or components that no longer exist are ignored
+void ObjectManager::executeCommand(InboxCommand& command) {
+
+	// does the target object exist?
+	bool exists = command.target >= 0 && (unsigned)command.target < fObjects.size() && fObjects[command.target] != 0 && !fObjects[command.target]->fDying;
+
+	switch (command.type) {
+
+		// send a message
+		case INBOX_MESSAGE: {
+			if (!command.component->isValid()) return;
+			RequestId reqId = command.reqId != 0 ? command.reqId : getMessageRequestId(REQ_MESSAGE, command.name);
+			Message msg(MESSAGE, command.component, command.payload);
+			if (command.target < 0) sendGlobalMessage(reqId, msg);
+			else if (exists) sendMessageToObject(reqId, msg, command.target);
+			break;
+		}
+
+		// create an object with its components
+		case INBOX_CREATE_OBJECT: {
+			ObjectId id = createObject();
+			for (list<Component*>::iterator it = command.components.begin(); it != command.components.end(); ++it) {
+				addComponent(id, *it);
+			}
+			if (command.finalize) finalizeObject(id);
+			break;
+		}
+
+		// add a component
+		case INBOX_ADD_COMPONENT:
+			if (exists) addComponent(command.target, command.component);
+			break;
+
+		// destroy a component
+		case INBOX_DESTROY_COMPONENT:
+			if (command.component->isValid()) destroyComponent(command.component);
+			break;
+
+		// destroy an object
+		case INBOX_DESTROY_OBJECT:
+			if (exists) destroyObject(command.target);
+			break;
+
+		// finalize an object
+		case INBOX_FINALIZE_OBJECT:
+			if (exists) finalizeObject(command.target);
+			break;
+
+		// move a component
+		case INBOX_MOVE_COMPONENT:
+			if (exists && command.component->isValid()) moveComponent(command.component, command.target);
+			break;
+
+		// register a name
+		case INBOX_REGISTER_NAME:
+			if (exists) registerName(command.target, command.name);
+			break;
+	}
+}
+
+
+/**
+ * COMMAND BUFFERS
+ */
+
+// execute the commands of a buffer in the order they were recorded
+unsigned ObjectManager::executeCommands(CommandBuffer& buffer) {
+
+	// the objects created by the buffer, by provisional id
+	vector<ObjectId> created;
+	unsigned n = buffer.fCommands.size();
+	for (unsigned i = 0; i < n; ++i) {
+		InboxCommand& command = buffer.fCommands[i];
+
+		// resolve a provisional target - it can't refer to an object created later in the buffer
+		if (command.target < -1 && command.type != INBOX_CREATE_OBJECT) {
+			unsigned index = -2 - command.target;
+			if (index >= created.size()) {
+				error(format("Failed to execute command buffer: object %d is used before it was created!") % command.target);
+			}
+			command.target = created[index];
+		}
+
+		// create an object, and remember its id
+		if (command.type == INBOX_CREATE_OBJECT) {
+			ObjectId id = createObject();
+			created.push_back(id);
+			for (list<Component*>::iterator it = command.components.begin(); it != command.components.end(); ++it) {
+				addComponent(id, *it);
+			}
+			if (command.finalize) finalizeObject(id);
+		}
+		else executeCommand(command);
+	}
+	buffer.clear();
+	return n;
+}
+
+// order the buffers by key
+static bool compareCommandBuffers(CommandBuffer *a, CommandBuffer *b) {
+	return a->getKey() < b->getKey();
+}
+
+// execute buffers in the order of their keys
+unsigned ObjectManager::executeCommands(vector<CommandBuffer*> const & buffers) {
+	vector<CommandBuffer*> sorted(buffers);
+	std::stable_sort(sorted.begin(), sorted.end(), compareCommandBuffers);
+	unsigned n = 0;
+	for (unsigned i = 0; i < sorted.size(); ++i) n += executeCommands(*sorted[i]);
+	return n;
+}
+
+
+// set the destruction budget
+void ObjectManager::setDestructionBudget(unsigned maxComponents, double maxSeconds) {
+	fIncrementalDestruction = true;
+	fDestructionMaxComponents = maxComponents;
+	fDestructionMaxSeconds = maxSeconds;
+}
+
+
+// back to immediate destruction
+void ObjectManager::disableDestructionBudget() {
+
+	// destroy everything that's still pending
+	fDestructionMaxComponents = 0;
+	fDestructionMaxSeconds = 0;
+	processDestruction();
+	fIncrementalDestruction = false;
+}
+
+
+// destroy pending components and objects within the budget
+unsigned ObjectManager::processDestruction() {
+
+	// messages are being sent, the components would only be postponed - the next call continues
+	if (fNLocks != 0 || fResumeDepth != 0) return 0;
+
+	// profile
+	ProfileScope profile(fProfiler, PROFILE_DESTRUCTION, ProcessDestructionAtom);
+
+	// start the clock
+	boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+	boost::chrono::duration<double> maxTime(fDestructionMaxSeconds);
+
+	// first components, then objects, until the budget is spent
+	unsigned n = 0;
+	while (fDyingComponents.size() > 0 || fDyingObjects.size() > 0) {
+
+		// out of budget
+		if (fDestructionMaxComponents != 0 && n >= fDestructionMaxComponents) break;
+		if (fDestructionMaxSeconds != 0 && boost::chrono::steady_clock::now() - start >= maxTime) break;
+
+		// single components
+		if (fDyingComponents.size() > 0) {
+			Component *comp = fDyingComponents.front();
+			fDyingComponents.pop_front();
+			destroyComponentNow(comp);
+			++n;
+			continue;
+		}
+
+		// an object, one component at a time - its components are taken once, it can't get new ones while dying
+		ObjectId id = fDyingObjects.front();
+		if (!fDestroyingObject) {
+			fDyingObjectComponents = fObjects[id]->getComponents();
+			fDestroyingObject = true;
+		}
+		while (fDyingObjectComponents.size() > 0 && fDyingObjectComponents.front()->isDestroyed()) fDyingObjectComponents.pop_front();
+		if (fDyingObjectComponents.size() > 0) {
+			Component *comp = fDyingObjectComponents.front();
+			fDyingObjectComponents.pop_front();
+			destroyComponentNow(comp);
+			++n;
+			continue;
+		}
+
+		// no components left, delete the object itself
+		fDestroyingObject = false;
+		fDyingObjects.pop_front();
+		destroyObjectNow(id);
+	}
+	return n;
+}
+
+
+/**
+ * COMPACTION
+ */
+
+// set the compaction budget
+void ObjectManager::setCompactionBudget(unsigned maxEntries, double maxSeconds) {
+	fCompaction = true;
+	fCompactionMaxEntries = maxEntries;
+	fCompactionMaxSeconds = maxSeconds;
+}
+
+
+// no more compaction in tick
+void ObjectManager::disableCompaction() {
+	fCompaction = false;
+}
+
+
+// compact within the budget
+unsigned ObjectManager::processCompaction() {
+	return compactStorage(fCompactionMaxEntries, fCompactionMaxSeconds);
+}
+
+
+// compact everything
+void ObjectManager::compact() {
+	fCompactionCursor = 0;
+	compactStorage(0, 0);
+}
+
+
+// compact until the budget is spent
+unsigned ObjectManager::compactStorage(unsigned maxEntries, double maxSeconds) {
+
+	// the storage is being iterated
+	if (fNLocks != 0 || fResumeDepth != 0 || fRunningSystems) return 0;
+
+	// profile
+	ProfileScope profile(fProfiler, PROFILE_STRUCTURE, CompactionAtom);
+
+	// start the clock
+	boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+	boost::chrono::duration<double> maxTime(maxSeconds);
+
+	// visit the objects at most once, from where the previous call stopped
+	unsigned n = 0;
+	for (unsigned i = 0; i < fObjects.size(); ++i) {
+
+		// out of budget
+		if (maxEntries != 0 && n >= maxEntries) break;
+		if (maxSeconds != 0 && boost::chrono::steady_clock::now() - start >= maxTime) break;
+
+		// next object
+		if (fCompactionCursor >= fObjects.size()) fCompactionCursor = 0;
+		n += compactObject(fObjects[fCompactionCursor++]);
+	}
+	return n;
+}
+
+
+// remove the destroyed components from an object
+unsigned ObjectManager::compactObject(Object *obj) {
+
+	// dead objects cost nothing, and dying ones are still being destroyed
+	if (obj == 0 || obj->fDying) return 0;
+
+	// the destroyed components, and the types without components left
+	unsigned n = 1;
+	for (hash_map<AtomId, list<Component*> >::iterator it = obj->fComponents.begin(); it != obj->fComponents.end();) {
+		list<Component*>& comps = it->second;
+		n += comps.size();
+		for (list<Component*>::iterator comp = comps.begin(); comp != comps.end();) {
+			if ((*comp)->isDestroyed()) comp = comps.erase(comp);
+			else ++comp;
+		}
+		if (comps.size() == 0) obj->fComponents.erase(it++);
+		else ++it;
+	}
+	return n;
+}
+
+
+// error processing
+void ObjectManager::error(boost::format err) {
+	cout << err.str() << endl;
+	assert(false);
+}
+
+
+// destroy object
+void ObjectManager::destroyObject(ObjectId id) {
+
+	// record
+	if (isRecording() && id >= 0 && (unsigned)id < fObjects.size() && fObjects[id] != 0 && !fObjects[id]->fDying) fRecorder->recordDestroyObject(id);
+	RecordScope record(fRecordDepth);
+
+	// with a destruction budget, hide it now and destroy it later
+	if (fIncrementalDestruction) {
+
+		// object doesn't exist
+		if (id < 0 || (unsigned)id >= fObjects.size() || fObjects[id] == 0) {
+			error(format("Failed to destroy object %d: it does not exist!") % id);
+		}
+
+		// already dying
+		Object *obj = fObjects[id];
+		if (obj->fDying) return;
+
+		// hide the object and its components
+		obj->fDying = true;
+		list<Component*> comps = obj->getComponents();
+		for (list<Component*>::iterator it = comps.begin(); it != comps.end(); ++it) {
+			(*it)->fDying = true;
+			if (fReplicator != 0) fReplicator->componentRemoved(*it);
+		}
+		fDyingObjects.push_back(id);
+		return;
+	}
+
+	// destroy it now
+	destroyObjectNow(id);
+}
+void ObjectManager::destroyObjectNow(ObjectId id) {
+
+	// if there's no lock, we delete the object immediately, otherwise, postpone
+	if (fNLocks != 0) {
+		fDeadObjects.push_back(id);
+		return;
+	}
+
+	// object doesn't exist
+	if (id < 0 || id >= fObjects.size() || fObjects[id] == 0) {
+		error(format("Failed to destroy object %d: it does not exist!") % id);
+	}
+
+	// destroy every component in the object
+	list<Component*> comps = fObjects[id]->getComponents();
+	for (list<Component*>::iterator it = comps.begin(); it != comps.end(); ++it) {
+		destroyComponentNow(*it);
+	}
+
+	// leave the groups, and close the inbox
+	leaveGroups(id);
+	closeObjectInbox(id);
+
+	// delete the actual object
+	//cout << "Destroyed object " << id << endl;
+	delete fObjects[id];
+	fObjects[id] = 0;
+}
+
+
+
+// destroy a component
+void ObjectManager::destroyComponent(Component *comp) {
+
+	// record
+	if (isRecording() && comp->isValid() && !comp->isDying()) fRecorder->recordDestroyComponent(comp);
+	RecordScope record(fRecordDepth);
+
+	// with a destruction budget, hide it now and destroy it later
+	if (fIncrementalDestruction && !comp->isDestroyed()) {
+		if (comp->isDying()) return;
+		comp->fDying = true;
+		fDyingComponents.push_back(comp);
+		if (fReplicator != 0) fReplicator->componentRemoved(comp);
+		return;
+	}
+
+	// destroy it now
+	destroyComponentNow(comp);
+}
+void ObjectManager::destroyComponentNow(Component *comp) {
+
+	// already destroyed before, don't do anything
+	if (comp->isDestroyed()) {
+		return;
+	}
+
+	// invalid component shouldn't be possible
+	else if (!comp->isValid()) {
+		error(format("Error destroying component %s: component is not valid.") % comp->toString());
+	}
+
+
+	// see if there are any locks - if there are, postpone this destroyal
+	if (fNLocks != 0) {
+		fDeadComponents.push_back(comp);
+		return;
+	}
+	
+
+	// profile
+	ProfileScope profile(fProfiler, PROFILE_STRUCTURE, DestroyComponentAtom, comp, comp->getOwnerId());
+
+	// remove it from the components of its type, moving the last one in its place
+	vector<Component*>& ofType = fComponentsByType[comp->getNameAtom().getId()];
+	ofType[comp->fTypeIndex] = ofType.back();
+	ofType[comp->fTypeIndex]->fTypeIndex = comp->fTypeIndex;
+	ofType.pop_back();
+	if (fReplicator != 0) fReplicator->componentRemoved(comp);
+
+	// put in log
+	//if (fStream.is_open()) fStream << "DESTROY " << *comp << endl;
+
+	// remove its own requests
+	list<ComponentRequest>& reqs = fRequestsByComponentId[comp->getId()];
+	for (list<ComponentRequest>::iterator it = reqs.begin(); it != reqs.end(); ++it) {
+
+		// get the appropriate id
+		RequestId reqId = getExistingRequestId(it->type, it->name);
+
+		// must exist!
+		assert(reqId != 0);
+
+		// look up the request and delete it
+		for (list<RegisteredComponent>::iterator reg = fGlobalRequests[reqId].begin(); reg != fGlobalRequests[reqId].end();) {
+			if (reg->component->getId() == comp->getId()) {
+				reg = fGlobalRequests[reqId].erase(reg);
+			}
+			else ++reg;
+		}
+
+		// and the batch handlers
+		if (it->type == REQ_MESSAGE && isBatched(reqId)) {
+			list<pair<Component*, MessageBatchFunction> >& handlers = fBatches[reqId]->components;
+			for (list<pair<Component*, MessageBatchFunction> >::iterator handler = handlers.begin(); handler != handlers.end();) {
+				if (handler->first == comp) {
+					handler = handlers.erase(handler);
+				}
+				else ++handler;
+			}
+		}
+
+		// and the requests for moves
+		if (it->type != REQ_COMPONENT || fMoveRequests.size() <= (unsigned)reqId) continue;
+		for (list<RegisteredComponent>::iterator reg = fMoveRequests[reqId].begin(); reg != fMoveRequests[reqId].end();) {
+			if (reg->component == comp) {
+				reg = fMoveRequests[reqId].erase(reg);
+			}
+			else ++reg;
+		}
+	}
+
+	// remove its own local requests - only if the object itself wasn't removed yet
+	fObjects[comp->getOwnerId()]->removeComponent(comp);
+
+	// remove its answers to queries
+	removeAnswers(comp);
+
+	// stop its behaviors
+	hash_map<ComponentId, list<Behavior*> >::iterator behaviors = fBehaviorsByComponentId.find(comp->getId());
+	if (behaviors != fBehaviorsByComponentId.end()) {
+		list<Behavior*> killed = behaviors->second;
+		for (list<Behavior*>::iterator it = killed.begin(); it != killed.end(); ++it) {
+			killBehavior(*it);
+		}
+		fBehaviorsByComponentId.erase(comp->getId());
+	}
+
+	// CREATE event
+	Message msg(DESTROY);
+	msg.sender = comp;
+
+	// get req id
+	RequestId reqId = getExistingRequestId(REQ_COMPONENT, comp->getNameAtom());
+
+	// if there exist some requests, we process them
+	if (reqId != 0) {
+
+		// activate lock
+		activateLock(reqId);
+
+		// look up the request and delete it
+		for (list<RegisteredComponent>::iterator reg = fGlobalRequests[reqId].begin(); reg != fGlobalRequests[reqId].end(); ++reg) {
+			if (reg->component->isDying()) continue;
+			ProfileScope profileCallback(fProfiler, comp, reg->component);
+			reg->callback(msg);
+		}
+
+		// forward to the object itself, so local requests are processed also
+		fObjects[comp->getOwnerId()]->sendMessage(reqId, msg, fProfiler);
+
+		// release the lock
+		releaseLock(reqId);
+	}
+
+	// make it invalid
+	comp->setDestroyed();
+}
+
+
+// move a component to another object
+void ObjectManager::moveComponent(Component *comp, ObjectId id) {
+
+	// the component must be part of an object
+	if (!comp->isValid() || comp->fObjectManager != this) {
+		error(format("Failed to move component %s: it is not valid.") % comp->toString());
+	}
+
+	// make sure the object exists
+	if (id < 0 || (unsigned)id >= fObjects.size() || fObjects[id] == 0 || fObjects[id]->fDying) {
+		error(format("Failed to move component %s to object %d: it does not exist!") % comp->toString() % id);
+	}
+
+	// dying components stay where they are
+	if (comp->isDying()) return;
+
+	// record, the MOVED messages are a consequence
+	if (isRecording()) fRecorder->recordMoveComponent(comp, id);
+	RecordScope record(fRecordDepth);
+
+	// move it now
+	moveComponentNow(comp, id);
+}
+void ObjectManager::moveComponentNow(Component *comp, ObjectId id) {
+
+	// if there's a lock, we postpone the move
+	if (fNLocks != 0) {
+		fPendingMoves.push_back(pair<Component*, ObjectId>(comp, id));
+		return;
+	}
+
+	// the component or the object may have been destroyed since the move was postponed
+	if (!comp->isValid() || comp->isDying() || (unsigned)id >= fObjects.size() || fObjects[id] == 0 || fObjects[id]->fDying) return;
+
+	// nothing to do
+	ObjectId previous = comp->getOwnerId();
+	if (previous == id) return;
+
+	// profile
+	ProfileScope profile(fProfiler, PROFILE_STRUCTURE, MoveComponentAtom, comp, id);
+
+	// behaviors waiting for local events wait in the object, take them out while the owner changes
+	vector<pair<Behavior*, pair<RequestId, bool> > > relink;
+	hash_map<ComponentId, list<Behavior*> >::iterator behaviors = fBehaviorsByComponentId.find(comp->getId());
+	if (behaviors != fBehaviorsByComponentId.end()) {
+		for (list<Behavior*>::iterator it = behaviors->second.begin(); it != behaviors->second.end(); ++it) {
+			Behavior *b = *it;
+			if (!b->fLinked[1]) continue;
+			relink.push_back(pair<Behavior*, pair<RequestId, bool> >(b, pair<RequestId, bool>(b->fWaitReqId, b->fLinked[0])));
+			unlinkBehavior(b);
+		}
+	}
+
+	// move the component, with its local requests and answers
+	// the owner is set directly, its ping request moved with the other local requests
+	fObjects[previous]->moveComponent(comp, fObjects[id]);
+	comp->fOwnerId = id;
+	if (fReplicator != 0) fReplicator->componentMoved(comp);
+
+	// the components it requires are checked when its new object is finalized, if it isn't yet
+	list<pair<ComponentId, Atom> > required;
+	hash_map<ObjectId, list<pair<ComponentId, Atom> > >::iterator from = fRequiredComponents.find(previous);
+	if (from != fRequiredComponents.end()) {
+		for (list<pair<ComponentId, Atom> >::iterator it = from->second.begin(); it != from->second.end();) {
+			if (it->first == comp->getId()) {
+				required.push_back(*it);
+				it = from->second.erase(it);
+			}
+			else ++it;
+		}
+		if (from->second.size() == 0) fRequiredComponents.erase(from);
+	}
+	if (required.size() > 0 && !fObjects[id]->isFinalized()) fRequiredComponents[id].splice(fRequiredComponents[id].end(), required);
+
+	// and the behaviors
+	for (unsigned i = 0; i < relink.size(); ++i) {
+		Behavior *b = relink[i].first;
+		b->fWaitReqId = relink[i].second.first;
+		linkBehavior(b, 1);
+		if (relink[i].second.second) linkBehavior(b, 0);
+	}
+
+	// let the components that requested moves of its type know, with the previous owner
+	RequestId reqId = getExistingRequestId(REQ_COMPONENT, comp->getNameAtom());
+	if (reqId == 0 || fMoveRequests.size() <= (unsigned)reqId || fMoveRequests[reqId].size() == 0) return;
+	Message msg(MOVED, comp, previous);
+
+	// no lock on the request id, moves may be requested in the callbacks - postpone any structural change instead
+	++fNLocks;
+	for (list<RegisteredComponent>::iterator it = fMoveRequests[reqId].begin(); it != fMoveRequests[reqId].end(); ++it) {
+		if (it->component == comp || it->component->isDying()) continue;
+		ProfileScope profileCallback(fProfiler, comp, it->component);
+		it->callback(msg);
+	}
+	--fNLocks;
+	processPending();
+}
+
+
+// finalize an object
+void ObjectManager::finalizeObject(ObjectId id) {
+
+	// object doesn't exist
+	if (id < 0 || id >= fObjects.size() || fObjects[id] == 0) {
+		error(format("Failed to destroy object %d: it does not exist!") % id);
+	}
+
+	// dying objects are invisible
+	if (fObjects[id]->fDying) return;
+
+	// record
+	if (isRecording()) fRecorder->recordFinalizeObject(id);
+	RecordScope record(fRecordDepth);
+
+	// finalize the object itself
+	fObjects[id]->finalize();
+
+	// see if there are any requirements
+	if (fRequiredComponents.find(id) == fRequiredComponents.end()) return;
+
+	// there are, do the checklist
+	list<pair<ComponentId, Atom> > requiredComponents = fRequiredComponents[id];
+	bool destroyObject = false;
+	for (list<pair<ComponentId, Atom> >::iterator it = requiredComponents.begin(); it != requiredComponents.end(); ++it) {
+
+		// get the components of this type
+		list<Component*> comps = fObjects[id]->getComponents(it->second);
+
+		// if there are none, we want this object dead!
+		if (comps.size() == 0) destroyObject = true;
+	}
+/*if (!destroyObject) cout << "Finalized object " << id << " succesfully!" << endl;
+else cout << "Finalize on object " << id << " failed, destroying..." << endl;*/
+	// we destroy the object if we didn't find what we needed
+	if (destroyObject) this->destroyObject(id);
+}
+
+
+// add an object to a group
+bool ObjectManager::joinGroup(ObjectId id, Atom group) {
+
+	// object doesn't exist
+	if (id < 0 || (unsigned)id >= fObjects.size() || fObjects[id] == 0) {
+		error(format("Failed to add object %d to group %s: it does not exist!") % id % group.str());
+	}
+
+	// already a member
+	if (isInGroup(id, group)) return false;
+
+	// record
+	if (isRecording()) fRecorder->recordJoinGroup(id, group);
+
+	// add it
+	if (fGroups.size() <= group.getId()) fGroups.resize(group.getId()+1);
+	Group& g = fGroups[group.getId()];
+	fObjects[id]->fGroups.push_back(pair<AtomId, unsigned>(group.getId(), g.members.size()));
+	g.members.push_back(id);
+	return true;
+}
+
+
+// remove an object from a group
+bool ObjectManager::leaveGroup(ObjectId id, Atom group) {
+
+	// object doesn't exist
+	if (id < 0 || (unsigned)id >= fObjects.size() || fObjects[id] == 0) return false;
+
+	// not a member
+	if (!isInGroup(id, group)) return false;
+
+	// record
+	if (isRecording()) fRecorder->recordLeaveGroup(id, group);
+
+	// remove it
+	removeFromGroup(id, group.getId());
+	return true;
+}
+void ObjectManager::removeFromGroup(ObjectId id, AtomId group) {
+
+	// find the membership
+	vector<pair<AtomId, unsigned> >& groups = fObjects[id]->fGroups;
+	unsigned m = 0;
+	while (m < groups.size() && groups[m].first != group) ++m;
+	if (m == groups.size()) return;
+
+	// while a message is being sent to the group, leave a hole
+	Group& g = fGroups[group];
+	unsigned index = groups[m].second;
+	if (g.locks > 0) {
+		g.members[index] = -1;
+		g.dirty = true;
+	}
+
+	// otherwise, move the last member in its place
+	else {
+		ObjectId last = g.members.back();
+		g.members[index] = last;
+		g.members.pop_back();
+		if (last != id) {
+			vector<pair<AtomId, unsigned> >& lastGroups = fObjects[last]->fGroups;
+			for (unsigned i = 0; i < lastGroups.size(); ++i) {
+				if (lastGroups[i].first == group) lastGroups[i].second = index;
+			}
+		}
+	}
+
+	// forget the membership
+	groups[m] = groups.back();
+	groups.pop_back();
+}
+
+
+// remove the holes in a group
+void ObjectManager::compactGroup(AtomId group) {
+	Group& g = fGroups[group];
+	unsigned n = 0;
+	for (unsigned i = 0; i < g.members.size(); ++i) {
+		ObjectId id = g.members[i];
+		if (id < 0) continue;
+
+		// moved, update its index
+		if (n != i) {
+			vector<pair<AtomId, unsigned> >& groups = fObjects[id]->fGroups;
+			for (unsigned m = 0; m < groups.size(); ++m) {
+				if (groups[m].first == group) groups[m].second = n;
+			}
+		}
+		g.members[n++] = id;
+	}
+	g.members.resize(n);
+	g.dirty = false;
+}
+
+
+// remove an object from all its groups
+void ObjectManager::leaveGroups(ObjectId id) {
+	while (fObjects[id]->fGroups.size() > 0) {
+		removeFromGroup(id, fObjects[id]->fGroups.back().first);
+	}
+}
+
+
+// is an object a member of a group?
+bool ObjectManager::isInGroup(ObjectId id, Atom group) {
+	if (id < 0 || (unsigned)id >= fObjects.size() || fObjects[id] == 0) return false;
+	vector<pair<AtomId, unsigned> >& groups = fObjects[id]->fGroups;
+	for (unsigned i = 0; i < groups.size(); ++i) {
+		if (groups[i].first == group.getId()) return true;
+	}
+	return false;
+}
+
+
+// get the members of a group
+vector<ObjectId> ObjectManager::getGroupMembers(Atom group) {
+	vector<ObjectId> members;
+	if (fGroups.size() <= group.getId()) return members;
+	Group& g = fGroups[group.getId()];
+	for (unsigned i = 0; i < g.members.size(); ++i) {
+		if (g.members[i] >= 0 && !fObjects[g.members[i]]->fDying) members.push_back(g.members[i]);
+	}
+	return members;
+}
+
+
+// get a component by type and index
+Component* ObjectManager::getComponent(ObjectId id, Atom type, unsigned ordinal) {
+
+	// object doesn't exist
+	if (id < 0 || (unsigned)id >= fObjects.size() || fObjects[id] == 0) return 0;
+
+	// no components of this type
+	hash_map<AtomId, list<Component*> >::iterator it = fObjects[id]->fComponents.find(type.getId());
+	if (it == fObjects[id]->fComponents.end()) return 0;
+
+	// find the index
+	for (list<Component*>::iterator comp = it->second.begin(); comp != it->second.end(); ++comp) {
+		if ((*comp)->isDestroyed()) continue;
+		if (ordinal == 0) return *comp;
+		--ordinal;
+	}
+	return 0;
+}
+
+
+// get the index of a component among the components of its type
+unsigned ObjectManager::getComponentOrdinal(Component *comp) {
+
+	// object doesn't exist
+	ObjectId id = comp->getOwnerId();
+	if (id < 0 || (unsigned)id >= fObjects.size() || fObjects[id] == 0) return 0;
+
+	// no components of this type
+	hash_map<AtomId, list<Component*> >::iterator it = fObjects[id]->fComponents.find(comp->getNameAtom().getId());
+	if (it == fObjects[id]->fComponents.end()) return 0;
+
+	// find the component
+	unsigned ordinal = 0;
+	for (list<Component*>::iterator c = it->second.begin(); c != it->second.end(); ++c) {
+		if (*c == comp) return ordinal;
+		if (!(*c)->isDestroyed()) ++ordinal;
+	}
+	return 0;
+}
+
+
+// register a unique name for an object
+bool ObjectManager::registerName(ObjectId id, string const & name) {
+
+	// see if the name doesn't exist yet
+	if (fObjectNameToId.find(name) != fObjectNameToId.end()) {
+		error(format("Failed to register name identifier %s for object %d, because it already exists!") % name % id);
+		return false;
+	}
+
+	// add the id
+	fObjectNameToId[name] = id;
+	return true;
+}
+
+// get the id based on the unique name identified
+ObjectId ObjectManager::getObjectId(string const & name) {
+
+	// see if the name doesn't exist yet
+	hash_map<string, ObjectId>::iterator it = fObjectNameToId.find(name);
+	if (it == fObjectNameToId.end()) {
+		error(format("Failed to acquire object id for unique name identifier %s because it doesn't exist!") % name);
+		return 0;
+	}
+
+	// return id
+	return it->second;
+}
+
+
+// logging
+void ObjectManager::trackRequest(RequestId reqId, bool local, Component *component) {
+
+	// if global, find it
+	if (!local) {
+
+		// find in global request list
+		for (list<RegisteredComponent>::iterator it = fGlobalRequests[reqId].begin(); it != fGlobalRequests[reqId].end(); ++it) {
+			if ((*it).component->getId() == component->getId()) (*it).trackMe = true;
+		}
+
+		// also pass to local for extra check (MESSAGE messages are always local AND global)
+		fObjects[component->getOwnerId()]->trackRequest(reqId, component);
+
+
+	}
+
+	// if local, forward to object
+	else {
+		fObjects[component->getOwnerId()]->trackRequest(reqId, component);
+	}
+}
+
+/**
+ * STAGING
+ */
+
+// merge a staging object manager
+ObjectId ObjectManager::merge(ObjectManager& staging) {
+
+	// not while messages are being sent, here or in the staging object manager
+	if (&staging == this || fNLocks != 0 || fResumeDepth != 0 || staging.fNLocks != 0 || staging.fResumeDepth != 0) {
+		error(format("Failed to merge: messages are being sent."));
+	}
+
+	// only what can be moved as it is
+	bool behaviors = false;
+	for (hash_map<ComponentId, list<Behavior*> >::iterator it = staging.fBehaviorsByComponentId.begin(); it != staging.fBehaviorsByComponentId.end(); ++it) {
+		if (it->second.size() > 0) behaviors = true;
+	}
+	if (behaviors || staging.fTimers.size() > 0 || staging.getPendingDestructions() > 0 || staging.fDeadComponents.size() > 0 || staging.fDeadObjects.size() > 0
+		|| staging.fPendingMoves.size() > 0 || staging.fPendingBatches.size() > 0) {
+		error(format("Failed to merge: the staging object manager has timers, behaviors, or pending destructions, moves or batches."));
+	}
+
+	// state channels and inboxes hold request ids and object ids of the staging object manager
+	bool channels = staging.fPendingChannels.size() > 0;
+	for (unsigned c = 0; c < staging.fStateChannels.size(); ++c) {
+		if (staging.fStateChannels[c] != 0) channels = true;
+	}
+	if (channels || staging.fInbox.size() > 0 || staging.fObjectInboxes.size() > 0 || staging.fClosedInboxes.size() > 0) {
+		error(format("Failed to merge: the staging object manager has state channels or inboxes."));
+	}
+	if (isRecording()) {
+		error(format("Failed to merge: merges can't be recorded."));
+	}
+
+	// profile
+	ProfileScope profile(fProfiler, PROFILE_STRUCTURE, MergeAtom);
+
+	// the request ids of the staging object manager, in this one
+	vector<RequestId> requests(staging.fRequestIdCounter+1, 0);
+	for (int type = REQ_COMPONENT; type <= REQ_MESSAGE; ++type) {
+		for (unsigned r = 1; r < staging.fIdToRequest[type].size(); ++r) {
+			if (staging.fIdToRequest[type][r].isValid()) requests[r] = getMessageRequestId((ComponentRequestType)type, staging.fIdToRequest[type][r]);
+		}
+	}
+
+	// the objects, in one block after the existing ones
+	ObjectId offset = fIdCounter;
+	fObjects.reserve(fObjects.size() + staging.fObjects.size());
+	for (unsigned i = 0; i < staging.fObjects.size(); ++i) {
+		Object *obj = staging.fObjects[i];
+		fObjects.push_back(obj);
+		if (obj == 0) continue;
+		obj->fId += offset;
+
+		// its local requests, by request id of this object manager
+		vector<list<RegisteredComponent> > local;
+		for (unsigned r = 1; r < obj->fLocalRequests.size(); ++r) {
+			if (obj->fLocalRequests[r].size() == 0) continue;
+			if (local.size() <= (unsigned)requests[r]) local.resize(requests[r]+1);
+			local[requests[r]].swap(obj->fLocalRequests[r]);
+		}
+		obj->fLocalRequests.swap(local);
+		vector<Behavior*>().swap(obj->fWaitingBehaviors);
+
+		// its components
+		for (hash_map<AtomId, list<Component*> >::iterator it = obj->fComponents.begin(); it != obj->fComponents.end(); ++it) {
+			for (list<Component*>::iterator comp = it->second.begin(); comp != it->second.end(); ++comp) {
+				(*comp)->fObjectManager = this;
+				(*comp)->fOwnerId += offset;
+				(*comp)->fChangeSerial = 0;
+			}
+		}
+	}
+	fIdCounter += staging.fIdCounter;
+
+	// the components of every type, after the existing ones
+	vector<unsigned> existing(staging.fComponentsByType.size(), 0);
+	if (fComponentsByType.size() < staging.fComponentsByType.size()) fComponentsByType.resize(staging.fComponentsByType.size());
+	for (unsigned t = 0; t < staging.fComponentsByType.size(); ++t) {
+		vector<Component*>& ofType = fComponentsByType[t];
+		existing[t] = ofType.size();
+		for (unsigned i = 0; i < staging.fComponentsByType[t].size(); ++i) {
+			Component *comp = staging.fComponentsByType[t][i];
+			comp->fTypeIndex = ofType.size();
+			ofType.push_back(comp);
+			if (fReplicator != 0) fReplicator->componentAdded(comp);
+		}
+	}
+
+	// the global requests, after the existing ones - remember how many there were
+	vector<int> requesters(fRequestIdCounter+1, -1);
+	for (unsigned r = 1; r < staging.fGlobalRequests.size(); ++r) {
+		if (staging.fGlobalRequests[r].size() == 0) continue;
+		RequestId id = requests[r];
+		if (fGlobalRequests.size() <= (unsigned)id) fGlobalRequests.resize(id+1);
+		requesters[id] = fGlobalRequests[id].size();
+		fGlobalRequests[id].splice(fGlobalRequests[id].end(), staging.fGlobalRequests[r]);
+	}
+	for (unsigned r = 1; r < staging.fMoveRequests.size(); ++r) {
+		if (staging.fMoveRequests[r].size() == 0) continue;
+		RequestId id = requests[r];
+		if (fGlobalRequests.size() <= (unsigned)id) fGlobalRequests.resize(id+1);
+		if (fMoveRequests.size() <= (unsigned)id) fMoveRequests.resize(id+1);
+		fMoveRequests[id].splice(fMoveRequests[id].end(), staging.fMoveRequests[r]);
+	}
+	for (unsigned r = 1; r < staging.fBatches.size(); ++r) {
+		if (staging.fBatches[r] == 0) continue;
+		Batch *batch = getBatch(staging.fIdToRequest[REQ_MESSAGE][r]);
+		batch->components.splice(batch->components.end(), staging.fBatches[r]->components);
+		batch->types.splice(batch->types.end(), staging.fBatches[r]->types);
+		delete staging.fBatches[r];
+	}
+	for (hash_map<ComponentId, list<ComponentRequest> >::iterator it = staging.fRequestsByComponentId.begin(); it != staging.fRequestsByComponentId.end(); ++it) {
+		list<ComponentRequest>& reqs = fRequestsByComponentId[it->first];
+		reqs.splice(reqs.end(), it->second);
+	}
+	for (hash_map<ObjectId, list<pair<ComponentId, Atom> > >::iterator it = staging.fRequiredComponents.begin(); it != staging.fRequiredComponents.end(); ++it) {
+		fRequiredComponents[it->first + offset].swap(it->second);
+	}
+
+	// the answers to queries, after the existing ones
+	for (unsigned q = 0; q < staging.fQueries.size(); ++q) {
+		Query& from = staging.fQueries[q];
+		if (from.answers.size() == 0) continue;
+		if (fQueries.size() <= q) fQueries.resize(q+1);
+		Query& to = fQueries[q];
+		if (to.type == 0) to.type = from.type;
+		else if (*to.type != *from.type) {
+			error(format("Failed to merge the answers of %s: the query is answered with another type.") % from.answers[0]->component->toString());
+		}
+		for (unsigned a = 0; a < from.answers.size(); ++a) {
+			from.answers[a]->index = to.answers.size();
+			to.answers.push_back(from.answers[a]);
+		}
+	}
+	for (hash_map<ComponentId, vector<AtomId> >::iterator it = staging.fQueriesByComponentId.begin(); it != staging.fQueriesByComponentId.end(); ++it) {
+		fQueriesByComponentId[it->first].swap(it->second);
+	}
+
+	// the names, unless they're taken
+	for (hash_map<string, ObjectId>::iterator it = staging.fObjectNameToId.begin(); it != staging.fObjectNameToId.end(); ++it) {
+		if (fObjectNameToId.find(it->first) == fObjectNameToId.end()) fObjectNameToId[it->first] = it->second + offset;
+	}
+
+	// the members of the groups, after the existing ones
+	for (unsigned g = 0; g < staging.fGroups.size(); ++g) {
+		vector<ObjectId>& members = staging.fGroups[g].members;
+		if (fGroups.size() <= g) fGroups.resize(g+1);
+		vector<ObjectId>& to = fGroups[g].members;
+		for (unsigned i = 0; i < members.size(); ++i) {
+			if (members[i] < 0) continue;
+			vector<pair<AtomId, unsigned> >& groups = fObjects[members[i] + offset]->fGroups;
+			for (unsigned j = 0; j < groups.size(); ++j) {
+				if (groups[j].first == g) groups[j].second = to.size();
+			}
+			to.push_back(members[i] + offset);
+		}
+	}
+
+	// the staging object manager is empty, its object ids and request ids stay taken
+	staging.fObjects.assign(staging.fObjects.size(), 0);
+	vector<vector<Component*> >().swap(staging.fComponentsByType);
+	vector<list<RegisteredComponent> >().swap(staging.fGlobalRequests);
+	vector<list<RegisteredComponent> >().swap(staging.fMoveRequests);
+	vector<Batch*>().swap(staging.fBatches);
+	hash_map<ComponentId, list<ComponentRequest> >().swap(staging.fRequestsByComponentId);
+	hash_map<ObjectId, list<pair<ComponentId, Atom> > >().swap(staging.fRequiredComponents);
+	vector<Query>().swap(staging.fQueries);
+	hash_map<ComponentId, vector<AtomId> >().swap(staging.fQueriesByComponentId);
+	hash_map<string, ObjectId>().swap(staging.fObjectNameToId);
+	vector<Group>().swap(staging.fGroups);
+	vector<vector<Component*> >().swap(staging.fChangedComponents);
+	vector<AtomId>().swap(staging.fChangedTypes);
+	hash_map<ComponentId, list<Behavior*> >().swap(staging.fBehaviorsByComponentId);
+
+	// the component types to send CREATE messages for - the merged ones, and the ones merged components requested
+	vector<Atom> types;
+	hash_map<AtomId, bool> seen;
+	for (unsigned t = 0; t < existing.size(); ++t) {
+		if (fComponentsByType[t].size() == existing[t]) continue;
+		types.push_back(fComponentsByType[t][existing[t]]->getNameAtom());
+		seen[t] = true;
+	}
+	for (unsigned r = 1; r < staging.fIdToRequest[REQ_COMPONENT].size(); ++r) {
+		Atom type = staging.fIdToRequest[REQ_COMPONENT][r];
+		if (!type.isValid() || seen.find(type.getId()) != seen.end()) continue;
+		types.push_back(type);
+		seen[type.getId()] = true;
+	}
+
+	// count the components and requesters before any callback runs, components added by the callbacks send their own CREATE
+	vector<MergedType> merged;
+	for (unsigned i = 0; i < types.size(); ++i) {
+		MergedType m;
+		m.reqId = getExistingRequestId(REQ_COMPONENT, types[i]);
+		if (m.reqId == 0) continue;
+		m.type = types[i].getId();
+		m.allComponents = m.type < fComponentsByType.size() ? fComponentsByType[m.type].size() : 0;
+		m.components = m.type < existing.size() ? existing[m.type] : m.allComponents;
+		m.allRequesters = fGlobalRequests[m.reqId].size();
+		m.requesters = (unsigned)m.reqId < requesters.size() && requesters[m.reqId] >= 0 ? requesters[m.reqId] : m.allRequesters;
+		merged.push_back(m);
+	}
+
+	// the existing requesters receive the merged components, the merged requesters the existing components
+	// destructions are postponed until every type is done, so the components keep their index
+	++fNLocks;
+	for (unsigned i = 0; i < merged.size(); ++i) {
+		MergedType& m = merged[i];
+		activateLock(m.reqId);
+		Message msg(CREATE);
+		list<RegisteredComponent>::iterator it = fGlobalRequests[m.reqId].begin();
+		for (unsigned k = 0; k < m.allRequesters; ++k, ++it) {
+			unsigned begin = k < m.requesters ? m.components : 0;
+			unsigned end = k < m.requesters ? m.allComponents : m.components;
+			for (unsigned c = begin; c < end; ++c) {
+				Component *comp = fComponentsByType[m.type][c];
+				if (it->component->isDying() || comp->isDying() || it->component == comp) continue;
+				msg.sender = comp;
+				ProfileScope profileCallback(fProfiler, comp, it->component);
+				it->callback(msg);
+			}
+		}
+
+		// resume the behaviors waiting for the merged components
+		for (unsigned c = m.components; c < m.allComponents; ++c) {
+			msg.sender = fComponentsByType[m.type][c];
+			resumeBehaviors(0, msg.sender->getOwnerId(), m.reqId, CREATE, msg);
+		}
+		releaseLock(m.reqId);
+	}
+	--fNLocks;
+	processPending();
+
+	// the merged requesters of state channels receive the cached values
+	for (unsigned r = 1; r < staging.fIdToRequest[REQ_MESSAGE].size(); ++r) {
+		RequestId reqId = requests[r];
+		if (!staging.fIdToRequest[REQ_MESSAGE][r].isValid() || !isStateChannel(reqId) || requesters[reqId] < 0) continue;
+		list<RegisteredComponent>::iterator it = fGlobalRequests[reqId].begin();
+		std::advance(it, requesters[reqId]);
+		vector<RegisteredComponent> merged(it, fGlobalRequests[reqId].end());
+		for (unsigned i = 0; i < merged.size(); ++i) replayStateChannel(reqId, merged[i]);
+	}
+	return offset;
+}
+
+
+/**
+ * STATISTICS
+ */
+
+// estimated memory of containers - list and hash map nodes hold two pointers next to their value, map nodes three and a color
+template<class T>
+static size_t vectorBytes(vector<T> const & v) {
+	return v.capacity() * sizeof(T);
+}
+template<class T>
+static size_t listBytes(list<T> const & l) {
+	return l.size() * (sizeof(T) + 2 * sizeof(void*));
+}
+template<class M>
+static size_t mapBytes(M const & m) {
+	return m.size() * (sizeof(typename M::value_type) + 4 * sizeof(void*));
+}
+template<class M>
+static size_t hashMapBytes(M const & m) {
+	return m.size() * (sizeof(typename M::value_type) + 2 * sizeof(void*)) + m.bucket_count() * sizeof(void*);
+}
+
+
+// get the type and name of a request id
+string ObjectManager::getRequestName(RequestId reqId) {
+	static const char *types[2] = { "component ", "message " };
+	for (int type = 0; type < 2; ++type) {
+		if (fIdToRequest[type].size() <= (unsigned)reqId) continue;
+		Atom name = fIdToRequest[type][reqId];
+		if (fRequestToId[type].size() > name.getId() && fRequestToId[type][name.getId()] == reqId) return types[type] + name.str();
+	}
+	return "unknown";
+}
+
+
+// take a snapshot of the statistics
+ObjectManagerStats ObjectManager::getStats() {
+	ObjectManagerStats stats;
+	stats.time = getTime();
+
+	// objects, with their component lists, groups and answers
+	MemoryUsage& objects = stats.memoryByStructure["objects"];
+	MemoryUsage& localRequests = stats.memoryByStructure["local requests"];
+	objects.add(0, vectorBytes(fObjects) + hashMapBytes(fObjectNameToId));
+	for (unsigned i = 0; i < fObjects.size(); ++i) {
+		Object *obj = fObjects[i];
+		if (obj == 0) continue;
+		++stats.objects;
+		size_t bytes = sizeof(Object) + hashMapBytes(obj->fComponents) + vectorBytes(obj->fGroups) + vectorBytes(obj->fWaitingBehaviors) + vectorBytes(obj->fQueryAnswers);
+		for (hash_map<AtomId, list<Component*> >::iterator it = obj->fComponents.begin(); it != obj->fComponents.end(); ++it) {
+			bytes += listBytes(it->second);
+			for (list<Component*>::iterator comp = it->second.begin(); comp != it->second.end(); ++comp) {
+				if ((*comp)->isDestroyed()) ++stats.staleComponents;
+			}
+		}
+		for (unsigned q = 0; q < obj->fQueryAnswers.size(); ++q) bytes += vectorBytes(obj->fQueryAnswers[q]);
+		objects.add(1, bytes);
+
+		// local requests, by request
+		localRequests.add(0, vectorBytes(obj->fLocalRequests));
+		for (unsigned r = 0; r < obj->fLocalRequests.size(); ++r) {
+			unsigned count = obj->fLocalRequests[r].size();
+			if (count == 0) continue;
+			localRequests.add(count, listBytes(obj->fLocalRequests[r]));
+			stats.memoryByRequest[getRequestName(r)].add(count, listBytes(obj->fLocalRequests[r]));
+		}
+	}
+
+	// components, by type
+	MemoryUsage& components = stats.memoryByStructure["components"];
+	MemoryUsage& componentsByType = stats.memoryByStructure["components by type"];
+	componentsByType.add(0, vectorBytes(fComponentsByType));
+	for (unsigned t = 0; t < fComponentsByType.size(); ++t) {
+		vector<Component*> const & comps = fComponentsByType[t];
+		componentsByType.add(0, vectorBytes(comps));
+		if (comps.size() == 0) continue;
+		MemoryUsage& type = stats.memoryByComponentType[comps[0]->getName()];
+		for (unsigned i = 0; i < comps.size(); ++i) {
+			size_t bytes = comps[i]->getMemorySize();
+			components.add(1, bytes);
+			type.add(1, bytes);
+		}
+		stats.components += comps.size();
+	}
+
+	// global requests, by request
+	MemoryUsage& globalRequests = stats.memoryByStructure["global requests"];
+	globalRequests.add(0, vectorBytes(fGlobalRequests));
+	for (unsigned r = 0; r < fGlobalRequests.size(); ++r) {
+		unsigned count = fGlobalRequests[r].size();
+		if (count == 0) continue;
+		globalRequests.add(count, listBytes(fGlobalRequests[r]));
+		stats.memoryByRequest[getRequestName(r)].add(count, listBytes(fGlobalRequests[r]));
+	}
+
+	// requests for moves, and the postponed moves
+	MemoryUsage& moveRequests = stats.memoryByStructure["move requests"];
+	moveRequests.add(0, vectorBytes(fMoveRequests) + listBytes(fPendingMoves));
+	for (unsigned r = 0; r < fMoveRequests.size(); ++r) moveRequests.add(fMoveRequests[r].size(), listBytes(fMoveRequests[r]));
+
+	// requests by component, and the required components
+	MemoryUsage& requestsByComponent = stats.memoryByStructure["requests by component"];
+	requestsByComponent.add(0, hashMapBytes(fRequestsByComponentId) + hashMapBytes(fRequiredComponents));
+	for (hash_map<ComponentId, list<ComponentRequest> >::iterator it = fRequestsByComponentId.begin(); it != fRequestsByComponentId.end(); ++it) {
+		requestsByComponent.add(it->second.size(), listBytes(it->second));
+	}
+	for (hash_map<ObjectId, list<pair<ComponentId, Atom> > >::iterator it = fRequiredComponents.begin(); it != fRequiredComponents.end(); ++it) {
+		requestsByComponent.add(0, listBytes(it->second));
+	}
+
+	// request ids and locks
+	MemoryUsage& requestIds = stats.memoryByStructure["request ids"];
+	requestIds.add(fRequestIdCounter, vectorBytes(fRequestToId[0]) + vectorBytes(fRequestToId[1]) + vectorBytes(fIdToRequest[0]) + vectorBytes(fIdToRequest[1]));
+	MemoryUsage& requestLocks = stats.memoryByStructure["request locks"];
+	requestLocks.add(fRequestLocks.size(), vectorBytes(fRequestLocks));
+	for (unsigned r = 0; r < fRequestLocks.size(); ++r) {
+		requestLocks.add(0, listBytes(fRequestLocks[r].pendingLocalRequests) + listBytes(fRequestLocks[r].pendingGlobalRequests));
+	}
+
+	// groups
+	MemoryUsage& groups = stats.memoryByStructure["groups"];
+	groups.add(0, vectorBytes(fGroups));
+	for (unsigned g = 0; g < fGroups.size(); ++g) {
+		if (fGroups[g].members.size() > 0) groups.add(1, vectorBytes(fGroups[g].members));
+	}
+
+	// queries
+	MemoryUsage& queries = stats.memoryByStructure["queries"];
+	queries.add(0, vectorBytes(fQueries) + hashMapBytes(fQueriesByComponentId));
+	for (unsigned q = 0; q < fQueries.size(); ++q) {
+		unsigned count = fQueries[q].answers.size();
+		queries.add(count, vectorBytes(fQueries[q].answers) + count * sizeof(TypedQueryAnswer<int>));
+	}
+	for (hash_map<ComponentId, vector<AtomId> >::iterator it = fQueriesByComponentId.begin(); it != fQueriesByComponentId.end(); ++it) {
+		queries.add(0, vectorBytes(it->second));
+	}
+
+	// state channels
+	MemoryUsage& channels = stats.memoryByStructure["state channels"];
+	channels.add(0, vectorBytes(fStateChannels) + vectorBytes(fPendingChannels));
+	for (unsigned c = 0; c < fStateChannels.size(); ++c) {
+		if (fStateChannels[c] == 0) continue;
+		channels.add(fStateChannels[c]->values.size(), sizeof(StateChannel) + mapBytes(fStateChannels[c]->values) + vectorBytes(fStateChannels[c]->pending));
+	}
+
+	// batched messages, counted by pending message
+	MemoryUsage& batches = stats.memoryByStructure["batches"];
+	batches.add(0, vectorBytes(fBatches) + vectorBytes(fPendingBatches));
+	for (unsigned b = 0; b < fBatches.size(); ++b) {
+		if (fBatches[b] == 0) continue;
+		batches.add(fBatches[b]->pending.size(), sizeof(Batch) + vectorBytes(fBatches[b]->pending) + listBytes(fBatches[b]->components) + listBytes(fBatches[b]->types));
+	}
+
+	// change detection
+	MemoryUsage& changed = stats.memoryByStructure["changed components"];
+	changed.add(0, vectorBytes(fChangedComponents) + vectorBytes(fChangedTypes) + vectorBytes(fDeferredChanges) + vectorBytes(fSystemChanges));
+	for (unsigned t = 0; t < fChangedComponents.size(); ++t) {
+		changed.add(fChangedComponents[t].size(), vectorBytes(fChangedComponents[t]));
+	}
+
+	// timers
+	stats.memoryByStructure["timers"].add(fTimers.size(), fTimers.getMemorySize() + vectorBytes(fExpiredTimers));
+
+	// behaviors
+	MemoryUsage& behaviors = stats.memoryByStructure["behaviors"];
+	behaviors.add(0, hashMapBytes(fBehaviorsByComponentId) + vectorBytes(fWaitingBehaviors) + listBytes(fDeadBehaviors));
+	for (hash_map<ComponentId, list<Behavior*> >::iterator it = fBehaviorsByComponentId.begin(); it != fBehaviorsByComponentId.end(); ++it) {
+		behaviors.add(it->second.size(), listBytes(it->second));
+	}
+
+	// destruction queues
+	stats.memoryByStructure["destruction"].add(fDeadComponents.size() + fDeadObjects.size() + fDyingComponents.size() + fDyingObjects.size(),
+		listBytes(fDeadComponents) + listBytes(fDeadObjects) + fDyingComponents.size() * sizeof(Component*) + fDyingObjects.size() * sizeof(ObjectId));
+
+	return stats;
+}
@@ -1,207 +1,1116 @@
-
-#ifndef INC_OBJECTMANAGER
-#define INC_OBJECTMANAGER
-
-
-#include "Object.h"
-
-
-#include <hash_map>
-#include <list>
-#include <string>
-#include <boost/format.hpp>
-
-
-namespace Cistron {
-
-using std::list;
-using std::string;
-using std::pair;
-using stdext::hash_map;
-
-
-// the object manager manages all object entities, and performs communication between them
-class ObjectManager {
-
-	public:
-
-		// constructor/destructor
-		ObjectManager();
-		virtual ~ObjectManager();
-
-		// create a new object
-		ObjectId createObject();
-
-		// add a new component to an object
-		void addComponent(ObjectId, Component*);
-
-		// destroy object
-		void destroyObject(ObjectId);
-
-		// destroy a component
-		void destroyComponent(Component*);
-
-		// finalize an object, resolving the required components
-		void finalizeObject(ObjectId);
-
-
-		// register a unique name for an object
-		bool registerName(ObjectId, string name);
-
-		// get the id based on the unique name identified
-		ObjectId getObjectId(string name);
-
-
-
-		/**
-		 * REQUEST MESSAGES
-		 */
-
-		// register global requests
-		void registerGlobalRequest(ComponentRequest, RegisteredComponent reg);
-
-		// register a local request
-		void registerLocalRequest(ComponentRequest, RegisteredComponent reg);
-
-		// get all components of a given type in a given object
-		list<Component*> getComponents(ObjectId objId, string componentName) {
-			return fObjects[objId]->getComponents(componentName);
-		}
-
-
-		/**
-		 * SENDING MESSAGES
-		 */
-
-		// send global messages
-		inline void sendGlobalMessage(string msg, Component *component, boost::any payload) {
-			sendGlobalMessage(getExistingRequestId(REQ_MESSAGE, msg), Message(MESSAGE, component, payload));
-		}
-		inline void sendGlobalMessage(RequestId reqId, Component *component, boost::any payload) {
-			sendGlobalMessage(reqId, Message(MESSAGE, component, payload));
-		}
-		void sendGlobalMessage(RequestId reqId, Message const & msg);
-
-		// send local messages to another object
-		inline void sendMessageToObject(string msg, Component *component, ObjectId id, boost::any payload) {
-			fObjects[id]->sendMessage(getMessageRequestId(REQ_MESSAGE, msg), Message(MESSAGE, component, payload));
-		}
-		inline void sendMessageToObject(RequestId reqId, Component *component, ObjectId id) {
-			fObjects[id]->sendMessage(reqId, Message(MESSAGE, component));
-		}
-		inline void sendMessageToObject(RequestId reqId, Component *component, ObjectId id, boost::any payload) {
-			fObjects[id]->sendMessage(reqId, Message(MESSAGE, component, payload));
-		}
-		inline void sendMessageToObject(string name, Message const & msg, ObjectId id) {
-			fObjects[id]->sendMessage(getMessageRequestId(REQ_MESSAGE, name), msg);
-		}
-		inline void sendMessageToObject(RequestId reqId, Message const & msg, ObjectId id) {
-			fObjects[id]->sendMessage(reqId, msg);
-		}
-
-		// ask for a request id
-		RequestId getMessageRequestId(ComponentRequestType, string name);
-
-		/**
-		 * LOGGING
-		 */
-
-		// track a request
-		void trackRequest(RequestId, bool local, Component*);
-
-		// get request name
-		inline string getRequestById(ComponentRequestType type, RequestId reqId) {
-			return fIdToRequest[type][reqId];
-		}
-
-
-	private:
-
-		/**
-		 * REQUEST IDS
-		 */
-
-		// request id counter
-		RequestId fRequestIdCounter;
-
-		// mapping from a request to a unique id that identifies the request
-		hash_map<string, RequestId> fRequestToId[2];
-
-		// mapping from request id to the original request name
-		hash_map<RequestId, string> fIdToRequest[2];
-
-		// get an existing request id
-		RequestId getExistingRequestId(ComponentRequestType, string name);
-
-
-		/**
-		 * LOCKING MECHANISM
-		 */
-
-		// activate/release request lock
-		// locks are activated when the current request id is being iterated on, to avoid conflicts with iterators
-		void activateLock(RequestId);
-		void releaseLock(RequestId);
-
-		// number of active locks
-		int fNLocks;
-
-		// a request lock contains whether this request is at the moment locked
-		// a request is locked if currently, a message is being processed for this request
-		struct RequestLock {
-			bool locked;
-			list<pair<ComponentRequest, RegisteredComponent> > pendingLocalRequests;
-			list<pair<ComponentRequest, RegisteredComponent> > pendingGlobalRequests;
-			RequestLock() : locked(false) {};
-		};
-
-		// list of locked request id's
-		vector<RequestLock> fRequestLocks;
-
-		// list of pending destroyals
-		list<ObjectId> fDeadObjects;
-		list<Component*> fDeadComponents;
-
-		/**
-		 * OBJECTS
-		 */
-
-		// id counter
-		ObjectId fIdCounter;
-
-		// list of objects with their id's
-		vector<Object*> fObjects;
-
-		// mapping of objects to their unique name identified
-		hash_map<string, ObjectId> fObjectNameToId;
-
-		/**
-		 * REQUESTS
-		 */
-
-
-		// vector of global requests
-		vector<list<RegisteredComponent> > fGlobalRequests;
-
-		// list of required components which still need to be processed
-		hash_map<ObjectId, list<string> > fRequiredComponents;
-
-		// list of component requests, by component id
-		hash_map<ComponentId, list<ComponentRequest> > fRequestsByComponentId;
-
-
-		/**
-		 * ERROR PROCESSING
-		 */
-
-		// error function
-		void error(boost::format str);
-
-
-
-};
-
-};
-
-
-#endif
+
+#ifndef INC_OBJECTMANAGER
+#define INC_OBJECTMANAGER
+
+
+#include "Object.h"
+#include "TimerWheel.h"
+#include "Behavior.h"
+#include "Inbox.h"
+#include "Profiler.h"
+#include "Recorder.h"
+#include "Mirror.h"
+#include "Replication.h"
+#include "System.h"
+#include "Stats.h"
+
+
+#include <hash_map>
+#include <list>
+#include <deque>
+#include <string>
+#include <boost/format.hpp>
+#include <boost/thread/mutex.hpp>
+
+
+namespace Cistron {
+
+using std::list;
+using std::deque;
+using std::string;
+using std::pair;
+using stdext::hash_map;
+
+
+// how the object manager shuts down
+enum TeardownMode {
+	TEARDOWN_GRACEFUL = 0,
+	TEARDOWN_FAST = 1
+};
+
+
+// the object manager manages all object entities, and performs communication between them
+class ObjectManager {
+
+	public:
+
+		// constructor/destructor
+		// the inbox capacity and overflow policy define the backpressure on threads posting to the inbox
+		ObjectManager(unsigned inboxCapacity = 0, InboxOverflow inboxOverflow = INBOX_GROW);
+		virtual ~ObjectManager();
+
+		// create a new object
+		ObjectId createObject();
+
+		// add a new component to an object
+		void addComponent(ObjectId, Component*);
+
+		// destroy object
+		void destroyObject(ObjectId);
+
+		// destroy a component
+		void destroyComponent(Component*);
+
+		// finalize an object, resolving the required components
+		void finalizeObject(ObjectId);
+
+		// move a component to another object, with its local requests, answers, waiting behaviors and required components
+		// no CREATE or DESTROY messages are sent, only a MOVED message to the components that requested the moves of its type
+		void moveComponent(Component*, ObjectId);
+
+		// destroy every object and component, and release the storage - the object manager is empty afterwards
+		// a graceful teardown sends the DESTROY messages, like destroying every object does, and is what the destructor does
+		// a fast teardown sends no messages, runs no callbacks, and only marks the components destroyed
+		void shutdown(TeardownMode mode = TEARDOWN_GRACEFUL);
+
+
+		/**
+		 * INCREMENTAL DESTRUCTION
+		 * With a destruction budget, destroyed components and objects become invisible immediately:
+		 * they no longer receive messages, and are not returned by queries. The actual destruction,
+		 * with its DESTROY messages, happens in processDestruction, which destroys at most
+		 * the budget of components per call.
+		 */
+
+		// set the budget per call to processDestruction - a count or time of 0 means no limit on that
+		void setDestructionBudget(unsigned maxComponents, double maxSeconds = 0);
+
+		// destroy components and objects immediately again
+		void disableDestructionBudget();
+
+		// destroy pending components and objects within the budget, returns the number of components destroyed
+		// called at the start of every tick - does nothing from within a callback
+		unsigned processDestruction();
+
+		// number of components and objects waiting for destruction
+		inline unsigned getPendingDestructions() {
+			return fDyingComponents.size() + fDyingObjects.size();
+		}
+
+
+		/**
+		 * COMPACTION
+		 * After a lot of churn, objects still list their destroyed components. Compaction removes them, and the types
+		 * left without components, so iterating an object no longer skips them. With a compaction budget, a part of the
+		 * objects is visited at the end of every tick, continuing where the previous tick stopped.
+		 * This is all compaction does: components aren't moved into dense storage per type, because object ids and
+		 * component pointers are handles held by the application, which can't be rewritten. The stale entries left are
+		 * in the statistics.
+		 */
+
+		// set the budget per call to processCompaction - a count of entries or time of 0 means no limit on that
+		void setCompactionBudget(unsigned maxEntries, double maxSeconds = 0);
+
+		// no longer compact at the end of every tick
+		void disableCompaction();
+
+		// compact within the budget, returns the number of entries visited - called at the end of every tick
+		unsigned processCompaction();
+
+		// compact everything now - not from within a callback
+		void compact();
+
+
+		// register a unique name for an object
+		// object names aren't atoms, so they don't take atom ids, and looking up a name doesn't keep it
+		bool registerName(ObjectId, string const & name);
+
+		// get the id based on the unique name identified
+		ObjectId getObjectId(string const & name);
+
+
+
+		/**
+		 * GROUPS
+		 * Objects can be members of named groups. A message sent to a group is delivered to the local
+		 * requests of every member, in one pass over the members. Objects leave their groups when destroyed.
+		 */
+
+		// add an object to a group - returns false if it already is a member
+		bool joinGroup(ObjectId, Atom group);
+
+		// remove an object from a group - returns false if it isn't a member
+		bool leaveGroup(ObjectId, Atom group);
+
+		// is an object a member of a group?
+		bool isInGroup(ObjectId, Atom group);
+
+		// get the members of a group
+		vector<ObjectId> getGroupMembers(Atom group);
+
+
+		/**
+		 * REQUEST MESSAGES
+		 */
+
+		// register global requests
+		void registerGlobalRequest(ComponentRequest, RegisteredComponent reg);
+
+		// register a local request
+		void registerLocalRequest(ComponentRequest, RegisteredComponent reg);
+
+		// register a request for the moves of components of a type
+		void registerMoveRequest(Atom name, RegisteredComponent reg);
+
+		// get all components of a given type in a given object
+		list<Component*> getComponents(ObjectId objId, Atom componentName) {
+			return fObjects[objId]->getComponents(componentName);
+		}
+
+		// get all components of a given type that aren't destroyed yet, including dying ones - in no particular order
+		inline vector<Component*> const & getComponentsOfType(Atom type) {
+			if (fComponentsByType.size() <= type.getId()) fComponentsByType.resize(type.getId()+1);
+			return fComponentsByType[type.getId()];
+		}
+
+
+		/**
+		 * REDUCTIONS
+		 * Aggregate a field over all living components of a type. The operation must be associative and commutative:
+		 * values are combined in chunks, with independent accumulators, and in parallel in parallelReduce.
+		 */
+
+		// reduce a field, converted to the type of the initial value, with a binary operation
+		template<class T, class F, class V, class Op>
+		V reduce(Atom type, F T::*field, V init, Op op);
+
+		// reduce a field on the system threads - owning thread only, not from within a system
+		template<class T, class F, class V, class Op>
+		V parallelReduce(Atom type, F T::*field, V init, Op op);
+
+
+		/**
+		 * SENDING MESSAGES
+		 */
+
+		// send global messages
+		inline void sendGlobalMessage(Atom msg, Component *component, boost::any payload) {
+			sendGlobalMessage(getExistingRequestId(REQ_MESSAGE, msg), Message(MESSAGE, component, payload));
+		}
+		inline void sendGlobalMessage(RequestId reqId, Component *component, boost::any payload) {
+			sendGlobalMessage(reqId, Message(MESSAGE, component, payload));
+		}
+		void sendGlobalMessage(RequestId reqId, Message const & msg);
+
+		// send local messages to another object
+		inline void sendMessageToObject(Atom msg, Component *component, ObjectId id, boost::any payload) {
+			sendMessageToObject(getMessageRequestId(REQ_MESSAGE, msg), Message(MESSAGE, component, payload), id);
+		}
+		inline void sendMessageToObject(RequestId reqId, Component *component, ObjectId id) {
+			sendMessageToObject(reqId, Message(MESSAGE, component), id);
+		}
+		inline void sendMessageToObject(RequestId reqId, Component *component, ObjectId id, boost::any payload) {
+			sendMessageToObject(reqId, Message(MESSAGE, component, payload), id);
+		}
+		inline void sendMessageToObject(Atom name, Message const & msg, ObjectId id) {
+			sendMessageToObject(getMessageRequestId(REQ_MESSAGE, name), msg, id);
+		}
+		void sendMessageToObject(RequestId reqId, Message const & msg, ObjectId id);
+
+		// send local messages to every object in a group
+		inline void sendMessageToGroup(Atom group, Atom msg, Component *component, boost::any payload) {
+			sendMessageToGroup(group, getMessageRequestId(REQ_MESSAGE, msg), Message(MESSAGE, component, payload));
+		}
+		inline void sendMessageToGroup(Atom group, RequestId reqId, Component *component, boost::any payload) {
+			sendMessageToGroup(group, reqId, Message(MESSAGE, component, payload));
+		}
+		void sendMessageToGroup(Atom group, RequestId reqId, Message const & msg);
+
+		// ask for a request id
+		RequestId getMessageRequestId(ComponentRequestType, Atom name);
+
+
+		/**
+		 * QUERIES
+		 * A query is a message the receivers answer with a value, instead of sending replies back. The answers are
+		 * folded into the initial value in no particular order, so the operation must be associative and commutative.
+		 * Every answer to a query has the same type, the one the query was first answered with.
+		 */
+
+		// register the answer of a component to a query - the answer is owned by the object manager
+		void registerQuery(Atom query, QueryAnswer*, std::type_info const & type);
+
+		// ask every component answering a query
+		template<class R, class Op>
+		R ask(Atom query, Component *sender, boost::any payload, R init, Op op);
+
+		// ask the components of an object
+		template<class R, class Op>
+		R askObject(ObjectId, Atom query, Component *sender, boost::any payload, R init, Op op);
+
+		// ask the components of every object in a group
+		template<class R, class Op>
+		R askGroup(Atom group, Atom query, Component *sender, boost::any payload, R init, Op op);
+
+
+		/**
+		 * CHANGE DETECTION
+		 * Components mark themselves changed, with Component::markChanged or a Tracked field. The changed components
+		 * are kept per type until the end of the tick, so systems can process what changed instead of every component.
+		 * Changes made by systems are also kept in the changed sets of the next tick, so the systems that ran before
+		 * the writer, or in parallel with it, see them too.
+		 */
+
+		// add a component to the changed set of its type - called by Component::markChanged
+		void markChanged(Component*);
+
+		// call a function for every living component of a type that changed in this tick, as a T*
+		template<class T, class F>
+		void forEachChanged(Atom type, F f);
+
+		// number of components of a type marked changed in this tick
+		inline unsigned getChangedCount(Atom type) {
+			return fChangedComponents.size() > type.getId() ? fChangedComponents[type.getId()].size() : 0;
+		}
+
+		// get the components of a type marked changed in this tick, including dying ones
+		vector<Component*> const & getChangedComponents(Atom type);
+
+		// forget the changes - called at the end of every tick
+		void clearChanged();
+
+
+		/**
+		 * SYSTEMS
+		 * Systems run once per tick, after the scheduled messages, in parallel where their declared types allow it.
+		 * Messages and structural changes they post to the inbox are executed at the sync point after the last system.
+		 * Changes recorded in the command buffer of a system are executed first, in the order the systems were added.
+		 */
+
+		// add/remove a system - systems are owned by the caller
+		void addSystem(System*);
+		bool removeSystem(System*);
+
+		// set the number of threads running systems, including the thread calling tick - 0 for the number of cores
+		inline void setSystemThreads(unsigned threads) {
+			fSystems.setThreads(threads);
+		}
+
+		// run the systems and the sync point - called every tick
+		void runSystems(Time dt);
+
+
+		/**
+		 * STATE CHANNELS
+		 * A state channel is a global message of which only the last value of every sender matters.
+		 * Sends are delivered once per sender at the end of the tick, with the last value sent, and the last value
+		 * of every sender is cached: components requesting the message receive the cached values immediately.
+		 */
+
+		// make a global message a state channel
+		void registerStateChannel(Atom msg);
+
+		// deliver the values sent to the state channels since the last delivery - called at the end of every tick
+		void flushStateChannels();
+
+
+		/**
+		 * BATCHED MESSAGES
+		 * Batch handlers receive the global messages of a request once per flush instead of once per message, so they can
+		 * process them in one loop. A component receives every message sent since the last flush in one call, and a type
+		 * handler receives every living component of a type with each message. The messages are still delivered to the
+		 * ordinary requests when they are sent. Batches are flushed at the end of every tick, after the state channels.
+		 */
+
+		// receive the messages of a request sent since the last flush - called by Component::requestMessageBatch
+		void registerMessageBatch(Atom msg, Component*, MessageBatchFunction);
+
+		// handle the messages of a request for every living component of a type at once - the handler lives as long as the object manager
+		void registerTypeBatch(Atom msg, Atom type, ReceiverBatchFunction);
+
+		// deliver the messages sent since the last flush - called at the end of every tick
+		void flushBatches();
+
+
+		/**
+		 * TIMED MESSAGES
+		 */
+
+		// schedule a message to be sent after a delay, and then every period time units if the period isn't 0
+		// the target is the object the message is sent to, or -1 to send a global message
+		// the timer is cancelled when it expires after its sender or target started being destroyed
+		TimerId scheduleMessage(RequestId reqId, Component *component, ObjectId target, boost::any payload, Time delay, Time period = 0);
+
+		// cancel a scheduled message
+		bool cancelMessage(TimerId);
+
+		// advance the time, sending all scheduled messages that expire
+		void tick(Time dt);
+
+		// get the current time
+		inline Time getTime() {
+			return fTimers.getTime();
+		}
+
+
+		/**
+		 * BEHAVIORS
+		 */
+
+		// start a behavior owned by a component
+		void startBehavior(Component*, Behavior*);
+
+		// suspend a behavior until an event happens
+		void awaitBehavior(Behavior*, Awaitable const &);
+
+
+		/**
+		 * INBOXES
+		 * The object manager is owned by one thread. Other threads post messages and structural commands to an inbox,
+		 * which are executed by the owning thread when it calls processInbox.
+		 */
+
+		// get the inbox of the object manager
+		inline Inbox* getInbox() {
+			return &fInbox;
+		}
+
+		// get the inbox of an object, creating it if it doesn't exist yet - owning thread only
+		// every call must be matched by a call to Inbox::release. When the object is destroyed, the inbox is closed:
+		// the commands posted until then are still executed, later ones are rejected
+		Inbox* getObjectInbox(ObjectId, unsigned capacity = 0, InboxOverflow overflow = INBOX_GROW);
+
+		// execute the commands posted until now, returns the number of commands executed
+		unsigned processInbox();
+
+		/**
+		 * COMMAND BUFFERS
+		 * Threads that work in parallel record their structural changes in a command buffer of their own instead of
+		 * posting them to an inbox. The owning thread executes the buffers at a sync point, in the order of their keys,
+		 * so the ids of the created objects and the order of the changes are the same in every run.
+		 */
+
+		// execute the commands of a buffer, which is cleared - owning thread only
+		unsigned executeCommands(CommandBuffer&);
+
+		// execute buffers in the order of their keys, buffers with the same key in the given order - owning thread only
+		unsigned executeCommands(vector<CommandBuffer*> const &);
+
+		/**
+		 * STAGING
+		 * A world can be built in parallel, in staging object managers that are each owned by one thread, and merged into
+		 * this one by its owning thread. The objects of a staging object manager move in one block after the existing ones,
+		 * with their components, requests, answers, names and groups. The CREATE messages between the merged components and
+		 * the existing ones are sent in bulk per component type, like each side had requested the other's components.
+		 * A merge still visits every staged object, component and request to rebase their ids, so it takes time linear in
+		 * the size of the staging object manager, not constant time per block.
+		 */
+
+		// merge a staging object manager, which is empty afterwards - returns the offset added to the ids of its objects
+		// the staging object manager can't have timers, behaviors, state channels, inboxes, or pending destructions, moves or batches
+		// names already registered here keep their object, and merges aren't recorded
+		ObjectId merge(ObjectManager& staging);
+
+		/**
+		 * LOGGING
+		 */
+
+		// track a request
+		void trackRequest(RequestId, bool local, Component*);
+
+		// get request name
+		inline Atom getRequestById(ComponentRequestType type, RequestId reqId) {
+			return fIdToRequest[type][reqId];
+		}
+
+		// record dispatches, callbacks and structural changes in a profiler - 0 to stop profiling
+		// the profiler is owned by the caller
+		inline void setProfiler(Profiler *profiler) {
+			fProfiler = profiler;
+		}
+		inline Profiler* getProfiler() {
+			return fProfiler;
+		}
+
+		// record the operations performed from the outside in a recorder - 0 to stop recording
+		// the recorder is owned by the caller
+		inline void setRecorder(Recorder *recorder) {
+			fRecorder = recorder;
+		}
+		inline Recorder* getRecorder() {
+			return fRecorder;
+		}
+
+		// publish the state of components in a shared memory mirror at the end of every tick - 0 to stop publishing
+		// the mirror is owned by the caller
+		inline void setMirror(Mirror *mirror) {
+			fMirror = mirror;
+		}
+		inline Mirror* getMirror() {
+			return fMirror;
+		}
+
+		// publish a snapshot in the mirror now
+		void publishMirror();
+
+		// send the changes of replicated components to a replica at the end of every tick - 0 to stop replicating
+		// keep it attached for the whole stream, changes made while no replicator is attached are not sent
+		// the replicator is owned by the caller
+		inline void setReplicator(Replicator *replicator) {
+			fReplicator = replicator;
+		}
+		inline Replicator* getReplicator() {
+			return fReplicator;
+		}
+
+		// send a replication frame now
+		void replicate();
+
+		// take a snapshot of the statistics, with the memory used by every structure
+		ObjectManagerStats getStats();
+
+		// get a component by type and index among the components of that type in the object, including dying ones
+		// destroyed components are skipped, so the indices don't change when the object is compacted
+		// returns 0 if there is no such component
+		Component* getComponent(ObjectId, Atom type, unsigned ordinal);
+
+		// get the index of a component among the components of its type in its object
+		unsigned getComponentOrdinal(Component*);
+
+
+	private:
+
+		/**
+		 * REQUEST IDS
+		 */
+
+		// request id counter
+		RequestId fRequestIdCounter;
+
+		// mapping from a request to a unique id that identifies the request, indexed by the atom id of the request name
+		vector<RequestId> fRequestToId[2];
+
+		// mapping from request id to the original request name
+		vector<Atom> fIdToRequest[2];
+
+		// get an existing request id
+		RequestId getExistingRequestId(ComponentRequestType, Atom name);
+
+		// get the type and name of a request id, for the statistics
+		string getRequestName(RequestId);
+
+		// send a global message to the components that requested it
+		void dispatchGlobalMessage(RequestId reqId, Message const & msg);
+
+
+		/**
+		 * LOCKING MECHANISM
+		 */
+
+		// activate/release request lock
+		// locks are activated when the current request id is being iterated on, to avoid conflicts with iterators
+		void activateLock(RequestId);
+		void releaseLock(RequestId);
+
+		// number of active locks
+		int fNLocks;
+
+		// a request lock contains whether this request is at the moment locked
+		// a request is locked if currently, a message is being processed for this request
+		struct RequestLock {
+			bool locked;
+			list<pair<ComponentRequest, RegisteredComponent> > pendingLocalRequests;
+			list<pair<ComponentRequest, RegisteredComponent> > pendingGlobalRequests;
+			RequestLock() : locked(false) {};
+		};
+
+		// list of locked request id's
+		vector<RequestLock> fRequestLocks;
+
+		// list of pending destroyals
+		list<ObjectId> fDeadObjects;
+		list<Component*> fDeadComponents;
+
+		// destroy an object or component now, or as soon as there are no locks
+		void destroyObjectNow(ObjectId);
+		void destroyComponentNow(Component*);
+
+		// list of pending moves
+		list<pair<Component*, ObjectId> > fPendingMoves;
+
+		// move a component now, or as soon as there are no locks
+		void moveComponentNow(Component*, ObjectId);
+
+		// move, then destroy the components and objects whose move or destruction was postponed, if there are no locks
+		void processPending();
+
+
+		/**
+		 * INCREMENTAL DESTRUCTION
+		 */
+
+		// is there a destruction budget?
+		bool fIncrementalDestruction;
+
+		// budget
+		unsigned fDestructionMaxComponents;
+		double fDestructionMaxSeconds;
+
+		// components and objects waiting for destruction
+		deque<Component*> fDyingComponents;
+		deque<ObjectId> fDyingObjects;
+
+		// remaining components of the first dying object, once its destruction started
+		bool fDestroyingObject;
+		list<Component*> fDyingObjectComponents;
+
+		/**
+		 * COMPACTION
+		 */
+
+		// is there a compaction budget?
+		bool fCompaction;
+
+		// budget
+		unsigned fCompactionMaxEntries;
+		double fCompactionMaxSeconds;
+
+		// the object where the next compaction continues
+		unsigned fCompactionCursor;
+
+		// compact until the budget is spent, or every object was visited once
+		unsigned compactStorage(unsigned maxEntries, double maxSeconds);
+
+		// remove the destroyed components from an object
+		unsigned compactObject(Object*);
+
+		/**
+		 * OBJECTS
+		 */
+
+		// id counter
+		ObjectId fIdCounter;
+
+		// list of objects with their id's
+		vector<Object*> fObjects;
+
+		// components that aren't destroyed, by atom id of their type
+		vector<vector<Component*> > fComponentsByType;
+
+		// mapping of objects to their unique name identified
+		hash_map<string, ObjectId> fObjectNameToId;
+
+		/**
+		 * GROUPS
+		 */
+
+		// a group - members that leave while a message is sent to the group are set to -1, and removed afterwards
+		struct Group {
+			vector<ObjectId> members;
+			int locks;
+			bool dirty;
+			Group() : locks(0), dirty(false) {};
+		};
+
+		// groups, by atom id of the group name
+		vector<Group> fGroups;
+
+		// remove an object from a group it is a member of
+		void removeFromGroup(ObjectId, AtomId group);
+
+		// remove the members that left while the group was locked
+		void compactGroup(AtomId);
+
+		// remove an object from all its groups
+		void leaveGroups(ObjectId);
+
+		/**
+		 * CHANGE DETECTION
+		 */
+
+		// changed components, by atom id of their type
+		vector<vector<Component*> > fChangedComponents;
+
+		// types with changed components
+		vector<AtomId> fChangedTypes;
+
+		// serial of the current changed sets, a component is in them if it has the same serial
+		unsigned fChangeSerial;
+
+		/**
+		 * SYSTEMS
+		 */
+
+		// scheduler and the context the systems run in
+		SystemScheduler fSystems;
+		SystemContext fSystemContext;
+
+		// are systems running on other threads?
+		bool fRunningSystems;
+
+		// components marked changed while systems were running, added to the changed sets at the sync point
+		vector<Component*> fDeferredChanges;
+		boost::mutex fDeferredChangesMutex;
+
+		// the changes of the systems in this tick, marked again at the start of the next one
+		vector<Component*> fSystemChanges;
+
+		/**
+		 * QUERIES
+		 */
+
+		// a query - the type of its answers, and the answers
+		struct Query {
+			std::type_info const *type;
+			vector<QueryAnswer*> answers;
+			Query() : type(0) {};
+		};
+
+		// queries by atom id of the query name
+		vector<Query> fQueries;
+
+		// queries answered by a component, by component id
+		hash_map<ComponentId, vector<AtomId> > fQueriesByComponentId;
+
+		// does any component answer a query? - the answers must have the given type
+		bool isAnswered(Atom query, std::type_info const & type);
+
+		// get the answers to a query of an object, or of every object for -1 - empty if the object is dying
+		vector<QueryAnswer*> const & getAnswers(ObjectId, AtomId query);
+
+		// remove the answers of a component
+		void removeAnswers(Component*);
+
+		// fold the answers to a query of an object, or of every object for -1
+		template<class R, class Op>
+		R foldAnswers(ObjectId, AtomId query, Message const & msg, R result, Op op);
+
+		/**
+		 * STATE CHANNELS
+		 */
+
+		// last value of a sender
+		struct StateValue {
+			Component *sender;
+			boost::any payload;
+			bool pending;
+		};
+
+		// a state channel - the values are ordered by component id, so they are delivered in a deterministic order
+		struct StateChannel {
+			map<ComponentId, StateValue> values;
+			vector<ComponentId> pending;
+		};
+
+		// state channels by request id, 0 if the message isn't a state channel
+		vector<StateChannel*> fStateChannels;
+
+		// request ids of the channels with pending values
+		vector<RequestId> fPendingChannels;
+
+		// is a message a state channel?
+		inline bool isStateChannel(RequestId reqId) {
+			return fStateChannels.size() > (unsigned)reqId && fStateChannels[reqId] != 0;
+		}
+
+		// send the cached values of a state channel to a component that requested it
+		void replayStateChannel(RequestId, RegisteredComponent&);
+
+		/**
+		 * BATCHED MESSAGES
+		 */
+
+		// a batched message - the messages sent since the last flush, and the handlers
+		struct Batch {
+			vector<Message> pending;
+			list<pair<Component*, MessageBatchFunction> > components;
+			list<pair<AtomId, ReceiverBatchFunction> > types;
+		};
+
+		// batches by request id, 0 if the message isn't batched
+		vector<Batch*> fBatches;
+
+		// request ids of the batches with pending messages
+		vector<RequestId> fPendingBatches;
+
+		// is a message batched?
+		inline bool isBatched(RequestId reqId) {
+			return fBatches.size() > (unsigned)reqId && fBatches[reqId] != 0;
+		}
+
+		// get the batch of a message, creating it if needed
+		Batch* getBatch(Atom msg);
+
+		/**
+		 * STAGING
+		 */
+
+		// a component type in a merge - the components and requesters from the staging object manager come after the existing ones
+		struct MergedType {
+			RequestId reqId;
+			AtomId type;
+			unsigned components, allComponents;
+			unsigned requesters, allRequesters;
+		};
+
+		/**
+		 * REQUESTS
+		 */
+
+
+		// vector of global requests
+		vector<list<RegisteredComponent> > fGlobalRequests;
+
+		// requests for the moves of components, by request id of the component type
+		vector<list<RegisteredComponent> > fMoveRequests;
+
+		// list of required components which still need to be processed, with the component that requires them
+		hash_map<ObjectId, list<pair<ComponentId, Atom> > > fRequiredComponents;
+
+		// list of component requests, by component id
+		hash_map<ComponentId, list<ComponentRequest> > fRequestsByComponentId;
+
+
+		/**
+		 * TIMERS
+		 */
+
+		// timer wheel with the scheduled messages
+		TimerWheel fTimers;
+
+		// timers expiring in the current time unit
+		vector<TimerId> fExpiredTimers;
+
+		// are we processing a tick?
+		bool fTicking;
+
+
+		/**
+		 * BEHAVIORS
+		 */
+
+		// behaviors waiting for a global event, by request id
+		vector<Behavior*> fWaitingBehaviors;
+
+		// behaviors by the id of the component that owns them
+		hash_map<ComponentId, list<Behavior*> > fBehaviorsByComponentId;
+
+		// behaviors that died while behaviors were being resumed, deleted when the outermost resume returns
+		list<Behavior*> fDeadBehaviors;
+
+		// number of nested resumes
+		int fResumeDepth;
+
+		// get the head of the global (0) or local (1) wait list a behavior is waiting in
+		Behavior*& getWaitingBehaviors(Behavior*, int scope);
+
+		// add/remove a behavior to/from the wait lists
+		void linkBehavior(Behavior*, int scope);
+		void unlinkBehavior(Behavior*);
+
+		// resume a behavior
+		void resumeBehavior(Behavior*, Message const &);
+
+		// resume all behaviors waiting for a global (0) or local (1) event
+		void resumeBehaviors(int scope, ObjectId, RequestId, MessageType, Message const &);
+
+		// stop a behavior
+		void killBehavior(Behavior*);
+
+		// delete the dead behaviors, if no behaviors are being resumed
+		void deleteDeadBehaviors();
+
+
+		/**
+		 * INBOXES
+		 */
+
+		// inbox of the object manager
+		Inbox fInbox;
+
+		// inboxes of living objects, by object id
+		map<ObjectId, Inbox*> fObjectInboxes;
+
+		// inboxes of destroyed objects, executed once more and then released
+		vector<Inbox*> fClosedInboxes;
+
+		// close the inbox of a destroyed object
+		void closeObjectInbox(ObjectId);
+
+		// execute the commands in an inbox
+		unsigned processInbox(Inbox&);
+
+		// execute a posted command
+		void executeCommand(InboxCommand&);
+
+
+		/**
+		 * ERROR PROCESSING
+		 */
+
+		// error function
+		void error(boost::format str);
+
+
+		/**
+		 * PROFILING
+		 */
+
+		// active profiler, if any
+		Profiler *fProfiler;
+
+
+		/**
+		 * RECORDING
+		 */
+
+		// active recorder, if any
+		Recorder *fRecorder;
+
+		// depth of nested operations - only operations at depth 0 are recorded
+		int fRecordDepth;
+
+		// are we recording this operation?
+		inline bool isRecording() {
+			return fRecorder != 0 && fRecordDepth == 0;
+		}
+
+		// an operation in progress, nested operations are its consequences
+		struct RecordScope {
+			int& depth;
+			RecordScope(int& d) : depth(d) { ++depth; }
+			~RecordScope() { --depth; }
+		};
+
+
+		/**
+		 * MIRRORING
+		 */
+
+		// active mirror, if any
+		Mirror *fMirror;
+
+		// active replicator, if any
+		Replicator *fReplicator;
+
+		// get every living component of the given types
+		void getLiveComponents(vector<Atom> const & types, vector<Component*>& comps);
+
+		// buffer for the living components
+		vector<Component*> fLiveComponents;
+
+
+		/**
+		 * REDUCTIONS
+		 */
+
+		// number of values gathered before they are reduced
+		static const unsigned ReduceChunk = 256;
+
+		// the result of reducing a range, if there were living components in it - a struct, so every task has its own
+		// even when V is bool
+		template<class V>
+		struct ReducedRange {
+			V value;
+			bool found;
+			ReducedRange() : found(false) {};
+		};
+
+		// reduce a range of components - returns false if there were no living components in it
+		template<class T, class F, class V, class Op>
+		static bool reduceRange(vector<Component*> const * comps, unsigned begin, unsigned end, F T::*field, Op op, ReducedRange<V> *result);
+
+
+
+};
+
+
+/**
+ * TEMPLATED REDUCTIONS
+ */
+
+// reduce a range
+template<class T, class F, class V, class Op>
+bool ObjectManager::reduceRange(vector<Component*> const * comps, unsigned begin, unsigned end, F T::*field, Op op, ReducedRange<V> *result) {
+	result->found = false;
+	V values[ReduceChunk];
+	for (unsigned i = begin; i < end; ) {
+
+		// gather the values of a chunk, so they are reduced from contiguous memory
+		unsigned n = 0;
+		for (; i < end && n < ReduceChunk; ++i) {
+			Component *comp = (*comps)[i];
+			if (comp->isDying()) continue;
+			values[n++] = static_cast<T*>(comp)->*field;
+		}
+		if (n == 0) continue;
+
+		// reduce them with four independent accumulators
+		V lanes[4] = { values[0], values[0], values[0], values[0] };
+		unsigned k = 1;
+		if (n >= 4) {
+			lanes[1] = values[1];
+			lanes[2] = values[2];
+			lanes[3] = values[3];
+			for (k = 4; k + 4 <= n; k += 4) {
+				lanes[0] = op(lanes[0], values[k]);
+				lanes[1] = op(lanes[1], values[k+1]);
+				lanes[2] = op(lanes[2], values[k+2]);
+				lanes[3] = op(lanes[3], values[k+3]);
+			}
+			lanes[0] = op(op(lanes[0], lanes[1]), op(lanes[2], lanes[3]));
+		}
+		for (; k < n; ++k) lanes[0] = op(lanes[0], values[k]);
+
+		// combine with the previous chunks
+		result->value = result->found ? op(result->value, lanes[0]) : lanes[0];
+		result->found = true;
+	}
+	return result->found;
+}
+
+// reduce a field
+template<class T, class F, class V, class Op>
+V ObjectManager::reduce(Atom type, F T::*field, V init, Op op) {
+	vector<Component*> const & comps = getComponentsOfType(type);
+	ReducedRange<V> result;
+	if (!reduceRange<T, F, V, Op>(&comps, 0, comps.size(), field, op, &result)) return init;
+	return op(init, result.value);
+}
+
+// reduce a field in parallel
+template<class T, class F, class V, class Op>
+V ObjectManager::parallelReduce(Atom type, F T::*field, V init, Op op) {
+	vector<Component*> const & comps = getComponentsOfType(type);
+
+	// a few tasks per thread, of at least a chunk each
+	unsigned tasks = fSystems.getThreads() * 4;
+	unsigned size = (comps.size() + tasks - 1) / tasks;
+	if (size < ReduceChunk) size = ReduceChunk;
+
+	// reduce the ranges
+	vector<ReducedRange<V> > results((comps.size() + size - 1) / size);
+	vector<boost::function<void()> > work;
+	for (unsigned i = 0; i < results.size(); ++i) {
+		unsigned end = (i + 1) * size < comps.size() ? (i + 1) * size : comps.size();
+		work.push_back(boost::bind(&ObjectManager::reduceRange<T, F, V, Op>, &comps, i * size, end, field, op, &results[i]));
+	}
+	fSystems.runParallel(work);
+
+	// combine them
+	V result = init;
+	for (unsigned i = 0; i < results.size(); ++i) {
+		if (results[i].found) result = op(result, results[i].value);
+	}
+	return result;
+}
+
+
+/**
+ * TEMPLATED QUERIES
+ */
+
+// fold answers - answers registered meanwhile aren't asked, and answers are only removed when there are no locks
+template<class R, class Op>
+R ObjectManager::foldAnswers(ObjectId id, AtomId query, Message const & msg, R result, Op op) {
+	unsigned size = getAnswers(id, query).size();
+	for (unsigned i = 0; i < size; ++i) {
+
+		// the answers are indexed every time, answering may register other answers
+		TypedQueryAnswer<R> *answer = static_cast<TypedQueryAnswer<R>*>(getAnswers(id, query)[i]);
+		if (answer->component->isDying()) continue;
+		ProfileScope profileCallback(fProfiler, msg.sender, answer->component);
+		result = op(result, answer->f(msg));
+	}
+	return result;
+}
+
+// ask every component answering a query
+template<class R, class Op>
+R ObjectManager::ask(Atom query, Component *sender, boost::any payload, R init, Op op) {
+	if (!isAnswered(query, typeid(R))) return init;
+	ProfileScope profile(fProfiler, PROFILE_MESSAGE, query, sender);
+
+	// lock, so components destroyed by the answers are destroyed afterwards
+	++fNLocks;
+	R result = foldAnswers(-1, query.getId(), Message(MESSAGE, sender, payload), init, op);
+	--fNLocks;
+	processPending();
+	return result;
+}
+
+// ask the components of an object
+template<class R, class Op>
+R ObjectManager::askObject(ObjectId id, Atom query, Component *sender, boost::any payload, R init, Op op) {
+	if (!isAnswered(query, typeid(R)) || id < 0) return init;
+	ProfileScope profile(fProfiler, PROFILE_MESSAGE, query, sender, id);
+
+	// lock
+	++fNLocks;
+	R result = foldAnswers(id, query.getId(), Message(MESSAGE, sender, payload), init, op);
+	--fNLocks;
+	processPending();
+	return result;
+}
+
+// ask the components of every object in a group
+template<class R, class Op>
+R ObjectManager::askGroup(Atom group, Atom query, Component *sender, boost::any payload, R init, Op op) {
+	if (!isAnswered(query, typeid(R)) || fGroups.size() <= group.getId()) return init;
+	ProfileScope profile(fProfiler, PROFILE_MESSAGE, query, sender);
+
+	// lock, and lock the group, so members leaving don't move the others
+	++fNLocks;
+	++fGroups[group.getId()].locks;
+	Message msg(MESSAGE, sender, payload);
+	R result = init;
+	unsigned size = fGroups[group.getId()].members.size();
+	for (unsigned i = 0; i < size; ++i) {
+		ObjectId id = fGroups[group.getId()].members[i];
+		if (id >= 0) result = foldAnswers(id, query.getId(), msg, result, op);
+	}
+
+	// unlock
+	Group& unlocked = fGroups[group.getId()];
+	if (--unlocked.locks == 0 && unlocked.dirty) compactGroup(group.getId());
+	--fNLocks;
+	processPending();
+	return result;
+}
+
+// ask from a component
+template<class R, class Op>
+R Component::ask(Atom query, Op op, R init, boost::any payload) {
+	return fObjectManager->ask(query, this, payload, init, op);
+}
+template<class R, class Op>
+R Component::askObject(ObjectId id, Atom query, Op op, R init, boost::any payload) {
+	return fObjectManager->askObject(id, query, this, payload, init, op);
+}
+template<class R, class Op>
+R Component::askGroup(Atom group, Atom query, Op op, R init, boost::any payload) {
+	return fObjectManager->askGroup(group, query, this, payload, init, op);
+}
+
+
+/**
+ * TEMPLATED CHANGE DETECTION
+ */
+
+// iterate the changed components of a type
+template<class T, class F>
+void ObjectManager::forEachChanged(Atom type, F f) {
+
+	// the function may mark other components changed, so the set is indexed every time
+	for (unsigned i = 0; i < getChangedCount(type); ++i) {
+		Component *comp = fChangedComponents[type.getId()][i];
+		if (comp->isDying() || !comp->isValid()) continue;
+		f(static_cast<T*>(comp));
+	}
+}
+
+
+};
+
+
+#endif
@@ -0,0 +1,115 @@
+
+#include "Profiler.h"
+
+
+using namespace Cistron;
+
+
+#include <fstream>
+#include <iomanip>
+
+
+// category names, in the order of ProfileCategory
+static const char *CategoryNames[] = { "tick", "message", "callback", "structure", "destruction" };
+
+
+// write a string as a JSON string
+static void writeString(ostream& s, string const & str) {
+	s << '"';
+	for (unsigned i = 0; i < str.size(); ++i) {
+		char c = str[i];
+		if (c == '"' || c == '\\') s << '\\' << c;
+		else if (c >= 0 && c < 0x20) s << ' ';
+		else s << c;
+	}
+	s << '"';
+}
+
+
+// constructor/destructor
+Profiler::Profiler() : fStart(boost::chrono::steady_clock::now()) {
+}
+Profiler::~Profiler() {
+}
+
+
+// time since start
+double Profiler::now() {
+	return boost::chrono::duration<double, boost::micro>(boost::chrono::steady_clock::now() - fStart).count();
+}
+
+
+// begin a span
+unsigned Profiler::begin(ProfileCategory category, Atom name, Component *sender, Component *receiver, ObjectId object) {
+	Span span;
+	span.category = category;
+	span.name = name;
+	span.senderObject = -1;
+	span.receiverObject = object;
+	if (sender != 0) {
+		span.senderType = sender->getNameAtom();
+		span.senderObject = sender->getOwnerId();
+	}
+	if (receiver != 0) {
+		span.receiverType = receiver->getNameAtom();
+		span.receiverObject = receiver->getOwnerId();
+	}
+	span.duration = 0;
+	span.start = now();
+	fSpans.push_back(span);
+	return fSpans.size() - 1;
+}
+
+
+// end a span
+void Profiler::end(unsigned span) {
+	if (span >= fSpans.size()) return;
+	fSpans[span].duration = now() - fSpans[span].start;
+}
+
+
+// forget everything
+void Profiler::clear() {
+	fSpans.clear();
+}
+
+
+// write the trace as complete ("X") events
+void Profiler::write(ostream& s) {
+	s << std::fixed << std::setprecision(3);
+	s << "{\"traceEvents\":[" << std::endl;
+	for (unsigned i = 0; i < fSpans.size(); ++i) {
+		Span& span = fSpans[i];
+		if (i > 0) s << "," << std::endl;
+		s << "{\"name\":";
+		writeString(s, span.name.str());
+		s << ",\"cat\":\"" << CategoryNames[span.category] << "\",\"ph\":\"X\",\"pid\":1,\"tid\":1";
+		s << ",\"ts\":" << span.start << ",\"dur\":" << span.duration << ",\"args\":{";
+		bool first = true;
+		if (span.senderType.isValid()) {
+			s << "\"sender\":";
+			writeString(s, span.senderType.str());
+			s << ",\"senderObject\":" << span.senderObject;
+			first = false;
+		}
+		if (span.receiverType.isValid()) {
+			if (!first) s << ",";
+			s << "\"receiver\":";
+			writeString(s, span.receiverType.str());
+			s << ",\"receiverObject\":" << span.receiverObject;
+			first = false;
+		}
+		else if (span.receiverObject >= 0) {
+			if (!first) s << ",";
+			s << "\"object\":" << span.receiverObject;
+		}
+		s << "}}";
+	}
+	s << std::endl << "]}" << std::endl;
+}
+bool Profiler::write(string const & filename) {
+	std::ofstream file(filename.c_str());
+	if (!file.is_open()) return false;
+	write(file);
+	return file.good();
+}
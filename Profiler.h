@@ -0,0 +1,115 @@
+
+#ifndef INC_PROFILER
+#define INC_PROFILER
+
+#include "Component.h"
+
+
+#include <vector>
+#include <string>
+#include <ostream>
+#include <boost/chrono.hpp>
+
+
+namespace Cistron {
+
+using std::vector;
+using std::string;
+using std::ostream;
+
+
+// category of a profiled span
+enum ProfileCategory {
+	PROFILE_TICK = 0,
+	PROFILE_MESSAGE = 1,
+	PROFILE_CALLBACK = 2,
+	PROFILE_STRUCTURE = 3,
+	PROFILE_DESTRUCTION = 4
+};
+
+
+// the profiler records nested spans of the object manager activity (dispatches, callbacks, structural changes)
+// and writes them as a Chrome trace (JSON), which can be loaded in chrome://tracing or Perfetto
+class Profiler {
+
+	public:
+
+		// constructor/destructor
+		Profiler();
+		virtual ~Profiler();
+
+		// begin a span - returns a handle to end it
+		// the sender and receiver components are optional, the object is the target object of the span, if any
+		unsigned begin(ProfileCategory, Atom name, Component *sender = 0, Component *receiver = 0, ObjectId object = -1);
+
+		// end a span
+		void end(unsigned span);
+
+		// write the trace
+		void write(ostream&);
+		bool write(string const & filename);
+
+		// forget all recorded spans
+		void clear();
+
+		// number of recorded spans
+		inline unsigned size() {
+			return fSpans.size();
+		}
+
+	private:
+
+		// a recorded span
+		struct Span {
+			ProfileCategory category;
+			Atom name;
+			Atom senderType;
+			ObjectId senderObject;
+			Atom receiverType;
+			ObjectId receiverObject;
+			double start;
+			double duration;
+		};
+
+		// time since the profiler started, in microseconds
+		double now();
+
+		// recorded spans
+		vector<Span> fSpans;
+
+		// time the profiler started
+		boost::chrono::steady_clock::time_point fStart;
+
+};
+
+
+// profiles a span for as long as it is in scope - does nothing (and touches no components) without a profiler
+class ProfileScope {
+
+	public:
+
+		// a dispatch or structural change
+		inline ProfileScope(Profiler *profiler, ProfileCategory category, Atom name, Component *sender = 0, ObjectId object = -1) : fProfiler(profiler), fSpan(0) {
+			if (fProfiler != 0) fSpan = fProfiler->begin(category, name, sender, 0, object);
+		}
+
+		// a callback of a receiving component
+		inline ProfileScope(Profiler *profiler, Component *sender, Component *receiver) : fProfiler(profiler), fSpan(0) {
+			if (fProfiler != 0) fSpan = fProfiler->begin(PROFILE_CALLBACK, receiver->getNameAtom(), sender, receiver);
+		}
+		inline ~ProfileScope() {
+			if (fProfiler != 0) fProfiler->end(fSpan);
+		}
+
+	private:
+
+		Profiler *fProfiler;
+		unsigned fSpan;
+
+};
+
+
+};
+
+
+#endif
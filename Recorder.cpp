@@ -0,0 +1,514 @@
+
+#include "Recorder.h"
+#include "ObjectManager.h"
+
+
+using namespace Cistron;
+
+
+#include <cstring>
+#include <iterator>
+
+
+// log header
+static const unsigned char RecordMagic[4] = { 'C', 'S', 'T', 'R' };
+static const unsigned char RecordVersion = 1;
+
+// the buffer is written to the stream when it grows beyond this size
+static const unsigned RecordFlushSize = 1 << 16;
+
+
+/**
+ * BINARY ENCODING
+ */
+
+// write values
+void RecordWriter::writeByte(unsigned char b) {
+	fBuffer.push_back(b);
+}
+void RecordWriter::writeUnsigned(unsigned v) {
+	while (v >= 0x80) {
+		fBuffer.push_back((unsigned char)(v | 0x80));
+		v >>= 7;
+	}
+	fBuffer.push_back((unsigned char)v);
+}
+void RecordWriter::writeInt(int v) {
+	writeUnsigned(((unsigned)v << 1) ^ (unsigned)(v >> 31));
+}
+void RecordWriter::writeDouble(double v) {
+	unsigned char bytes[sizeof(double)];
+	memcpy(bytes, &v, sizeof(double));
+	fBuffer.insert(fBuffer.end(), bytes, bytes + sizeof(double));
+}
+void RecordWriter::writeString(string const & s) {
+	writeUnsigned(s.size());
+	fBuffer.insert(fBuffer.end(), s.begin(), s.end());
+}
+void RecordWriter::writeBytes(vector<unsigned char> const & bytes) {
+	writeUnsigned(bytes.size());
+	fBuffer.insert(fBuffer.end(), bytes.begin(), bytes.end());
+}
+
+
+// read values
+unsigned char RecordReader::readByte() {
+	if (fPos >= fSize) {
+		fFailed = true;
+		return 0;
+	}
+	return fData[fPos++];
+}
+unsigned RecordReader::readUnsigned() {
+	unsigned v = 0;
+	for (unsigned shift = 0; shift < 35; shift += 7) {
+		unsigned char b = readByte();
+		v |= (unsigned)(b & 0x7f) << shift;
+		if ((b & 0x80) == 0) return v;
+	}
+	fFailed = true;
+	return 0;
+}
+int RecordReader::readInt() {
+	unsigned v = readUnsigned();
+	return (int)(v >> 1) ^ -(int)(v & 1);
+}
+double RecordReader::readDouble() {
+	double v = 0;
+	if (fPos + sizeof(double) > fSize) {
+		fFailed = true;
+		return v;
+	}
+	memcpy(&v, fData + fPos, sizeof(double));
+	fPos += sizeof(double);
+	return v;
+}
+string RecordReader::readString() {
+	unsigned size = readUnsigned();
+	if (fPos + size > fSize) {
+		fFailed = true;
+		return string();
+	}
+	string s((char const *)fData + fPos, size);
+	fPos += size;
+	return s;
+}
+vector<unsigned char> RecordReader::readBytes() {
+	unsigned size = readUnsigned();
+	if (fPos + size > fSize) {
+		fFailed = true;
+		return vector<unsigned char>();
+	}
+	vector<unsigned char> bytes(fData + fPos, fData + fPos + size);
+	fPos += size;
+	return bytes;
+}
+void RecordReader::skip(unsigned size) {
+	if (fPos + size > fSize) {
+		fFailed = true;
+		fPos = fSize;
+		return;
+	}
+	fPos += size;
+}
+
+
+/**
+ * BUILT-IN PAYLOADS
+ */
+
+static void writeIntPayload(int const & v, RecordWriter& w) { w.writeInt(v); }
+static void writeUnsignedPayload(unsigned const & v, RecordWriter& w) { w.writeUnsigned(v); }
+static void writeDoublePayload(double const & v, RecordWriter& w) { w.writeDouble(v); }
+static void writeFloatPayload(float const & v, RecordWriter& w) { w.writeDouble(v); }
+static void writeBoolPayload(bool const & v, RecordWriter& w) { w.writeByte(v ? 1 : 0); }
+static void writeStringPayload(string const & v, RecordWriter& w) { w.writeString(v); }
+
+static int readIntPayload(RecordReader& r) { return r.readInt(); }
+static unsigned readUnsignedPayload(RecordReader& r) { return r.readUnsigned(); }
+static double readDoublePayload(RecordReader& r) { return r.readDouble(); }
+static float readFloatPayload(RecordReader& r) { return (float)r.readDouble(); }
+static bool readBoolPayload(RecordReader& r) { return r.readByte() != 0; }
+static string readStringPayload(RecordReader& r) { return r.readString(); }
+
+
+/**
+ * RECORDING
+ */
+
+// constructor/destructor
+Recorder::Recorder(ostream& stream) : fStream(stream), fWriter(fBuffer), fUnknownPayloads(0) {
+
+	// header
+	fBuffer.insert(fBuffer.end(), RecordMagic, RecordMagic + 4);
+	fWriter.writeByte(RecordVersion);
+
+	// built-in payloads
+	registerPayload<int>(PAYLOAD_INT, &writeIntPayload);
+	registerPayload<unsigned>(PAYLOAD_UNSIGNED, &writeUnsignedPayload);
+	registerPayload<double>(PAYLOAD_DOUBLE, &writeDoublePayload);
+	registerPayload<float>(PAYLOAD_FLOAT, &writeFloatPayload);
+	registerPayload<bool>(PAYLOAD_BOOL, &writeBoolPayload);
+	registerPayload<string>(PAYLOAD_STRING, &writeStringPayload);
+}
+Recorder::~Recorder() {
+	flush();
+}
+
+
+// register a component state writer
+void Recorder::registerComponent(Atom type, ComponentWriter writer) {
+	fComponentWriters[type.getId()] = writer;
+}
+
+
+// write the buffer to the stream
+void Recorder::flush() {
+	if (fBuffer.size() == 0) return;
+	fStream.write((char const *)&fBuffer[0], fBuffer.size());
+	fStream.flush();
+	fBuffer.clear();
+}
+
+
+// write an atom reference
+void Recorder::writeAtom(Atom a) {
+
+	// define it the first time
+	if (fDefinedAtoms.size() <= a.getId()) fDefinedAtoms.resize(a.getId()+1, false);
+	if (!fDefinedAtoms[a.getId()]) {
+		fWriter.writeByte(RECORD_ATOM);
+		fWriter.writeUnsigned(a.getId());
+		fWriter.writeString(a.str());
+		fDefinedAtoms[a.getId()] = true;
+	}
+}
+
+
+// write a component reference: owner, type and index among the components of that type in the owner
+void Recorder::writeComponent(Component *comp) {
+	fWriter.writeInt(comp->getOwnerId());
+	fWriter.writeUnsigned(comp->getNameAtom().getId());
+	fWriter.writeUnsigned(comp->getObjectManager()->getComponentOrdinal(comp));
+}
+
+
+// write a payload
+void Recorder::writePayload(boost::any const & payload) {
+
+	// nothing
+	if (payload.empty()) {
+		fWriter.writeByte(PAYLOAD_NONE);
+		return;
+	}
+
+	// unknown type
+	map<std::type_info const *, pair<unsigned char, PayloadWriter>, TypeInfoLess>::iterator it = fPayloadWriters.find(&payload.type());
+	if (it == fPayloadWriters.end()) {
+		++fUnknownPayloads;
+		fWriter.writeByte(PAYLOAD_NONE);
+		return;
+	}
+
+	// tag and value
+	fWriter.writeByte(it->second.first);
+	it->second.second(payload, fWriter);
+}
+
+
+// record operations
+void Recorder::recordCreateObject(ObjectId id) {
+	fWriter.writeByte(RECORD_CREATE_OBJECT);
+	fWriter.writeInt(id);
+}
+void Recorder::recordAddComponent(ObjectId id, Component *comp) {
+
+	// the state of the component
+	vector<unsigned char> state;
+	map<AtomId, ComponentWriter>::iterator it = fComponentWriters.find(comp->getNameAtom().getId());
+	if (it != fComponentWriters.end()) {
+		RecordWriter stateWriter(state);
+		it->second(comp, stateWriter);
+	}
+
+	// write it
+	writeAtom(comp->getNameAtom());
+	fWriter.writeByte(RECORD_ADD_COMPONENT);
+	fWriter.writeInt(id);
+	fWriter.writeUnsigned(comp->getNameAtom().getId());
+	fWriter.writeBytes(state);
+	if (fBuffer.size() > RecordFlushSize) flush();
+}
+void Recorder::recordDestroyObject(ObjectId id) {
+	fWriter.writeByte(RECORD_DESTROY_OBJECT);
+	fWriter.writeInt(id);
+}
+void Recorder::recordDestroyComponent(Component *comp) {
+	writeAtom(comp->getNameAtom());
+	fWriter.writeByte(RECORD_DESTROY_COMPONENT);
+	writeComponent(comp);
+}
+void Recorder::recordFinalizeObject(ObjectId id) {
+	fWriter.writeByte(RECORD_FINALIZE_OBJECT);
+	fWriter.writeInt(id);
+}
+void Recorder::recordSendGlobal(Atom msg, Component *sender, boost::any const & payload) {
+	writeAtom(msg);
+	writeAtom(sender->getNameAtom());
+	fWriter.writeByte(RECORD_SEND_GLOBAL);
+	fWriter.writeUnsigned(msg.getId());
+	writeComponent(sender);
+	writePayload(payload);
+	if (fBuffer.size() > RecordFlushSize) flush();
+}
+void Recorder::recordSendObject(Atom msg, Component *sender, ObjectId target, boost::any const & payload) {
+	writeAtom(msg);
+	writeAtom(sender->getNameAtom());
+	fWriter.writeByte(RECORD_SEND_OBJECT);
+	fWriter.writeUnsigned(msg.getId());
+	writeComponent(sender);
+	fWriter.writeInt(target);
+	writePayload(payload);
+	if (fBuffer.size() > RecordFlushSize) flush();
+}
+void Recorder::recordTick(Time dt) {
+	fWriter.writeByte(RECORD_TICK);
+	fWriter.writeUnsigned(dt);
+}
+void Recorder::recordJoinGroup(ObjectId id, Atom group) {
+	writeAtom(group);
+	fWriter.writeByte(RECORD_JOIN_GROUP);
+	fWriter.writeInt(id);
+	fWriter.writeUnsigned(group.getId());
+}
+void Recorder::recordLeaveGroup(ObjectId id, Atom group) {
+	writeAtom(group);
+	fWriter.writeByte(RECORD_LEAVE_GROUP);
+	fWriter.writeInt(id);
+	fWriter.writeUnsigned(group.getId());
+}
+void Recorder::recordFlushChannels() {
+	fWriter.writeByte(RECORD_FLUSH_CHANNELS);
+}
+void Recorder::recordMoveComponent(Component *comp, ObjectId target) {
+	writeAtom(comp->getNameAtom());
+	fWriter.writeByte(RECORD_MOVE_COMPONENT);
+	writeComponent(comp);
+	fWriter.writeInt(target);
+}
+void Recorder::recordFlushBatches() {
+	fWriter.writeByte(RECORD_FLUSH_BATCHES);
+}
+void Recorder::recordSendGroup(Atom group, Atom msg, Component *sender, boost::any const & payload) {
+	writeAtom(group);
+	writeAtom(msg);
+	writeAtom(sender->getNameAtom());
+	fWriter.writeByte(RECORD_SEND_GROUP);
+	fWriter.writeUnsigned(group.getId());
+	fWriter.writeUnsigned(msg.getId());
+	writeComponent(sender);
+	writePayload(payload);
+	if (fBuffer.size() > RecordFlushSize) flush();
+}
+
+
+/**
+ * REPLAYING
+ */
+
+// constructor/destructor
+Replayer::Replayer(ObjectManager *objectManager) : fObjectManager(objectManager), fOperations(0), fMismatches(0) {
+
+	// built-in payloads
+	registerPayload<int>(PAYLOAD_INT, &readIntPayload);
+	registerPayload<unsigned>(PAYLOAD_UNSIGNED, &readUnsignedPayload);
+	registerPayload<double>(PAYLOAD_DOUBLE, &readDoublePayload);
+	registerPayload<float>(PAYLOAD_FLOAT, &readFloatPayload);
+	registerPayload<bool>(PAYLOAD_BOOL, &readBoolPayload);
+	registerPayload<string>(PAYLOAD_STRING, &readStringPayload);
+}
+Replayer::~Replayer() {
+}
+
+
+// register a component factory
+void Replayer::registerComponent(Atom type, ComponentFactory factory) {
+	fFactories[type.getId()] = factory;
+}
+
+
+// read the log
+bool Replayer::load(istream& stream) {
+	fLog.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+
+	// check the header
+	return fLog.size() >= 5 && memcmp(&fLog[0], RecordMagic, 4) == 0 && fLog[4] == RecordVersion;
+}
+
+
+// read an atom reference
+Atom Replayer::readAtom(RecordReader& r) {
+	unsigned id = r.readUnsigned();
+	if (id >= fAtoms.size() || !fAtoms[id].isValid()) return Atom();
+	return fAtoms[id];
+}
+
+
+// read a component reference
+Component* Replayer::readComponent(RecordReader& r) {
+	ObjectId owner = r.readInt();
+	Atom type = readAtom(r);
+	unsigned ordinal = r.readUnsigned();
+	Component *comp = fObjectManager->getComponent(owner, type, ordinal);
+	if (comp == 0) ++fMismatches;
+	return comp;
+}
+
+
+// read a payload
+boost::any Replayer::readPayload(RecordReader& r) {
+	unsigned char tag = r.readByte();
+	if (tag == PAYLOAD_NONE) return boost::any();
+	map<unsigned char, PayloadReader>::iterator it = fPayloadReaders.find(tag);
+
+	// without a reader, we can't know the size - the log can't be read any further
+	if (it == fPayloadReaders.end()) {
+		r.fail();
+		return boost::any();
+	}
+	return it->second(r);
+}
+
+
+// replay the log
+bool Replayer::replay() {
+	if (fLog.size() < 5) return false;
+	RecordReader r(&fLog[0] + 5, fLog.size() - 5);
+	while (!r.atEnd() && !r.failed()) {
+		unsigned char op = r.readByte();
+		++fOperations;
+		switch (op) {
+
+			// define an atom
+			case RECORD_ATOM: {
+				unsigned id = r.readUnsigned();
+				string name = r.readString();
+				if (fAtoms.size() <= id) fAtoms.resize(id+1);
+				fAtoms[id] = Atom(name);
+				--fOperations;
+				break;
+			}
+
+			// create an object - ids must match the recording
+			case RECORD_CREATE_OBJECT: {
+				ObjectId id = r.readInt();
+				if (fObjectManager->createObject() != id) ++fMismatches;
+				break;
+			}
+
+			// add a component
+			case RECORD_ADD_COMPONENT: {
+				ObjectId id = r.readInt();
+				Atom type = readAtom(r);
+				vector<unsigned char> state = r.readBytes();
+				map<AtomId, ComponentFactory>::iterator factory = fFactories.find(type.getId());
+				if (factory == fFactories.end()) {
+					++fMismatches;
+					break;
+				}
+				RecordReader stateReader(state.size() > 0 ? &state[0] : 0, state.size());
+				fObjectManager->addComponent(id, factory->second(stateReader));
+				break;
+			}
+
+			// destroy an object
+			case RECORD_DESTROY_OBJECT:
+				fObjectManager->destroyObject(r.readInt());
+				break;
+
+			// destroy a component
+			case RECORD_DESTROY_COMPONENT: {
+				Component *comp = readComponent(r);
+				if (comp != 0) fObjectManager->destroyComponent(comp);
+				break;
+			}
+
+			// finalize an object
+			case RECORD_FINALIZE_OBJECT:
+				fObjectManager->finalizeObject(r.readInt());
+				break;
+
+			// global message
+			case RECORD_SEND_GLOBAL: {
+				Atom msg = readAtom(r);
+				Component *sender = readComponent(r);
+				boost::any payload = readPayload(r);
+				if (r.failed()) return false;
+				if (sender != 0) fObjectManager->sendGlobalMessage(fObjectManager->getMessageRequestId(REQ_MESSAGE, msg), Message(MESSAGE, sender, payload));
+				break;
+			}
+
+			// message to an object
+			case RECORD_SEND_OBJECT: {
+				Atom msg = readAtom(r);
+				Component *sender = readComponent(r);
+				ObjectId target = r.readInt();
+				boost::any payload = readPayload(r);
+				if (r.failed()) return false;
+				if (sender != 0) fObjectManager->sendMessageToObject(fObjectManager->getMessageRequestId(REQ_MESSAGE, msg), Message(MESSAGE, sender, payload), target);
+				break;
+			}
+
+			// advance the time
+			case RECORD_TICK:
+				fObjectManager->tick(r.readUnsigned());
+				break;
+
+			// group membership
+			case RECORD_JOIN_GROUP: {
+				ObjectId id = r.readInt();
+				fObjectManager->joinGroup(id, readAtom(r));
+				break;
+			}
+			case RECORD_LEAVE_GROUP: {
+				ObjectId id = r.readInt();
+				fObjectManager->leaveGroup(id, readAtom(r));
+				break;
+			}
+
+			// message to a group
+			case RECORD_SEND_GROUP: {
+				Atom group = readAtom(r);
+				Atom msg = readAtom(r);
+				Component *sender = readComponent(r);
+				boost::any payload = readPayload(r);
+				if (r.failed()) return false;
+				if (sender != 0) fObjectManager->sendMessageToGroup(group, fObjectManager->getMessageRequestId(REQ_MESSAGE, msg), Message(MESSAGE, sender, payload));
+				break;
+			}
+
+			// deliver the state channels
+			case RECORD_FLUSH_CHANNELS:
+				fObjectManager->flushStateChannels();
+				break;
+
+			// move a component
+			case RECORD_MOVE_COMPONENT: {
+				Component *comp = readComponent(r);
+				ObjectId target = r.readInt();
+				if (comp != 0) fObjectManager->moveComponent(comp, target);
+				break;
+			}
+
+			// deliver the batched messages
+			case RECORD_FLUSH_BATCHES:
+				fObjectManager->flushBatches();
+				break;
+
+			// corrupt log
+			default:
+				return false;
+		}
+	}
+	return !r.failed();
+}
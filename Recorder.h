@@ -0,0 +1,303 @@
+
+#ifndef INC_RECORDER
+#define INC_RECORDER
+
+#include "Component.h"
+
+
+#include <vector>
+#include <map>
+#include <utility>
+#include <string>
+#include <istream>
+#include <ostream>
+#include <typeinfo>
+#include <boost/function.hpp>
+
+
+namespace Cistron {
+
+using std::vector;
+using std::map;
+using std::pair;
+using std::string;
+using std::istream;
+using std::ostream;
+
+
+/**
+ * BINARY ENCODING
+ */
+
+// writes values to a byte buffer - integers are written as varints
+class RecordWriter {
+
+	public:
+
+		RecordWriter(vector<unsigned char>& buffer) : fBuffer(buffer) {};
+
+		void writeByte(unsigned char);
+		void writeUnsigned(unsigned);
+		void writeInt(int);
+		void writeDouble(double);
+		void writeString(string const &);
+		void writeBytes(vector<unsigned char> const &);
+
+	private:
+
+		vector<unsigned char>& fBuffer;
+
+};
+
+// reads values written by a RecordWriter - reading past the end sets the failed flag and returns zeroes
+class RecordReader {
+
+	public:
+
+		RecordReader(unsigned char const *data, unsigned size) : fData(data), fSize(size), fPos(0), fFailed(false) {};
+
+		unsigned char readByte();
+		unsigned readUnsigned();
+		int readInt();
+		double readDouble();
+		string readString();
+		vector<unsigned char> readBytes();
+		void skip(unsigned size);
+
+		inline bool atEnd() { return fPos >= fSize; }
+		inline unsigned remaining() { return fPos < fSize ? fSize - fPos : 0; }
+		inline bool failed() { return fFailed; }
+		inline void fail() { fFailed = true; }
+
+	private:
+
+		unsigned char const *fData;
+		unsigned fSize;
+		unsigned fPos;
+		bool fFailed;
+
+};
+
+
+// compares type infos, to use them as map keys
+struct TypeInfoLess {
+	inline bool operator()(std::type_info const *a, std::type_info const *b) const {
+		return a->before(*b) != 0;
+	}
+};
+
+
+// serializes a payload, and the state a component needs to be constructed on replay
+typedef boost::function<void(boost::any const &, RecordWriter&)> PayloadWriter;
+typedef boost::function<boost::any(RecordReader&)> PayloadReader;
+typedef boost::function<void(Component*, RecordWriter&)> ComponentWriter;
+typedef boost::function<Component*(RecordReader&)> ComponentFactory;
+
+// payload tags - user payloads must use tags from PAYLOAD_USER onwards
+enum PayloadTag {
+	PAYLOAD_NONE = 0,
+	PAYLOAD_INT = 1,
+	PAYLOAD_UNSIGNED = 2,
+	PAYLOAD_DOUBLE = 3,
+	PAYLOAD_FLOAT = 4,
+	PAYLOAD_BOOL = 5,
+	PAYLOAD_STRING = 6,
+	PAYLOAD_USER = 16
+};
+
+// operations in the log
+enum RecordOperation {
+	RECORD_ATOM = 1,
+	RECORD_CREATE_OBJECT = 2,
+	RECORD_ADD_COMPONENT = 3,
+	RECORD_DESTROY_OBJECT = 4,
+	RECORD_DESTROY_COMPONENT = 5,
+	RECORD_FINALIZE_OBJECT = 6,
+	RECORD_SEND_GLOBAL = 7,
+	RECORD_SEND_OBJECT = 8,
+	RECORD_TICK = 9,
+	RECORD_JOIN_GROUP = 10,
+	RECORD_LEAVE_GROUP = 11,
+	RECORD_SEND_GROUP = 12,
+	RECORD_FLUSH_CHANNELS = 13,
+	RECORD_MOVE_COMPONENT = 14,
+	RECORD_FLUSH_BATCHES = 15
+};
+
+
+/**
+ * RECORDING
+ * The recorder logs the operations performed on an object manager from the outside: operations performed
+ * by callbacks are consequences of the logged ones, and happen again when the log is replayed on a world
+ * with the same component logic. Components are referred to by object, type and their index among the
+ * components of that type in the object, which is the same in the replay.
+ */
+class Recorder {
+
+	public:
+
+		// constructor/destructor - the log is written to the stream
+		Recorder(ostream&);
+		virtual ~Recorder();
+
+		// register the state a component type needs on replay - types without writer are recorded without state
+		void registerComponent(Atom type, ComponentWriter);
+
+		// register a payload type - payloads of unknown types are recorded as empty
+		template<class T>
+		void registerPayload(unsigned char tag, boost::function<void(T const &, RecordWriter&)> writer);
+
+		// write the buffered log to the stream
+		void flush();
+
+		// number of payloads that could not be serialized
+		inline unsigned getUnknownPayloads() {
+			return fUnknownPayloads;
+		}
+
+		// called by the object manager
+		void recordCreateObject(ObjectId);
+		void recordAddComponent(ObjectId, Component*);
+		void recordDestroyObject(ObjectId);
+		void recordDestroyComponent(Component*);
+		void recordFinalizeObject(ObjectId);
+		void recordSendGlobal(Atom msg, Component *sender, boost::any const & payload);
+		void recordSendObject(Atom msg, Component *sender, ObjectId target, boost::any const & payload);
+		void recordTick(Time dt);
+		void recordJoinGroup(ObjectId, Atom group);
+		void recordLeaveGroup(ObjectId, Atom group);
+		void recordSendGroup(Atom group, Atom msg, Component *sender, boost::any const & payload);
+		void recordFlushChannels();
+		void recordMoveComponent(Component*, ObjectId target);
+		void recordFlushBatches();
+
+	private:
+
+		// write an atom reference, defining it first if needed
+		void writeAtom(Atom);
+
+		// write a component reference
+		void writeComponent(Component*);
+
+		// write a payload
+		void writePayload(boost::any const &);
+
+		// store a typed payload writer
+		template<class T>
+		static void writeTyped(boost::function<void(T const &, RecordWriter&)> writer, boost::any const & payload, RecordWriter& w) {
+			writer(boost::any_cast<T const &>(payload), w);
+		}
+
+		// output
+		ostream& fStream;
+		vector<unsigned char> fBuffer;
+		RecordWriter fWriter;
+
+		// atoms already defined in the log
+		vector<bool> fDefinedAtoms;
+
+		// component state writers, by atom id
+		map<AtomId, ComponentWriter> fComponentWriters;
+
+		// payload writers, by type
+		map<std::type_info const *, pair<unsigned char, PayloadWriter>, TypeInfoLess> fPayloadWriters;
+
+		// number of payloads that could not be serialized
+		unsigned fUnknownPayloads;
+
+};
+
+
+/**
+ * REPLAYING
+ */
+class ObjectManager;
+class Replayer {
+
+	public:
+
+		// constructor/destructor - the log is replayed on the object manager, which should be empty
+		Replayer(ObjectManager*);
+		virtual ~Replayer();
+
+		// register the factory of a component type - every component type added from the outside needs one
+		void registerComponent(Atom type, ComponentFactory);
+
+		// register a payload type
+		template<class T>
+		void registerPayload(unsigned char tag, boost::function<T(RecordReader&)> reader);
+
+		// read a log into memory
+		bool load(istream&);
+
+		// replay the loaded log as fast as possible - returns false if the log is corrupt, or has a payload without a reader
+		bool replay();
+
+		// number of replayed operations
+		inline unsigned getOperations() {
+			return fOperations;
+		}
+
+		// number of operations whose object or component didn't match the recording
+		inline unsigned getMismatches() {
+			return fMismatches;
+		}
+
+	private:
+
+		// read an atom reference
+		Atom readAtom(RecordReader&);
+
+		// read a component reference
+		Component* readComponent(RecordReader&);
+
+		// read a payload
+		boost::any readPayload(RecordReader&);
+
+		// store a typed payload reader
+		template<class T>
+		static boost::any readTyped(boost::function<T(RecordReader&)> reader, RecordReader& r) {
+			return boost::any(reader(r));
+		}
+
+		// object manager to replay on
+		ObjectManager *fObjectManager;
+
+		// the log
+		vector<unsigned char> fLog;
+
+		// atoms defined in the log
+		vector<Atom> fAtoms;
+
+		// component factories, by atom id
+		map<AtomId, ComponentFactory> fFactories;
+
+		// payload readers, by tag
+		map<unsigned char, PayloadReader> fPayloadReaders;
+
+		// statistics
+		unsigned fOperations;
+		unsigned fMismatches;
+
+};
+
+
+/**
+ * TEMPLATED PAYLOAD FUNCTIONS
+ */
+
+// register a payload type
+template<class T>
+void Recorder::registerPayload(unsigned char tag, boost::function<void(T const &, RecordWriter&)> writer) {
+	fPayloadWriters[&typeid(T)] = pair<unsigned char, PayloadWriter>(tag, boost::bind(&Recorder::writeTyped<T>, writer, _1, _2));
+}
+template<class T>
+void Replayer::registerPayload(unsigned char tag, boost::function<T(RecordReader&)> reader) {
+	fPayloadReaders[tag] = boost::bind(&Replayer::readTyped<T>, reader, _1);
+}
+
+
+};
+
+
+#endif
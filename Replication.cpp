@@ -0,0 +1,364 @@
+
+#include "Replication.h"
+#include "ObjectManager.h"
+
+
+using namespace Cistron;
+
+
+#include <cstdio>
+
+
+// a run of fewer unchanged bytes than this doesn't end a run of changed bytes
+static const unsigned ReplicationMinSkip = 3;
+
+
+/**
+ * SINKS
+ */
+
+// write a length-prefixed frame
+void StreamSink::write(vector<unsigned char> const & frame) {
+	vector<unsigned char> length;
+	RecordWriter(length).writeUnsigned(frame.size());
+	fStream.write((char const *)&length[0], length.size());
+	if (frame.size() > 0) fStream.write((char const *)&frame[0], frame.size());
+	fStream.flush();
+}
+
+
+/**
+ * REPLICATING
+ */
+
+// constructor/destructor
+Replicator::Replicator(ReplicationSink *sink) : fSink(sink), fWriter(fFrame), fFrameNumber(0), fChanged(0) {
+}
+Replicator::~Replicator() {
+}
+
+
+// replicate a component type
+void Replicator::registerComponent(Atom type, ComponentWriter writer) {
+	if (fWriters.find(type.getId()) == fWriters.end()) fTypes.push_back(type);
+	fWriters[type.getId()] = writer;
+}
+
+
+// write an atom reference
+void Replicator::writeAtom(Atom a) {
+	if (fDefinedAtoms.size() <= a.getId()) fDefinedAtoms.resize(a.getId()+1, false);
+	if (!fDefinedAtoms[a.getId()]) {
+		fWriter.writeByte(REPLICATE_ATOM);
+		fWriter.writeUnsigned(a.getId());
+		fWriter.writeString(a.str());
+		fDefinedAtoms[a.getId()] = true;
+	}
+}
+
+
+// start a frame
+void Replicator::beginFrame(Time time) {
+	fFrame.clear();
+	fWriter.writeUnsigned(time);
+	fChanged = 0;
+}
+
+
+// structural changes
+void Replicator::componentAdded(Component *comp) {
+	if (fWriters.find(comp->getNameAtom().getId()) != fWriters.end()) fAdded.push_back(comp);
+}
+void Replicator::componentRemoved(Component *comp) {
+	if (fWriters.find(comp->getNameAtom().getId()) != fWriters.end()) fRemoved.push_back(comp->getId());
+}
+void Replicator::componentMoved(Component *comp) {
+	if (fWriters.find(comp->getNameAtom().getId()) != fWriters.end()) fMoved.push_back(comp);
+}
+
+
+// write the structural changes since the last frame
+void Replicator::writePending() {
+
+	// destroyed and hidden components, if the replica has them
+	for (unsigned i = 0; i < fRemoved.size(); ++i) {
+		hash_map<ComponentId, Replica>::iterator it = fReplicas.find(fRemoved[i]);
+		if (it == fReplicas.end()) continue;
+		fWriter.writeByte(REPLICATE_DESTROY);
+		fWriter.writeInt(fRemoved[i]);
+		fReplicas.erase(it);
+		++fChanged;
+	}
+
+	// added and moved components that are still alive - writing them creates or moves them on the replica
+	for (unsigned i = 0; i < fAdded.size(); ++i) {
+		if (!fAdded[i]->isDestroyed() && !fAdded[i]->isDying()) writeComponent(fAdded[i]);
+	}
+	for (unsigned i = 0; i < fMoved.size(); ++i) {
+		if (!fMoved[i]->isDestroyed() && !fMoved[i]->isDying()) writeComponent(fMoved[i]);
+	}
+	fRemoved.clear();
+	fAdded.clear();
+	fMoved.clear();
+}
+
+
+// add the state of a component to the frame, if it changed
+void Replicator::writeComponent(Component *comp) {
+
+	// not replicated
+	map<AtomId, ComponentWriter>::iterator writer = fWriters.find(comp->getNameAtom().getId());
+	if (writer == fWriters.end()) return;
+
+	// current state
+	fState.clear();
+	RecordWriter stateWriter(fState);
+	writer->second(comp, stateWriter);
+
+	// new component, send it whole
+	hash_map<ComponentId, Replica>::iterator it = fReplicas.find(comp->getId());
+	if (it == fReplicas.end()) {
+		Replica& replica = fReplicas[comp->getId()];
+		replica.state = fState;
+		replica.owner = comp->getOwnerId();
+		writeAtom(comp->getNameAtom());
+		fWriter.writeByte(REPLICATE_CREATE);
+		fWriter.writeInt(comp->getId());
+		fWriter.writeInt(comp->getOwnerId());
+		fWriter.writeUnsigned(comp->getNameAtom().getId());
+		fWriter.writeBytes(fState);
+		++fChanged;
+		return;
+	}
+
+	// moved to another object
+	Replica& replica = it->second;
+	if (replica.owner != comp->getOwnerId()) {
+		replica.owner = comp->getOwnerId();
+		fWriter.writeByte(REPLICATE_MOVE);
+		fWriter.writeInt(comp->getId());
+		fWriter.writeInt(replica.owner);
+		++fChanged;
+	}
+
+	// unchanged
+	if (replica.state == fState) return;
+
+	// the XOR against the previous state, as runs of unchanged bytes to skip and runs of changed bytes
+	fWriter.writeByte(REPLICATE_UPDATE);
+	fWriter.writeInt(comp->getId());
+	fWriter.writeUnsigned(fState.size());
+	unsigned pos = 0;
+	while (pos < fState.size()) {
+
+		// unchanged bytes
+		unsigned start = pos;
+		while (pos < fState.size() && pos < replica.state.size() && fState[pos] == replica.state[pos]) ++pos;
+		fWriter.writeUnsigned(pos - start);
+		if (pos == fState.size()) {
+			fWriter.writeUnsigned(0);
+			break;
+		}
+
+		// changed bytes, including short runs of unchanged ones
+		start = pos;
+		unsigned end = pos;
+		while (pos < fState.size()) {
+			if (pos >= replica.state.size() || fState[pos] != replica.state[pos]) end = ++pos;
+			else if (pos - end + 1 >= ReplicationMinSkip) break;
+			else ++pos;
+		}
+		pos = end;
+		fWriter.writeUnsigned(end - start);
+		for (unsigned i = start; i < end; ++i) {
+			fWriter.writeByte(fState[i] ^ (i < replica.state.size() ? replica.state[i] : 0));
+		}
+	}
+	replica.state.swap(fState);
+	++fChanged;
+}
+
+
+// send the frame
+void Replicator::endFrame() {
+	fWriter.writeByte(REPLICATE_END);
+	fSink->write(fFrame);
+	++fFrameNumber;
+}
+
+
+/**
+ * APPLYING
+ */
+
+// constructor/destructor
+ReplicationApplier::ReplicationApplier(ObjectManager *objectManager) : fObjectManager(objectManager), fTime(0) {
+}
+ReplicationApplier::~ReplicationApplier() {
+}
+
+
+// register a component type
+void ReplicationApplier::registerComponent(Atom type, ComponentFactory factory, ComponentReader reader) {
+	fTypes[type.getId()] = pair<ComponentFactory, ComponentReader>(factory, reader);
+}
+
+
+// get the replica of an object
+ObjectId ReplicationApplier::getReplicaId(ObjectId id) {
+	hash_map<ObjectId, pair<ObjectId, unsigned> >::iterator it = fObjects.find(id);
+	if (it == fObjects.end()) return -1;
+	return it->second.first;
+}
+
+
+// apply a frame
+bool ReplicationApplier::apply(vector<unsigned char> const & frame) {
+	if (frame.size() == 0) return false;
+	RecordReader r(&frame[0], frame.size());
+	fTime = r.readUnsigned();
+	while (!r.failed()) {
+		switch (r.readByte()) {
+
+			// end of the frame
+			case REPLICATE_END:
+				return !r.failed();
+
+			// define an atom
+			case REPLICATE_ATOM: {
+				unsigned id = r.readUnsigned();
+				string name = r.readString();
+				if (fAtoms.size() <= id) fAtoms.resize(id+1);
+				fAtoms[id] = Atom(name);
+				break;
+			}
+
+			// new component
+			case REPLICATE_CREATE: {
+				ComponentId id = r.readInt();
+				ObjectId owner = r.readInt();
+				unsigned type = r.readUnsigned();
+				vector<unsigned char> state = r.readBytes();
+				if (r.failed() || type >= fAtoms.size()) return false;
+				map<AtomId, pair<ComponentFactory, ComponentReader> >::iterator factory = fTypes.find(fAtoms[type].getId());
+				if (factory == fTypes.end()) break;
+
+				// the object is created with its first replicated component
+				hash_map<ObjectId, pair<ObjectId, unsigned> >::iterator obj = fObjects.find(owner);
+				if (obj == fObjects.end()) {
+					obj = fObjects.insert(std::make_pair(owner, pair<ObjectId, unsigned>(fObjectManager->createObject(), 0))).first;
+				}
+				++obj->second.second;
+
+				// create the component
+				RecordReader stateReader(state.size() > 0 ? &state[0] : 0, state.size());
+				Replica& replica = fComponents[id];
+				replica.component = factory->second.first(stateReader);
+				replica.object = owner;
+				replica.state.swap(state);
+				fObjectManager->addComponent(obj->second.first, replica.component);
+				break;
+			}
+
+			// changed component
+			case REPLICATE_UPDATE: {
+				ComponentId id = r.readInt();
+				unsigned size = r.readUnsigned();
+				hash_map<ComponentId, Replica>::iterator it = fComponents.find(id);
+				Replica *replica = it != fComponents.end() ? &it->second : 0;
+
+				// undo the XOR - the runs of a component of a type that isn't replicated here are only read
+				if (replica != 0) replica->state.resize(size, 0);
+				unsigned pos = 0;
+				while (pos < size && !r.failed()) {
+					pos += r.readUnsigned();
+					unsigned changed = r.readUnsigned();
+					if (pos + changed > size) return false;
+					for (unsigned i = 0; i < changed; ++i, ++pos) {
+						unsigned char b = r.readByte();
+						if (replica != 0) replica->state[pos] ^= b;
+					}
+				}
+				if (replica == 0 || r.failed()) break;
+
+				// apply the new state
+				RecordReader stateReader(size > 0 ? &replica->state[0] : 0, size);
+				fTypes[replica->component->getNameAtom().getId()].second(replica->component, stateReader);
+				break;
+			}
+
+			// destroyed component
+			case REPLICATE_DESTROY: {
+				ComponentId id = r.readInt();
+				hash_map<ComponentId, Replica>::iterator it = fComponents.find(id);
+				if (it == fComponents.end()) break;
+				ObjectId owner = it->second.object;
+				fObjectManager->destroyComponent(it->second.component);
+				fComponents.erase(it);
+
+				// the object dies with its last replicated component
+				hash_map<ObjectId, pair<ObjectId, unsigned> >::iterator obj = fObjects.find(owner);
+				if (obj != fObjects.end() && --obj->second.second == 0) {
+					fObjectManager->destroyObject(obj->second.first);
+					fObjects.erase(obj);
+				}
+				break;
+			}
+
+			// moved component
+			case REPLICATE_MOVE: {
+				ComponentId id = r.readInt();
+				ObjectId owner = r.readInt();
+				hash_map<ComponentId, Replica>::iterator it = fComponents.find(id);
+				if (r.failed() || it == fComponents.end()) break;
+				ObjectId previous = it->second.object;
+
+				// the new object may not have any replicated component yet
+				hash_map<ObjectId, pair<ObjectId, unsigned> >::iterator obj = fObjects.find(owner);
+				if (obj == fObjects.end()) {
+					obj = fObjects.insert(std::make_pair(owner, pair<ObjectId, unsigned>(fObjectManager->createObject(), 0))).first;
+				}
+				++obj->second.second;
+				fObjectManager->moveComponent(it->second.component, obj->second.first);
+				it->second.object = owner;
+
+				// the previous object dies with its last replicated component
+				obj = fObjects.find(previous);
+				if (obj != fObjects.end() && --obj->second.second == 0) {
+					fObjectManager->destroyObject(obj->second.first);
+					fObjects.erase(obj);
+				}
+				break;
+			}
+
+			// corrupt frame
+			default:
+				return false;
+		}
+	}
+	return false;
+}
+
+
+// apply the frames in a stream
+unsigned ReplicationApplier::apply(istream& stream) {
+	unsigned frames = 0;
+	vector<unsigned char> frame;
+	while (true) {
+
+		// length
+		unsigned size = 0;
+		int c;
+		for (unsigned shift = 0; (c = stream.get()) != EOF; shift += 7) {
+			size |= (unsigned)(c & 0x7f) << shift;
+			if ((c & 0x80) == 0) break;
+		}
+		if (c == EOF) return frames;
+
+		// frame
+		frame.resize(size);
+		if (size > 0) stream.read((char*)&frame[0], size);
+		if ((unsigned)stream.gcount() != size || !apply(frame)) return frames;
+		++frames;
+	}
+}
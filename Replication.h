@@ -0,0 +1,229 @@
+
+#ifndef INC_REPLICATION
+#define INC_REPLICATION
+
+#include "Recorder.h"
+
+
+#include <hash_map>
+#include <vector>
+#include <map>
+#include <string>
+#include <istream>
+#include <ostream>
+#include <boost/function.hpp>
+
+
+namespace Cistron {
+
+using std::vector;
+using std::map;
+using std::string;
+using std::istream;
+using std::ostream;
+using stdext::hash_map;
+
+
+// applies a replicated state to an existing component
+typedef boost::function<void(Component*, RecordReader&)> ComponentReader;
+
+// operations in a replication frame
+enum ReplicationOperation {
+	REPLICATE_END = 0,
+	REPLICATE_ATOM = 1,
+	REPLICATE_CREATE = 2,
+	REPLICATE_UPDATE = 3,
+	REPLICATE_DESTROY = 4,
+	REPLICATE_MOVE = 5
+};
+
+
+/**
+ * SINKS
+ */
+
+// receives the frames of a replication stream
+class ReplicationSink {
+
+	public:
+
+		virtual ~ReplicationSink() {};
+
+		// send a frame
+		virtual void write(vector<unsigned char> const & frame) = 0;
+
+};
+
+// writes length-prefixed frames to a stream - a file, or a boost::asio::ip::tcp::iostream for a socket
+class StreamSink : public ReplicationSink {
+
+	public:
+
+		StreamSink(ostream& stream) : fStream(stream) {};
+
+		void write(vector<unsigned char> const & frame);
+
+	private:
+
+		ostream& fStream;
+
+};
+
+
+/**
+ * REPLICATING
+ * The replicator sends the state of selected component types at the end of every tick of the object manager it is
+ * attached to. The first frame creates every component on the replica, later frames contain only what changed:
+ * created, destroyed and moved components, and the state of changed components as the XOR against the previously sent state,
+ * with runs of unchanged bytes skipped. The sink must deliver every frame, in order.
+ * After the first frame, only the components marked changed in the tick (Component::markChanged, Tracked fields) and the
+ * structural changes the object manager reported are written, so the cost of a frame follows the amount of change.
+ * The last sent state of every component is kept, to XOR against. Register the types before attaching the replicator.
+ */
+class Replicator {
+
+	public:
+
+		// constructor/destructor - the sink is owned by the caller
+		Replicator(ReplicationSink*);
+		virtual ~Replicator();
+
+		// replicate a component type - the writer writes the state of one component
+		void registerComponent(Atom type, ComponentWriter);
+
+		// replicated component types
+		inline vector<Atom> const & getTypes() {
+			return fTypes;
+		}
+
+		// statistics of the last frame
+		inline unsigned getFrameSize() {
+			return fFrame.size();
+		}
+		inline unsigned getChanged() {
+			return fChanged;
+		}
+
+		// called by the object manager
+		void beginFrame(Time);
+		void writeComponent(Component*);
+		void writePending();
+		void endFrame();
+
+		// is the next frame the first one, which has every component?
+		inline bool isFirstFrame() {
+			return fFrameNumber == 0;
+		}
+
+		// structural changes reported by the object manager, written in the next frame
+		void componentAdded(Component*);
+		void componentRemoved(Component*);
+		void componentMoved(Component*);
+
+	private:
+
+		// write an atom reference, defining it first if needed
+		void writeAtom(Atom);
+
+		// output
+		ReplicationSink *fSink;
+		vector<unsigned char> fFrame;
+		RecordWriter fWriter;
+
+		// replicated types, and their writers by atom id
+		vector<Atom> fTypes;
+		map<AtomId, ComponentWriter> fWriters;
+
+		// atoms already defined in the stream
+		vector<bool> fDefinedAtoms;
+
+		// state and owner of a component on the replica
+		struct Replica {
+			vector<unsigned char> state;
+			ObjectId owner;
+		};
+
+		// replicated components, by component id
+		hash_map<ComponentId, Replica> fReplicas;
+
+		// components added or moved, and components destroyed or hidden since the last frame
+		vector<Component*> fAdded;
+		vector<Component*> fMoved;
+		vector<ComponentId> fRemoved;
+
+		// number of frames sent
+		unsigned fFrameNumber;
+
+		// buffer for the state of a component
+		vector<unsigned char> fState;
+
+		// number of created, changed and destroyed components in the last frame
+		unsigned fChanged;
+
+};
+
+
+/**
+ * APPLYING
+ */
+class ObjectManager;
+class ReplicationApplier {
+
+	public:
+
+		// constructor/destructor - the replica is built in the object manager
+		ReplicationApplier(ObjectManager*);
+		virtual ~ReplicationApplier();
+
+		// register how to create a component of a type, and how to apply a new state to it
+		void registerComponent(Atom type, ComponentFactory, ComponentReader);
+
+		// apply a frame - returns false if it is corrupt
+		// the components of the types that weren't registered here are skipped, with their updates and moves
+		bool apply(vector<unsigned char> const & frame);
+
+		// apply the frames written by a StreamSink until the end of the stream - returns the number of frames applied
+		unsigned apply(istream&);
+
+		// time of the last applied frame
+		inline Time getTime() {
+			return fTime;
+		}
+
+		// get the replica of an object - -1 if the object has no replicated components
+		ObjectId getReplicaId(ObjectId);
+
+	private:
+
+		// object manager with the replica
+		ObjectManager *fObjectManager;
+
+		// atoms defined in the stream
+		vector<Atom> fAtoms;
+
+		// factories and readers, by atom id
+		map<AtomId, pair<ComponentFactory, ComponentReader> > fTypes;
+
+		// a replicated component
+		struct Replica {
+			Component *component;
+			ObjectId object;
+			vector<unsigned char> state;
+		};
+
+		// replicated components, by id on the source
+		hash_map<ComponentId, Replica> fComponents;
+
+		// replicated objects by id on the source: the replica id, and its number of replicated components
+		hash_map<ObjectId, pair<ObjectId, unsigned> > fObjects;
+
+		// time of the last frame
+		Time fTime;
+
+};
+
+
+};
+
+
+#endif
@@ -0,0 +1,46 @@
+
+#include "Stats.h"
+
+
+using namespace Cistron;
+
+
+#include <iomanip>
+
+
+// write a breakdown of memory usage
+static void writeMemory(ostream& s, string const & title, map<string, MemoryUsage> const & memory) {
+	s << title << std::endl;
+	for (map<string, MemoryUsage>::const_iterator it = memory.begin(); it != memory.end(); ++it) {
+		s << "  " << std::left << std::setw(32) << it->first << std::right
+			<< std::setw(12) << it->second.count << std::setw(14) << it->second.bytes << " bytes" << std::endl;
+	}
+}
+
+
+// total memory
+MemoryUsage ObjectManagerStats::getTotalMemory() const {
+	MemoryUsage total;
+	for (map<string, MemoryUsage>::const_iterator it = memoryByStructure.begin(); it != memoryByStructure.end(); ++it) {
+		total.add(it->second.count, it->second.bytes);
+	}
+	return total;
+}
+
+
+// fragmentation
+double ObjectManagerStats::getFragmentation() const {
+	unsigned entries = components + staleComponents;
+	return entries == 0 ? 0 : (double)staleComponents / entries;
+}
+
+
+// write as text
+void ObjectManagerStats::write(ostream& s) const {
+	MemoryUsage total = getTotalMemory();
+	s << "time " << time << ", " << objects << " objects, " << components << " components, " << total.bytes << " bytes" << std::endl;
+	s << "fragmentation " << getFragmentation() << " (" << staleComponents << " stale)" << std::endl;
+	writeMemory(s, "memory by structure", memoryByStructure);
+	writeMemory(s, "memory by component type", memoryByComponentType);
+	writeMemory(s, "memory by request", memoryByRequest);
+}
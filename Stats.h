@@ -0,0 +1,68 @@
+
+#ifndef INC_STATS
+#define INC_STATS
+
+#include "Component.h"
+
+
+#include <map>
+#include <string>
+#include <ostream>
+#include <cstddef>
+
+
+namespace Cistron {
+
+using std::map;
+using std::string;
+using std::ostream;
+
+
+// memory used by a kind of entry - the bytes are estimated from the sizes of the entries and the container overhead
+struct MemoryUsage {
+	unsigned count;
+	size_t bytes;
+	MemoryUsage() : count(0), bytes(0) {};
+	inline void add(unsigned c, size_t b) {
+		count += c;
+		bytes += b;
+	}
+};
+
+
+// a snapshot of the statistics of an object manager
+struct ObjectManagerStats {
+
+	// time of the snapshot
+	Time time;
+
+	// number of living objects and components
+	unsigned objects;
+	unsigned components;
+
+	// destroyed components still listed by their object, until it's compacted
+	unsigned staleComponents;
+
+	// memory by internal structure, by component type, and by request name (messages and component requests)
+	map<string, MemoryUsage> memoryByStructure;
+	map<string, MemoryUsage> memoryByComponentType;
+	map<string, MemoryUsage> memoryByRequest;
+
+	ObjectManagerStats() : time(0), objects(0), components(0), staleComponents(0) {};
+
+	// total memory of all structures
+	MemoryUsage getTotalMemory() const;
+
+	// fraction of the component entries of the objects that are stale - 0 after a full compaction
+	double getFragmentation() const;
+
+	// write the statistics as text
+	void write(ostream&) const;
+
+};
+
+
+};
+
+
+#endif
@@ -0,0 +1,260 @@
+
+#include "System.h"
+#include "ObjectManager.h"
+
+
+using namespace Cistron;
+
+
+#include <algorithm>
+#include <boost/bind.hpp>
+
+
+// returned for types that weren't collected
+static const vector<Component*> NoComponents;
+
+
+/**
+ * SYSTEM CONTEXT
+ */
+
+// living components of a type
+vector<Component*> const & SystemContext::getComponents(Atom type) {
+	map<AtomId, vector<Component*> >::iterator it = fComponents.find(type.getId());
+	if (it == fComponents.end()) return NoComponents;
+	return it->second;
+}
+
+// changed components of a type
+vector<Component*> const & SystemContext::getChanged(Atom type) {
+	if (fComponents.find(type.getId()) == fComponents.end()) return NoComponents;
+	return fObjectManager->getChangedComponents(type);
+}
+
+// inbox
+Inbox* SystemContext::getInbox() {
+	return fObjectManager->getInbox();
+}
+
+
+/**
+ * SYSTEMS
+ */
+
+// declare types
+void System::reads(Atom type) {
+	if (std::find(fReads.begin(), fReads.end(), type) == fReads.end()) fReads.push_back(type);
+}
+void System::writes(Atom type) {
+	if (std::find(fWrites.begin(), fWrites.end(), type) == fWrites.end()) fWrites.push_back(type);
+}
+
+
+/**
+ * SCHEDULING
+ */
+
+// constructor/destructor
+SystemScheduler::SystemScheduler() : fDirty(false), fUnfinished(0), fContext(0), fUnfinishedTasks(0), fThreadCount(0), fStop(false) {
+}
+SystemScheduler::~SystemScheduler() {
+	stop();
+}
+
+
+// set the number of threads
+void SystemScheduler::setThreads(unsigned threads) {
+	stop();
+	fThreadCount = threads;
+}
+
+
+// get the number of threads
+unsigned SystemScheduler::getThreads() {
+	unsigned threads = fThreadCount != 0 ? fThreadCount : boost::thread::hardware_concurrency();
+	return threads != 0 ? threads : 1;
+}
+
+
+// add a system
+void SystemScheduler::add(System *system) {
+	fSystems.push_back(system);
+	fDirty = true;
+}
+
+// remove a system
+bool SystemScheduler::remove(System *system) {
+	vector<System*>::iterator it = std::find(fSystems.begin(), fSystems.end(), system);
+	if (it == fSystems.end()) return false;
+	fSystems.erase(it);
+	fDirty = true;
+	return true;
+}
+
+
+// every declared type
+vector<Atom> SystemScheduler::getTypes() {
+	vector<Atom> types;
+	for (unsigned i = 0; i < fSystems.size(); ++i) {
+		vector<Atom> const & reads = fSystems[i]->getReads();
+		vector<Atom> const & writes = fSystems[i]->getWrites();
+		for (unsigned t = 0; t < reads.size(); ++t) {
+			if (std::find(types.begin(), types.end(), reads[t]) == types.end()) types.push_back(reads[t]);
+		}
+		for (unsigned t = 0; t < writes.size(); ++t) {
+			if (std::find(types.begin(), types.end(), writes[t]) == types.end()) types.push_back(writes[t]);
+		}
+	}
+	return types;
+}
+
+
+// do two systems conflict? - they do if one writes a type the other reads or writes
+bool SystemScheduler::conflicts(System *a, System *b) {
+	vector<Atom> const & aWrites = a->getWrites();
+	vector<Atom> const & bWrites = b->getWrites();
+	for (unsigned i = 0; i < aWrites.size(); ++i) {
+		if (std::find(bWrites.begin(), bWrites.end(), aWrites[i]) != bWrites.end()) return true;
+		if (std::find(b->getReads().begin(), b->getReads().end(), aWrites[i]) != b->getReads().end()) return true;
+	}
+	for (unsigned i = 0; i < bWrites.size(); ++i) {
+		if (std::find(a->getReads().begin(), a->getReads().end(), bWrites[i]) != a->getReads().end()) return true;
+	}
+	return false;
+}
+
+
+// build the dependencies - a system waits for every earlier system it conflicts with
+void SystemScheduler::build() {
+	fDependents.assign(fSystems.size(), vector<unsigned>());
+	fDependencies.assign(fSystems.size(), 0);
+	for (unsigned j = 0; j < fSystems.size(); ++j) {
+		for (unsigned i = 0; i < j; ++i) {
+			if (conflicts(fSystems[i], fSystems[j])) {
+				fDependents[i].push_back(j);
+				++fDependencies[j];
+			}
+		}
+	}
+	fDirty = false;
+}
+
+
+// start the worker threads
+void SystemScheduler::start() {
+	if (fThreads.size() > 0) return;
+	unsigned threads = getThreads();
+	fStop = false;
+	for (unsigned i = 1; i < threads; ++i) {
+		fThreads.push_back(new boost::thread(boost::bind(&SystemScheduler::work, this)));
+	}
+}
+
+// stop the worker threads
+void SystemScheduler::stop() {
+	{
+		boost::unique_lock<boost::mutex> lock(fMutex);
+		fStop = true;
+	}
+	fWork.notify_all();
+	for (unsigned i = 0; i < fThreads.size(); ++i) {
+		fThreads[i]->join();
+		delete fThreads[i];
+	}
+	fThreads.clear();
+}
+
+
+// run a ready system, and release the systems waiting for it
+void SystemScheduler::runReady(boost::unique_lock<boost::mutex>& lock) {
+	unsigned s = fReady.front();
+	fReady.pop_front();
+
+	// run it without the lock
+	lock.unlock();
+	fSystems[s]->update(*fContext);
+	lock.lock();
+
+	// release its dependents
+	bool notify = false;
+	for (unsigned i = 0; i < fDependents[s].size(); ++i) {
+		unsigned d = fDependents[s][i];
+		if (--fRemaining[d] == 0) {
+			fReady.push_back(d);
+			notify = true;
+		}
+	}
+	if (--fUnfinished == 0) notify = true;
+	if (notify) fWork.notify_all();
+}
+
+
+// run a task
+void SystemScheduler::runTask(boost::unique_lock<boost::mutex>& lock) {
+	boost::function<void()> const * task = fTasks.front();
+	fTasks.pop_front();
+
+	// run it without the lock
+	lock.unlock();
+	(*task)();
+	lock.lock();
+
+	// the last one wakes up the caller
+	if (--fUnfinishedTasks == 0) fWork.notify_all();
+}
+
+
+// worker thread
+void SystemScheduler::work() {
+	boost::unique_lock<boost::mutex> lock(fMutex);
+	while (true) {
+		while (!fStop && fReady.size() == 0 && fTasks.size() == 0) fWork.wait(lock);
+		if (fStop) return;
+		if (fTasks.size() > 0) runTask(lock);
+		else runReady(lock);
+	}
+}
+
+
+// run every system once
+void SystemScheduler::run(SystemContext& context) {
+	if (fSystems.size() == 0) return;
+	if (fDirty) build();
+	start();
+
+	// the systems without dependencies are ready
+	boost::unique_lock<boost::mutex> lock(fMutex);
+	fContext = &context;
+	fRemaining = fDependencies;
+	fUnfinished = fSystems.size();
+	for (unsigned i = 0; i < fSystems.size(); ++i) {
+		if (fRemaining[i] == 0) fReady.push_back(i);
+	}
+	fWork.notify_all();
+
+	// help until all systems finished
+	while (fUnfinished > 0) {
+		if (fReady.size() > 0) runReady(lock);
+		else fWork.wait(lock);
+	}
+	fContext = 0;
+}
+
+
+// run tasks on the thread pool
+void SystemScheduler::runParallel(vector<boost::function<void()> > const & tasks) {
+	if (tasks.size() == 0) return;
+	start();
+
+	// queue them
+	boost::unique_lock<boost::mutex> lock(fMutex);
+	for (unsigned i = 0; i < tasks.size(); ++i) fTasks.push_back(&tasks[i]);
+	fUnfinishedTasks += tasks.size();
+	fWork.notify_all();
+
+	// help until all tasks finished
+	while (fUnfinishedTasks > 0) {
+		if (fTasks.size() > 0) runTask(lock);
+		else fWork.wait(lock);
+	}
+}
@@ -0,0 +1,218 @@
+
+#ifndef INC_SYSTEM
+#define INC_SYSTEM
+
+#include "Component.h"
+#include "Inbox.h"
+
+
+#include <vector>
+#include <map>
+#include <deque>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+
+namespace Cistron {
+
+using std::vector;
+using std::map;
+using std::deque;
+
+class ObjectManager;
+
+
+/**
+ * SYSTEM CONTEXT
+ * What a system sees while it runs. Systems run on worker threads: they read and write the components of the
+ * types they declared, and record structural changes in their command buffer or post them to the inbox, which
+ * are executed at the sync point after all systems ran.
+ */
+class SystemContext {
+
+	public:
+
+		// constructor
+		SystemContext(ObjectManager *objectManager) : fObjectManager(objectManager), fTime(0), fDelta(0) {};
+
+		// living components of a type the system declared
+		vector<Component*> const & getComponents(Atom type);
+
+		// components of a type the system declared that changed in this tick, or were written by a system in the previous one
+		vector<Component*> const & getChanged(Atom type);
+
+		// time of the object manager, and the time advanced in this tick
+		inline Time getTime() {
+			return fTime;
+		}
+		inline Time getDelta() {
+			return fDelta;
+		}
+
+		// inbox for messages and structural changes
+		Inbox* getInbox();
+
+	private:
+
+		// object manager the systems run on
+		ObjectManager *fObjectManager;
+
+		// living components, by atom id of their type
+		map<AtomId, vector<Component*> > fComponents;
+
+		// time
+		Time fTime;
+		Time fDelta;
+
+		// the object manager fills the context
+		friend class ObjectManager;
+
+};
+
+
+/**
+ * SYSTEMS
+ */
+class System {
+
+	public:
+
+		// constructor/destructor
+		System(Atom name) : fName(name) {};
+		virtual ~System() {};
+
+		// declare the component types the system reads and writes - declare them before adding the system
+		void reads(Atom type);
+		void writes(Atom type);
+
+		// run the system - must not throw
+		virtual void update(SystemContext&) = 0;
+
+		// get the name
+		inline Atom getName() {
+			return fName;
+		}
+
+		// declared types
+		inline vector<Atom> const & getReads() {
+			return fReads;
+		}
+		inline vector<Atom> const & getWrites() {
+			return fWrites;
+		}
+
+		// command buffer for structural changes, executed at the sync point - only for use in update
+		inline CommandBuffer& getCommands() {
+			return fCommands;
+		}
+
+	private:
+
+		// name of the system
+		Atom fName;
+
+		// declared types
+		vector<Atom> fReads;
+		vector<Atom> fWrites;
+
+		// recorded structural changes
+		CommandBuffer fCommands;
+
+};
+
+
+/**
+ * SCHEDULING
+ * Systems that access the same type, with at least one of them writing it, run in the order they were added.
+ * Other systems run in parallel on a thread pool. The thread calling run works as well.
+ */
+class SystemScheduler {
+
+	public:
+
+		// constructor/destructor
+		SystemScheduler();
+		virtual ~SystemScheduler();
+
+		// set the number of threads, including the calling thread - 0 for the number of cores
+		void setThreads(unsigned);
+
+		// get the number of threads, including the calling thread
+		unsigned getThreads();
+
+		// add/remove a system - systems are owned by the caller
+		void add(System*);
+		bool remove(System*);
+
+		// number of systems, and a system in the order they were added
+		inline unsigned size() {
+			return fSystems.size();
+		}
+		inline System* get(unsigned index) {
+			return fSystems[index];
+		}
+
+		// every type any system declared
+		vector<Atom> getTypes();
+
+		// run every system once
+		void run(SystemContext&);
+
+		// run independent tasks on the thread pool, and wait for them
+		void runParallel(vector<boost::function<void()> > const & tasks);
+
+	private:
+
+		// do two systems conflict?
+		bool conflicts(System*, System*);
+
+		// build the dependencies
+		void build();
+
+		// start/stop the worker threads
+		void start();
+		void stop();
+
+		// worker thread
+		void work();
+
+		// run a ready system or task, with the lock held
+		void runReady(boost::unique_lock<boost::mutex>&);
+		void runTask(boost::unique_lock<boost::mutex>&);
+
+		// systems, in the order they were added
+		vector<System*> fSystems;
+
+		// systems that wait for a system, and the number of systems a system waits for
+		vector<vector<unsigned> > fDependents;
+		vector<unsigned> fDependencies;
+
+		// do the dependencies need to be built again?
+		bool fDirty;
+
+		// state of a run
+		vector<unsigned> fRemaining;
+		deque<unsigned> fReady;
+		unsigned fUnfinished;
+		SystemContext *fContext;
+
+		// tasks waiting for a thread, and the number of tasks that didn't finish
+		deque<boost::function<void()> const *> fTasks;
+		unsigned fUnfinishedTasks;
+
+		// thread pool
+		unsigned fThreadCount;
+		vector<boost::thread*> fThreads;
+		bool fStop;
+		boost::mutex fMutex;
+		boost::condition_variable fWork;
+
+};
+
+
+};
+
+
+#endif
@@ -0,0 +1,746 @@
+/**
+ * Test program checking the object manager features that the example program doesn't show the results of.
+ * Every test builds its own object managers, and compares what they did with what they should have done.
+ *
+ * Usage: Tests
+ *
+ * It prints the checks that failed, and the number of checks, and returns 1 if any of them failed.
+ */
+
+#include "Cistron.h"
+
+using namespace Cistron;
+
+
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+
+
+/**
+ * CHECKS
+ */
+
+// test being run
+static string gTest;
+
+// number of checks, and of checks that failed
+static unsigned gChecks = 0;
+static unsigned gFailures = 0;
+
+// check a condition of the test being run
+static void check(bool ok, string const & what) {
+	++gChecks;
+	if (ok) return;
+	++gFailures;
+	cout << "FAILED " << gTest << ": " << what << endl;
+}
+
+// random numbers, the same in every run
+static unsigned gSeed = 12345;
+static unsigned nextRandom() {
+	gSeed = gSeed * 1103515245 + 12345;
+	return (gSeed >> 16) & 0x7fff;
+}
+
+
+
+/**
+ * REPLAY
+ */
+
+// sum of the messages received by the components of the replay test
+static int gReplayTotal = 0;
+
+// a component adding the payloads it receives, and destroying itself on request
+class Accumulator : public Component {
+
+	public:
+
+		Accumulator(int factor) : Component("Accumulator"), fFactor(factor) {};
+
+		void addedToObject() {
+			requestMessage("Add", &Accumulator::add);
+			requestMessage("Kill", &Accumulator::kill);
+		}
+
+		void add(Message const & msg) {
+			gReplayTotal += fFactor * boost::any_cast<int>(msg.p);
+		}
+
+		void kill(Message const & msg) {
+			if (getOwnerId() == boost::any_cast<int>(msg.p)) destroy();
+		}
+
+		int fFactor;
+};
+
+// a component sending a message to itself after a delay, and adding to everyone when it arrives
+class Beat : public Component {
+
+	public:
+
+		Beat() : Component("Beat") {};
+
+		void addedToObject() {
+			requestMessage("Beat", &Beat::beat);
+			sendMessageDelayed("Beat", 1, 3);
+		}
+
+		void beat(Message const & /*msg*/) {
+			gReplayTotal += 1000;
+			sendMessage("Add", 1);
+		}
+};
+
+// record and replay components
+static void writeAccumulator(Component *comp, RecordWriter& w) {
+	w.writeInt(((Accumulator*)comp)->fFactor);
+}
+static Component* readAccumulator(RecordReader& r) {
+	return new Accumulator(r.readInt());
+}
+static Component* readBeat(RecordReader& /*r*/) {
+	return new Beat();
+}
+
+// replaying a recording does the same as the recorded run
+static void testReplay() {
+	gTest = "replay";
+
+	// record
+	stringstream log;
+	{
+		ObjectManager om;
+		Recorder recorder(log);
+		recorder.registerComponent("Accumulator", &writeAccumulator);
+		om.setRecorder(&recorder);
+		for (int i = 0; i < 50; ++i) {
+			ObjectId id = om.createObject();
+			om.addComponent(id, new Accumulator(i % 5));
+			om.addComponent(id, new Accumulator(i % 7));
+			om.finalizeObject(id);
+		}
+		Beat *beat = new Beat();
+		om.addComponent(om.createObject(), beat);
+		for (int i = 0; i < 20; ++i) {
+			om.sendGlobalMessage("Add", beat, i);
+			om.sendGlobalMessage("Kill", beat, i);
+			om.sendMessageToObject("Add", beat, 49 - i, i);
+			om.tick(2);
+		}
+		om.setRecorder(0);
+	}
+	int recorded = gReplayTotal;
+	check(recorded != 0, "the recorded run delivers messages");
+
+	// replay
+	gReplayTotal = 0;
+	ObjectManager om;
+	Replayer replayer(&om);
+	replayer.registerComponent("Accumulator", &readAccumulator);
+	replayer.registerComponent("Beat", &readBeat);
+	check(replayer.load(log), "the recording loads");
+	check(replayer.replay(), "the recording replays");
+	check(replayer.getMismatches() == 0, "the replay creates the same ids");
+	check(gReplayTotal == recorded, "the replay delivers the same messages");
+}
+
+
+
+/**
+ * REPLICATION
+ */
+
+// a replicated component with a value
+class Value : public Component {
+
+	public:
+
+		Value(int value = 0) : Component("Value"), fValue(value) {};
+
+		int fValue;
+		string fText;
+};
+
+// a component that is replicated by the source, but not applied by the replica
+class Counter : public Component {
+
+	public:
+
+		Counter() : Component("Counter"), fCount(0) {};
+
+		int fCount;
+};
+
+// replicate components
+static void writeValue(Component *comp, RecordWriter& w) {
+	w.writeInt(((Value*)comp)->fValue);
+	w.writeString(((Value*)comp)->fText);
+}
+static Component* createValue(RecordReader& r) {
+	Value *value = new Value(r.readInt());
+	value->fText = r.readString();
+	return value;
+}
+static void readValue(Component *comp, RecordReader& r) {
+	((Value*)comp)->fValue = r.readInt();
+	((Value*)comp)->fText = r.readString();
+}
+static void writeCounter(Component *comp, RecordWriter& w) {
+	w.writeInt(((Counter*)comp)->fCount);
+}
+
+// the values of an object, in order
+static vector<string> getValues(ObjectManager& om, ObjectId id) {
+	vector<string> values;
+	list<Component*> comps = om.getComponents(id, "Value");
+	for (list<Component*>::iterator it = comps.begin(); it != comps.end(); ++it) {
+		stringstream s;
+		s << ((Value*)*it)->fValue << " " << ((Value*)*it)->fText;
+		values.push_back(s.str());
+	}
+	std::sort(values.begin(), values.end());
+	return values;
+}
+
+// a replica applying the frames of a source has the same values, also when it doesn't know every replicated type
+static void testReplication() {
+	gTest = "replication";
+
+	// the source replicates both types
+	stringstream stream;
+	StreamSink sink(stream);
+	Replicator replicator(&sink);
+	replicator.registerComponent("Value", &writeValue);
+	replicator.registerComponent("Counter", &writeCounter);
+	ObjectManager source;
+	source.setReplicator(&replicator);
+	vector<ObjectId> objects;
+	vector<bool> alive;
+	vector<Component*> values;
+	vector<Component*> counters;
+	for (int i = 0; i < 1000; ++i) {
+		ObjectId id = source.createObject();
+		objects.push_back(id);
+		alive.push_back(true);
+		values.push_back(new Value(i));
+		source.addComponent(id, values.back());
+		counters.push_back(new Counter());
+		source.addComponent(id, counters.back());
+	}
+
+	// change, move, destroy and create components for a while
+	unsigned ticks = 30;
+	for (unsigned t = 0; t < ticks; ++t) {
+		for (unsigned k = 0; k < 20; ++k) {
+			Value *value = (Value*)values[nextRandom() % values.size()];
+			if (!value->isDestroyed()) {
+				value->fValue += nextRandom();
+				if (k % 5 == 0) value->fText += "ab";
+				value->markChanged();
+			}
+			Counter *counter = (Counter*)counters[nextRandom() % counters.size()];
+			if (!counter->isDestroyed()) {
+				++counter->fCount;
+				counter->markChanged();
+			}
+		}
+		if (t % 10 == 2) {
+			Component *counter = counters[nextRandom() % counters.size()];
+			unsigned i = nextRandom() % objects.size();
+			if (!counter->isDestroyed() && alive[i]) source.moveComponent(counter, objects[i]);
+		}
+		if (t % 10 == 4) {
+			Component *value = values[nextRandom() % values.size()];
+			unsigned i = nextRandom() % objects.size();
+			if (!value->isDestroyed() && alive[i]) source.moveComponent(value, objects[i]);
+		}
+		if (t % 10 == 5) {
+			unsigned i = nextRandom() % objects.size();
+			if (alive[i]) source.destroyObject(objects[i]);
+			alive[i] = false;
+		}
+		if (t % 10 == 7) {
+			ObjectId id = source.createObject();
+			objects.push_back(id);
+			alive.push_back(true);
+			values.push_back(new Value(-1));
+			source.addComponent(id, values.back());
+		}
+		source.tick(1);
+	}
+
+	// the replica only applies values
+	ObjectManager replica;
+	ReplicationApplier applier(&replica);
+	applier.registerComponent("Value", &createValue, &readValue);
+	check(applier.apply(stream) == ticks, "every frame applies");
+	check(applier.getTime() == source.getTime(), "the replica is at the time of the source");
+
+	// the same values in the same objects
+	unsigned different = 0;
+	unsigned missing = 0;
+	for (unsigned i = 0; i < objects.size(); ++i) {
+		ObjectId id = applier.getReplicaId(objects[i]);
+		if (!alive[i]) {
+			if (id != -1) ++different;
+			continue;
+		}
+		vector<string> expected = getValues(source, objects[i]);
+		if (id == -1) {
+			if (expected.size() > 0) ++missing;
+			continue;
+		}
+		if (getValues(replica, id) != expected) ++different;
+	}
+	check(missing == 0, "every object with values has a replica");
+	check(different == 0, "the replicas have the same values, and destroyed objects have none");
+	check(replica.getComponentsOfType("Counter").size() == 0, "types the replica doesn't apply are skipped");
+}
+
+
+
+/**
+ * STAGING
+ */
+
+// a job paying a salary
+class Job : public Component {
+
+	public:
+
+		Job(int salary) : Component("Job"), fSalary(salary) {};
+
+		void addedToObject() {
+			answerQuery("Salary", &Job::getSalary);
+		}
+
+		int getSalary(Message const & /*msg*/) {
+			return fSalary;
+		}
+
+		int fSalary;
+};
+
+// a worker counting the jobs of its object
+class Worker : public Component {
+
+	public:
+
+		Worker() : Component("Worker"), fJobs(0) {};
+
+		void addedToObject() {
+			requestComponent("Job", &Worker::job, true);
+		}
+
+		void job(Message const & msg) {
+			if (msg.type == CREATE) ++fJobs;
+		}
+
+		int fJobs;
+};
+
+// a registry counting all jobs and workers
+class Registry : public Component {
+
+	public:
+
+		Registry() : Component("Registry"), fJobs(0), fWorkers(0) {};
+
+		void addedToObject() {
+			requestComponent("Job", &Registry::job);
+			requestComponent("Worker", &Registry::worker);
+		}
+
+		void job(Message const & msg) {
+			if (msg.type == CREATE) ++fJobs;
+			else if (msg.type == DESTROY) --fJobs;
+		}
+
+		void worker(Message const & msg) {
+			if (msg.type == CREATE) ++fWorkers;
+		}
+
+		int fJobs;
+		int fWorkers;
+};
+
+// a census counting the registries
+class Census : public Component {
+
+	public:
+
+		Census() : Component("Census"), fRegistries(0) {};
+
+		void addedToObject() {
+			requestComponent("Registry", &Census::registry);
+		}
+
+		void registry(Message const & msg) {
+			if (msg.type == CREATE) ++fRegistries;
+		}
+
+		int fRegistries;
+};
+
+// build a part of the world in a staging object manager - every worker has a job paying its index, odd ones a second one
+static const int StagedWorkers = 1000;
+static void stage(ObjectManager *om, string name) {
+	for (int i = 0; i < StagedWorkers; ++i) {
+		ObjectId id = om->createObject();
+		om->addComponent(id, new Job(i));
+		if (i % 2 == 1) om->addComponent(id, new Job(1));
+		om->addComponent(id, new Worker());
+		om->joinGroup(id, "Workers");
+	}
+	ObjectId id = om->createObject();
+	om->addComponent(id, new Census());
+	om->registerName(id, name);
+}
+
+// worlds built in parallel and merged have their ids rebased, and their components see the existing ones and each other
+static void testMerge() {
+	gTest = "merge";
+
+	// the existing world
+	ObjectManager om;
+	Registry *registry = new Registry();
+	ObjectId registryId = om.createObject();
+	om.addComponent(registryId, registry);
+	om.registerName(registryId, "registry");
+	for (int i = 0; i < 3; ++i) om.addComponent(om.createObject(), new Job(100));
+	ObjectId existing = om.createObject();
+	om.destroyObject(existing);
+
+	// staged in parallel
+	ObjectManager first, second;
+	boost::thread firstThread(stage, &first, string("first"));
+	boost::thread secondThread(stage, &second, string("second"));
+	firstThread.join();
+	secondThread.join();
+
+	// merged after the existing objects, one block after the other
+	ObjectId firstOffset = om.merge(first);
+	ObjectId secondOffset = om.merge(second);
+	check(firstOffset == existing + 1, "the first block starts after the existing objects");
+	check(secondOffset == firstOffset + StagedWorkers + 1, "the second block starts after the first one");
+	check(om.getComponentsOfType("Worker").size() == 2 * StagedWorkers, "every component is merged");
+	check(om.getGroupMembers("Workers").size() == 2 * StagedWorkers, "groups are merged");
+	check(om.getObjectId("registry") == registryId, "existing names keep their object");
+	check(om.getObjectId("first") == firstOffset + StagedWorkers, "merged names are rebased");
+	check(om.getObjectId("second") == secondOffset + StagedWorkers, "merged names are rebased, for every block");
+
+	// the requests of every side see the components of the other
+	check(registry->fJobs == 3 + 3 * StagedWorkers, "existing requests see the merged components");
+	check(registry->fWorkers == 2 * StagedWorkers, "existing requests see the merged components of every type");
+	Census *census = (Census*)om.getComponentsOfType("Census")[0];
+	check(census->fRegistries == 1, "merged requests see the existing components");
+	Worker *worker = (Worker*)om.getComponents(secondOffset + 5, "Worker").front();
+	om.addComponent(secondOffset + 5, new Job(0));
+	check(worker->fJobs == 3 && worker->getOwnerId() == secondOffset + 5, "merged local requests keep their object");
+
+	// the answers are merged and rebased too
+	int salaries = registry->ask<int>("Salary", std::plus<int>(), 0);
+	check(salaries == 300 + 2 * (StagedWorkers * (StagedWorkers - 1) / 2 + StagedWorkers / 2), "merged answers are asked");
+	check(registry->askObject<int>(firstOffset + 3, "Salary", std::plus<int>(), 0) == 4, "merged answers are asked by object");
+
+	// and the merged objects can be destroyed
+	int jobs = registry->fJobs;
+	om.destroyObject(firstOffset + 3);
+	check(registry->fJobs == jobs - 2, "merged components are destroyed");
+	check(om.getGroupMembers("Workers").size() == 2 * StagedWorkers - 1, "merged objects leave their groups");
+
+	// a staging object manager can be used again, its ids aren't reused
+	ObjectId id = first.createObject();
+	first.addComponent(id, new Worker());
+	ObjectId offset = om.merge(first);
+	check(om.getComponents(offset + id, "Worker").size() == 1, "a staging object manager can be merged again");
+	check(registry->fWorkers == 2 * StagedWorkers + 1, "existing requests see the components merged again");
+	om.shutdown();
+}
+
+
+
+/**
+ * TIMERS
+ */
+
+// a component remembering when it received its alarms
+class Alarm : public Component {
+
+	public:
+
+		Alarm() : Component("Alarm") {};
+
+		void addedToObject() {
+			requestMessage("Alarm", &Alarm::alarm);
+		}
+
+		void alarm(Message const & msg) {
+			fReceived.push_back(pair<int, Time>(boost::any_cast<int>(msg.p), getObjectManager()->getTime()));
+		}
+
+		vector<pair<int, Time> > fReceived;
+};
+
+// timers expire once, at their time and in order, from every level of the wheel, and cancelled ones never do
+static void testTimers() {
+	gTest = "timers";
+
+	// delays from a few ticks to many turns of the wheel
+	ObjectManager om;
+	ObjectId id = om.createObject();
+	Alarm *alarm = new Alarm();
+	om.addComponent(id, alarm);
+	vector<Time> delays;
+	for (int i = 0; i < 2000; ++i) {
+		delays.push_back(1 + nextRandom() * 10 % (i % 3 == 0 ? 300000 : i % 3 == 1 ? 20000 : 300));
+		alarm->sendMessageDelayed("Alarm", delays.back(), i);
+	}
+	check(alarm->cancelMessage(alarm->sendMessageDelayed("Alarm", 50, -1)), "a pending timer is cancelled");
+	alarm->sendMessageToObjectPeriodic(id, "Alarm", 1000, -2);
+	for (int t = 0; t < 400; ++t) om.tick(1000);
+
+	// every delayed alarm once, at its time
+	vector<unsigned> received(delays.size(), 0);
+	unsigned late = 0;
+	unsigned unordered = 0;
+	unsigned cancelled = 0;
+	unsigned periodic = 0;
+	for (unsigned i = 0; i < alarm->fReceived.size(); ++i) {
+		int payload = alarm->fReceived[i].first;
+		Time time = alarm->fReceived[i].second;
+		if (i > 0 && time < alarm->fReceived[i-1].second) ++unordered;
+		if (payload == -1) ++cancelled;
+		else if (payload == -2) {
+			if (time != 1000 * (periodic + 1)) ++late;
+			++periodic;
+		}
+		else {
+			if (time != delays[payload]) ++late;
+			++received[payload];
+		}
+	}
+	check(std::count(received.begin(), received.end(), 1) == (int)delays.size(), "every timer expires once");
+	check(late == 0, "every timer expires at its time");
+	check(unordered == 0, "timers expire in order");
+	check(cancelled == 0, "cancelled timers don't expire");
+	check(periodic == 400, "periodic timers expire every period");
+}
+
+// timers to an object that is being destroyed are cancelled, even while its components are destroyed over several ticks
+static void testTimerTarget() {
+	gTest = "timer target";
+	ObjectManager om;
+	om.setDestructionBudget(1);
+	Alarm *sender = new Alarm();
+	om.addComponent(om.createObject(), sender);
+	ObjectId target = om.createObject();
+	vector<Alarm*> alarms;
+	for (int i = 0; i < 6; ++i) {
+		alarms.push_back(new Alarm());
+		om.addComponent(target, alarms.back());
+	}
+	TimerId timer = sender->sendMessageToObjectPeriodic(target, "Alarm", 1, 0);
+	om.tick(1);
+	check(alarms[0]->fReceived.size() == 1, "the timer expires while the target lives");
+
+	om.destroyObject(target);
+	om.tick(1);
+	om.tick(1);
+	unsigned received = 0;
+	for (unsigned i = 0; i < alarms.size(); ++i) received += alarms[i]->fReceived.size();
+	check(received == alarms.size(), "the timer doesn't expire once the target is dying");
+	check(!sender->cancelMessage(timer), "the timer is cancelled");
+}
+
+
+
+/**
+ * INBOXES
+ */
+
+// a component counting the messages posted to it
+class Mailbox : public Component {
+
+	public:
+
+		Mailbox() : Component("Mailbox"), fMessages(0), fSum(0) {};
+
+		void addedToObject() {
+			requestMessage("Mail", &Mailbox::mail);
+		}
+
+		void mail(Message const & msg) {
+			++fMessages;
+			fSum += boost::any_cast<int>(msg.p);
+		}
+
+		int fMessages;
+		long fSum;
+};
+
+// post to a blocking inbox from another thread
+static const int PostedMessages = 20000;
+static void postMail(Inbox *inbox, Component *sender) {
+	for (int i = 0; i < PostedMessages; ++i) inbox->postMessage(sender, "Mail", i);
+}
+
+// the object inbox being posted to by the closing test, and the posts it accepted
+static boost::atomic<Inbox*> gPostedInbox(0);
+static boost::atomic<unsigned> gAcceptedPosts(0);
+static boost::atomic<bool> gPosting(true);
+
+// post to the object inbox that is current, until the test is done
+static void postToObjects(Component *sender) {
+	while (gPosting.load()) {
+		Inbox *inbox = gPostedInbox.exchange(0);
+		if (inbox == 0) {
+			boost::this_thread::yield();
+			continue;
+		}
+		for (int i = 0; i < 100; ++i) {
+			if (inbox->postMessage(sender, "Mail", 1)) ++gAcceptedPosts;
+		}
+		inbox->release();
+	}
+}
+
+// full inboxes reject or block posts as configured, and closed ones only accept the posts they will execute
+static void testInboxes() {
+	gTest = "inboxes";
+
+	// a rejecting inbox is full at its capacity
+	{
+		ObjectManager om(10, INBOX_REJECT);
+		Mailbox *mailbox = new Mailbox();
+		om.addComponent(om.createObject(), mailbox);
+		unsigned accepted = 0;
+		for (int i = 0; i < 15; ++i) {
+			if (om.getInbox()->postMessage(mailbox, "Mail", 1)) ++accepted;
+		}
+		check(accepted == 10, "a full inbox rejects posts");
+		check(om.processInbox() == 10 && mailbox->fMessages == 10, "the accepted posts are executed");
+		check(om.getInbox()->postMessage(mailbox, "Mail", 1), "a processed inbox accepts posts again");
+	}
+
+	// a blocking inbox makes the posting threads wait for the owning thread
+	{
+		ObjectManager om(100, INBOX_BLOCK);
+		Mailbox *mailbox = new Mailbox();
+		om.addComponent(om.createObject(), mailbox);
+		boost::thread_group threads;
+		for (int t = 0; t < 4; ++t) threads.create_thread(boost::bind(&postMail, om.getInbox(), mailbox));
+		while (mailbox->fMessages < 4 * PostedMessages) om.tick(1);
+		threads.join_all();
+		om.processInbox();
+		check(mailbox->fMessages == 4 * PostedMessages, "a full blocking inbox loses no posts");
+		check(mailbox->fSum == 4 * ((long)PostedMessages * (PostedMessages - 1) / 2), "every post is executed once");
+	}
+
+	// objects are destroyed while other threads post to their inboxes
+	{
+		ObjectManager om;
+		Mailbox *sender = new Mailbox();
+		om.addComponent(om.createObject(), sender);
+		boost::thread_group threads;
+		for (int t = 0; t < 3; ++t) threads.create_thread(boost::bind(&postToObjects, sender));
+		unsigned executed = 0;
+		for (int i = 0; i < 500; ++i) {
+			ObjectId id = om.createObject();
+			om.addComponent(id, new Mailbox());
+			Inbox *previous = gPostedInbox.exchange(om.getObjectInbox(id));
+			if (previous != 0) previous->release();
+			for (volatile int k = 0; k < (i % 7) * 20000; ++k);
+			om.destroyObject(id);
+			executed += om.processInbox();
+		}
+		gPosting = false;
+		threads.join_all();
+		Inbox *previous = gPostedInbox.exchange(0);
+		if (previous != 0) previous->release();
+		executed += om.processInbox();
+		check(gAcceptedPosts.load() > 0, "an object inbox accepts posts");
+		check(executed == gAcceptedPosts.load(), "every post accepted by a closing inbox is executed");
+	}
+}
+
+
+
+/**
+ * COMPACTION
+ */
+
+// compaction removes the destroyed components listed by objects, within its budget, and keeps the ordinals of the others
+static void testCompaction() {
+	gTest = "compaction";
+
+	// objects listing many destroyed jobs, and a few living ones - the jobs kept are in objects that aren't destroyed
+	ObjectManager om;
+	vector<ObjectId> objects;
+	vector<Component*> jobs;
+	for (int i = 0; i < 50; ++i) {
+		objects.push_back(om.createObject());
+		om.addComponent(objects.back(), new Worker());
+		om.finalizeObject(objects.back());
+	}
+	for (int r = 0; r < 20; ++r) {
+		for (int i = 0; i < 50; ++i) {
+			Component *job = new Job(r);
+			om.addComponent(objects[i], job);
+			if (r < 19 || i % 2 == 0) job->destroy();
+			else if (i % 3 != 0) jobs.push_back(job);
+		}
+	}
+	for (int i = 0; i < 50; i += 3) om.destroyObject(objects[i]);
+	ObjectManagerStats stats = om.getStats();
+	check(stats.staleComponents > 0 && stats.getFragmentation() > 0, "destroyed components are stale until compacted");
+
+	// the ordinals of the living components
+	vector<unsigned> ordinals;
+	for (unsigned i = 0; i < jobs.size(); ++i) ordinals.push_back(om.getComponentOrdinal(jobs[i]));
+
+	// a budget compacts a part of the objects every tick
+	unsigned stale = stats.staleComponents;
+	om.setCompactionBudget(40);
+	om.tick(1);
+	stats = om.getStats();
+	check(stats.staleComponents < stale && stats.staleComponents > 0, "a tick compacts within the budget");
+
+	// and everything at once
+	om.compact();
+	stats = om.getStats();
+	check(stats.staleComponents == 0 && stats.getFragmentation() == 0, "a full compaction leaves no stale components");
+	check(stats.components == om.getComponentsOfType("Worker").size() + jobs.size(), "compaction keeps the living components");
+	unsigned moved = 0;
+	for (unsigned i = 0; i < jobs.size(); ++i) {
+		if (om.getComponentOrdinal(jobs[i]) != ordinals[i] || om.getComponent(jobs[i]->getOwnerId(), "Job", ordinals[i]) != jobs[i]) ++moved;
+	}
+	check(moved == 0, "compaction keeps the ordinals of the living components");
+}
+
+
+
+/**
+ * MAIN
+ */
+
+int main() {
+	testReplay();
+	testReplication();
+	testMerge();
+	testTimers();
+	testTimerTarget();
+	testInboxes();
+	testCompaction();
+
+	cout << gChecks << " checks, " << gFailures << " failed" << endl;
+	return gFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,219 @@
+
+#include "TimerWheel.h"
+
+
+using namespace Cistron;
+
+
+#include <cassert>
+
+
+// wheel layout: one level of 256 slots, followed by 4 levels of 64 slots, covering the full 32 bit range
+static const unsigned ROOT_BITS = 8;
+static const unsigned LEVEL_BITS = 6;
+static const unsigned ROOT_SIZE = 1 << ROOT_BITS;
+static const unsigned LEVEL_SIZE = 1 << LEVEL_BITS;
+static const unsigned ROOT_MASK = ROOT_SIZE - 1;
+static const unsigned LEVEL_MASK = LEVEL_SIZE - 1;
+static const unsigned N_LEVELS = 4;
+
+// empty slot or end of list
+static const unsigned NIL = 0xffffffff;
+
+
+// first slot of a level
+static inline unsigned levelOffset(unsigned level) {
+	return ROOT_SIZE + (level-1) * LEVEL_SIZE;
+}
+
+// slot index of a time in a level
+static inline unsigned levelIndex(Time t, unsigned level) {
+	return (t >> (ROOT_BITS + (level-1) * LEVEL_BITS)) & LEVEL_MASK;
+}
+
+
+// constructor/destructor
+TimerWheel::TimerWheel() : fTime(0), fNTimers(0) {
+	fSlots.resize(ROOT_SIZE + N_LEVELS * LEVEL_SIZE, NIL);
+}
+TimerWheel::~TimerWheel() {
+}
+
+
+// schedule a timer
+TimerId TimerWheel::schedule(ScheduledMessage const & msg, Time delay) {
+
+	// a timer can't expire in the current time unit
+	if (delay == 0) delay = 1;
+
+	// get a node from the pool
+	unsigned node;
+	if (fFreeNodes.size() > 0) {
+		node = fFreeNodes.back();
+		fFreeNodes.pop_back();
+	}
+	else {
+		node = fNodes.size();
+		fNodes.push_back(TimerNode());
+	}
+
+	// fill it
+	TimerNode& n = fNodes[node];
+	n.msg = msg;
+	n.expires = fTime + delay;
+	++n.generation;
+	if (n.generation == 0) ++n.generation;
+
+	// put it in the wheel
+	insert(node);
+	++fNTimers;
+	return TimerId(node, n.generation);
+}
+
+
+// cancel a timer
+bool TimerWheel::cancel(TimerId id) {
+
+	// must still be the same timer
+	if (id.index >= fNodes.size() || fNodes[id.index].generation != id.generation) return false;
+
+	// remove it from the wheel
+	TimerNode& n = fNodes[id.index];
+	if (n.state == NODE_FREE) return false;
+	if (n.state == NODE_SCHEDULED) unlink(id.index);
+	release(id.index);
+	return true;
+}
+
+
+// get a timer
+ScheduledMessage* TimerWheel::get(TimerId id) {
+	if (id.index >= fNodes.size()) return 0;
+	TimerNode& n = fNodes[id.index];
+	if (n.generation != id.generation || n.state == NODE_FREE) return 0;
+	return &n.msg;
+}
+
+
+// finish an expired timer
+void TimerWheel::expire(TimerId id) {
+
+	// must be an expired timer
+	if (id.index >= fNodes.size()) return;
+	TimerNode& n = fNodes[id.index];
+	if (n.generation != id.generation || n.state != NODE_EXPIRED) return;
+
+	// periodic timers go back in the wheel
+	if (n.msg.period > 0) {
+		n.expires = fTime + n.msg.period;
+		insert(id.index);
+	}
+	else release(id.index);
+}
+
+
+// insert a node in the wheel
+void TimerWheel::insert(unsigned node) {
+	TimerNode& n = fNodes[node];
+	Time delta = n.expires - fTime;
+
+	// find the level
+	unsigned slot;
+	if (delta < ROOT_SIZE) slot = n.expires & ROOT_MASK;
+	else {
+		unsigned level = 1;
+		while (level < N_LEVELS && delta >= (Time(1) << (ROOT_BITS + level * LEVEL_BITS))) ++level;
+		slot = levelOffset(level) + levelIndex(n.expires, level);
+	}
+
+	// push it in front of the slot list
+	n.slot = slot;
+	n.prev = NIL;
+	n.next = fSlots[slot];
+	if (n.next != NIL) fNodes[n.next].prev = node;
+	fSlots[slot] = node;
+	n.state = NODE_SCHEDULED;
+}
+
+
+// remove a node from its slot
+void TimerWheel::unlink(unsigned node) {
+	TimerNode& n = fNodes[node];
+	if (n.prev != NIL) fNodes[n.prev].next = n.next;
+	else fSlots[n.slot] = n.next;
+	if (n.next != NIL) fNodes[n.next].prev = n.prev;
+	n.prev = n.next = NIL;
+}
+
+
+// release a node
+void TimerWheel::release(unsigned node) {
+	TimerNode& n = fNodes[node];
+	n.state = NODE_FREE;
+	n.msg = ScheduledMessage();
+	fFreeNodes.push_back(node);
+	--fNTimers;
+}
+
+
+// cancel every timer - the slots are emptied at once
+void TimerWheel::clear() {
+	for (unsigned i = 0; i < fNodes.size(); ++i) {
+		if (fNodes[i].state != NODE_FREE) release(i);
+	}
+	fSlots.assign(fSlots.size(), NIL);
+}
+
+
+// move the timers of a slot one level down
+unsigned TimerWheel::cascade(unsigned level, unsigned index) {
+
+	// detach the slot
+	unsigned slot = levelOffset(level) + index;
+	unsigned node = fSlots[slot];
+	fSlots[slot] = NIL;
+
+	// re-insert every node, relative to the current time
+	while (node != NIL) {
+		unsigned next = fNodes[node].next;
+		insert(node);
+		node = next;
+	}
+	return index;
+}
+
+
+// advance one time unit
+void TimerWheel::step(vector<TimerId>& expired) {
+
+	// next time unit
+	++fTime;
+
+	// when the root level completes a turn, cascade the higher levels down
+	unsigned index = fTime & ROOT_MASK;
+	if (index == 0) {
+		for (unsigned level = 1; level <= N_LEVELS; ++level) {
+			if (cascade(level, levelIndex(fTime, level)) != 0) break;
+		}
+	}
+
+	// all timers in this slot expire now
+	unsigned node = fSlots[index];
+	fSlots[index] = NIL;
+	while (node != NIL) {
+		TimerNode& n = fNodes[node];
+		unsigned next = n.next;
+		assert(n.expires == fTime);
+		n.prev = n.next = NIL;
+		n.state = NODE_EXPIRED;
+		expired.push_back(TimerId(node, n.generation));
+		node = next;
+	}
+}
+
+
+// advance without timers
+void TimerWheel::skip(Time dt) {
+	assert(fNTimers == 0);
+	fTime += dt;
+}
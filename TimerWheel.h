@@ -0,0 +1,128 @@
+
+#ifndef INC_TIMERWHEEL
+#define INC_TIMERWHEEL
+
+#include "Component.h"
+
+
+#include <vector>
+
+
+namespace Cistron {
+
+using std::vector;
+
+
+// a message waiting in the timer wheel
+struct ScheduledMessage {
+	RequestId reqId;
+	Component *sender;
+	ObjectId target;
+	boost::any payload;
+	Time period;
+	ScheduledMessage() : reqId(0), sender(0), target(-1), period(0) {};
+	ScheduledMessage(RequestId r, Component *c, ObjectId t, boost::any p, Time per) : reqId(r), sender(c), target(t), payload(p), period(per) {};
+};
+
+
+// hierarchical timer wheel
+// the first level has one slot per time unit, every following level has slots that each span a full turn of the previous level
+// timers far in the future are cascaded down a level whenever the level below completes a turn
+// scheduling and cancelling are O(1), every slot is an intrusive list of timer nodes that live in a single pool
+class TimerWheel {
+
+	public:
+
+		// constructor/destructor
+		TimerWheel();
+		virtual ~TimerWheel();
+
+		// schedule a message to expire after the given delay (at least one unit)
+		TimerId schedule(ScheduledMessage const &, Time delay);
+
+		// cancel a timer - returns false if the timer already expired or was cancelled
+		bool cancel(TimerId);
+
+		// advance the wheel by one time unit, and append all timers that expire to the list
+		// expired timers remain valid until expire() is called on them, or until they are cancelled
+		void step(vector<TimerId>& expired);
+
+		// advance the wheel without any timers in it
+		void skip(Time dt);
+
+		// get an expired or scheduled message - returns 0 if the timer no longer exists
+		ScheduledMessage* get(TimerId);
+
+		// finish an expired timer: periodic timers are scheduled again, others are released
+		void expire(TimerId);
+
+		// cancel every timer, keeping the time
+		void clear();
+
+		// current time
+		inline Time getTime() {
+			return fTime;
+		}
+
+		// number of live timers
+		inline unsigned size() {
+			return fNTimers;
+		}
+
+		// memory used by the pool and the slots
+		inline size_t getMemorySize() {
+			return fNodes.capacity() * sizeof(TimerNode) + (fFreeNodes.capacity() + fSlots.capacity()) * sizeof(unsigned);
+		}
+
+	private:
+
+		// state of a node in the pool
+		enum NodeState {
+			NODE_FREE,
+			NODE_SCHEDULED,
+			NODE_EXPIRED
+		};
+
+		// a node in the pool
+		struct TimerNode {
+			ScheduledMessage msg;
+			Time expires;
+			unsigned prev, next;
+			unsigned slot;
+			unsigned generation;
+			NodeState state;
+			TimerNode() : expires(0), prev(0), next(0), slot(0), generation(0), state(NODE_FREE) {};
+		};
+
+		// insert a node in the appropriate slot
+		void insert(unsigned node);
+
+		// remove a node from its slot
+		void unlink(unsigned node);
+
+		// release a node to the free list
+		void release(unsigned node);
+
+		// move all timers in a slot of a higher level down - returns the slot index
+		unsigned cascade(unsigned level, unsigned index);
+
+		// current time
+		Time fTime;
+
+		// node pool, and the list of free nodes
+		vector<TimerNode> fNodes;
+		vector<unsigned> fFreeNodes;
+
+		// head of every slot, over all levels
+		vector<unsigned> fSlots;
+
+		// number of live timers
+		unsigned fNTimers;
+
+};
+
+
+};
+
+
+#endif